@@ -0,0 +1,129 @@
+// Benchmarks for the interpreter. Usage: interpreter_bench [name filter]
+#include <mjs/parser.h>
+#include <mjs/interpreter.h>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+using namespace mjs;
+
+namespace {
+
+struct benchmark {
+    const char*    name;
+    const wchar_t* text;
+};
+
+const benchmark benchmarks[] = {
+    { "loop", LR"(
+var s = 0;
+for (var i = 0; i < 1000000; ++i) {
+    s += i;
+}
+s;
+)" },
+    { "loop in function", LR"(
+function f(n) {
+    var s = 0;
+    for (var i = 0; i < n; ++i) {
+        s += i & 7;
+    }
+    return s;
+}
+f(1000000);
+)" },
+    { "calls", LR"(
+function add(a, b) { return a + b; }
+function f(n) {
+    var s = 0;
+    for (var i = 0; i < n; ++i) {
+        s = add(s, i);
+    }
+    return s;
+}
+f(300000);
+)" },
+    { "recursion", LR"(
+function fib(n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); }
+fib(22);
+)" },
+    { "properties", LR"(
+function point(x, y) { this.x = x; this.y = y; }
+function f(n) {
+    var p = new point(1, 2), s = 0;
+    for (var i = 0; i < n; ++i) {
+        p.x = p.y + i;
+        s += p.x;
+    }
+    return s;
+}
+f(300000);
+)" },
+    { "arrays", LR"(
+function f(n) {
+    var a = new Array(0, 0), s = 0;
+    for (var i = 0; i < n; ++i) {
+        a[i & 1023] = i;
+    }
+    for (var j = 0; j < 1024; ++j) {
+        s += a[j];
+    }
+    return s;
+}
+f(300000);
+)" },
+    { "strings", LR"(
+function f(n) {
+    var s = '';
+    for (var i = 0; i < n; ++i) {
+        s += 'x';
+        if (s.length > 100) s = '';
+    }
+    return s.length;
+}
+f(100000);
+)" },
+    { "closures", LR"(
+function f(n) {
+    var s = 0;
+    for (var i = 0; i < n; ++i) {
+        function g() { return i; }
+        s += g();
+    }
+    return s;
+}
+f(100000);
+)" },
+};
+
+double run(const benchmark& b) {
+    using clock = std::chrono::steady_clock;
+    gc_heap heap{1<<24};
+    auto bs = parse(std::make_shared<source_file>(L"bench", b.text));
+    const auto start = clock::now();
+    {
+        interpreter i{heap, *bs};
+        for (const auto& s: bs->l()) {
+            (void)i.eval(*s);
+        }
+    }
+    return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+}
+
+} // unnamed namespace
+
+int main(int argc, char* argv[]) {
+    const std::string filter = argc > 1 ? argv[1] : "";
+    for (const auto& b: benchmarks) {
+        if (std::string{b.name}.find(filter) == std::string::npos) {
+            continue;
+        }
+        // Best of a few runs
+        double best = run(b);
+        for (int i = 0; i < 4; ++i) {
+            best = std::min(best, run(b));
+        }
+        std::cout << "  " << std::left << std::setw(20) << b.name << std::right << std::fixed << std::setprecision(1) << std::setw(10) << best << " ms\n";
+    }
+}
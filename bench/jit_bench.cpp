@@ -0,0 +1,120 @@
+// Numeric loops run by the interpreter and by the JIT. Usage: jit_bench [name filter]
+#include <mjs/parser.h>
+#include <mjs/interpreter.h>
+#include <mjs/jit.h>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+using namespace mjs;
+
+namespace {
+
+struct benchmark {
+    const char*    name;
+    const wchar_t* text;
+};
+
+const benchmark benchmarks[] = {
+    { "sum", LR"(
+function f(n) {
+    var s = 0;
+    for (var i = 0; i < n; ++i) {
+        s += i;
+    }
+    return s;
+}
+f(3000000);
+)" },
+    { "nested loops", LR"(
+function f(n) {
+    var s = 0;
+    for (var i = 0; i < n; ++i) {
+        for (var j = 0; j < i; ++j) {
+            s += i * j - j;
+        }
+    }
+    return s;
+}
+f(2000);
+)" },
+    { "bit operations", LR"(
+function f(n) {
+    var h = 5381;
+    for (var i = 0; i < n; ++i) {
+        h = ((h << 5) + h + (i & 255)) | 0;
+        h = h ^ (h >>> 13);
+    }
+    return h;
+}
+f(1000000);
+)" },
+    { "float math", LR"(
+function f(n) {
+    var x = 0.5, y = 0, dx = 1 / n;
+    for (var i = 0; i < n; ++i) {
+        y += 4 / (1 + x * x) * dx;
+        x = x + dx;
+    }
+    return y;
+}
+f(2000000);
+)" },
+    { "while countdown", LR"(
+function f(n) {
+    var c = 0;
+    while (n > 0) {
+        if (n % 3 == 0) c++;
+        n = n - 1;
+    }
+    return c;
+}
+f(1000000);
+)" },
+};
+
+double run(const benchmark& b) {
+    using clock = std::chrono::steady_clock;
+    gc_heap heap{1<<24};
+    auto bs = parse(std::make_shared<source_file>(L"bench", b.text));
+    const auto start = clock::now();
+    {
+        interpreter i{heap, *bs};
+        for (const auto& s: bs->l()) {
+            (void)i.eval(*s);
+        }
+    }
+    return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+}
+
+// Best of a few runs
+double best_of(const benchmark& b) {
+    double best = run(b);
+    for (int i = 0; i < 4; ++i) {
+        best = std::min(best, run(b));
+    }
+    return best;
+}
+
+} // unnamed namespace
+
+int main(int argc, char* argv[]) {
+    if (!jit_supported()) {
+        std::cout << "The JIT is not supported on this platform\n";
+        return 1;
+    }
+    const std::string filter = argc > 1 ? argv[1] : "";
+    std::cout << "  " << std::left << std::setw(20) << "" << std::right << std::setw(13) << "interpreter" << std::setw(13) << "jit" << "\n";
+    for (const auto& b: benchmarks) {
+        if (std::string{b.name}.find(filter) == std::string::npos) {
+            continue;
+        }
+        enable_jit(false);
+        const double interpreted = best_of(b);
+        enable_jit(true);
+        const double compiled = best_of(b);
+        std::cout << "  " << std::left << std::setw(20) << b.name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << interpreted << " ms" << std::setw(10) << compiled << " ms" << std::setw(8) << interpreted / compiled << "x\n";
+    }
+}
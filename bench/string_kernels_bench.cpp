@@ -0,0 +1,85 @@
+// Microbenchmark for the string kernels. Usage: string_kernels_bench [text length]
+#include <mjs/string_kernels.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+using namespace mjs;
+
+namespace {
+
+const char* isa_name(string_kernel_isa isa) {
+    switch (isa) {
+    case string_kernel_isa::scalar: return "scalar";
+    case string_kernel_isa::sse2:   return "sse2";
+    case string_kernel_isa::avx2:   return "avx2";
+    }
+    return "?";
+}
+
+volatile size_t sink;
+
+template<typename F>
+void run(const char* name, size_t bytes, F f) {
+    using clock = std::chrono::steady_clock;
+    // Repeat until enough time has passed to get a stable result
+    size_t iterations = 0;
+    const auto start = clock::now();
+    auto elapsed = clock::duration{};
+    do {
+        for (int i = 0; i < 16; ++i) {
+            sink = f();
+        }
+        iterations += 16;
+        elapsed = clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(200));
+    const double secs = std::chrono::duration<double>(elapsed).count();
+    std::cout << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(10) << secs * 1e9 / iterations << " ns/op"
+        << std::setw(10) << (bytes * iterations) / secs / 1e9 << " GB/s\n";
+}
+
+} // unnamed namespace
+
+int main(int argc, char* argv[]) {
+    const size_t length = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4096;
+
+    // Natural-ish text without the needles, which are placed at the end
+    std::wstring text;
+    const std::wstring_view words[] = { L"lorem ", L"ipsum ", L"dolor ", L"sit ", L"amet, ", L"consectetur ", L"adipiscing ", L"elit " };
+    for (size_t i = 0; text.length() < length; ++i) {
+        text += words[(i * 5 + i / 3) % std::size(words)];
+    }
+    text.resize(length);
+    const std::wstring_view needle = L"needle in the haystack";
+    text.replace(text.length() - needle.length(), needle.length(), needle);
+    std::wstring other = text;
+    other.back() = L'!';
+
+    const size_t bytes = text.length() * sizeof(wchar_t);
+    const std::wstring_view s{text}, o{other};
+
+    const auto best = current_string_kernels();
+    for (const auto isa: {string_kernel_isa::scalar, string_kernel_isa::sse2, string_kernel_isa::avx2}) {
+        if (select_string_kernels(isa) != isa) {
+            continue;
+        }
+        std::cout << isa_name(isa) << " (" << length << " characters)\n";
+        run("find char", bytes, [&] { return string_find(s, L'y'); });
+        run("rfind char", bytes, [&] { return string_rfind(s, L'\n'); });
+        run("find", bytes, [&] { return string_find(s, needle); });
+        run("rfind", bytes, [&] { return string_rfind(s, L"lorem ipsum sit"); });
+        run("equal", bytes, [&] { return static_cast<size_t>(string_equal(s, o)); });
+        run("compare", bytes, [&] { return static_cast<size_t>(string_compare(s, o)); });
+    }
+    std::cout << "std::wstring_view (" << length << " characters)\n";
+    run("find char", bytes, [&] { return s.find(L'y'); });
+    run("rfind char", bytes, [&] { return s.rfind(L'\n'); });
+    run("find", bytes, [&] { return s.find(needle); });
+    run("rfind", bytes, [&] { return s.rfind(L"lorem ipsum sit"); });
+    run("equal", bytes, [&] { return static_cast<size_t>(s == o); });
+    run("compare", bytes, [&] { return static_cast<size_t>(s.compare(o)); });
+    select_string_kernels(best);
+}
@@ -11,6 +11,7 @@
 #include <mjs/parser.h>
 #include <mjs/interpreter.h>
 #include <mjs/printer.h>
+#include <mjs/jit.h>
 
 #include <fstream>
 #include <streambuf>
@@ -39,6 +40,13 @@ int interpret_file(const std::shared_ptr<mjs::source_file>& source) {
 
 int main(int argc, char* argv[]) {
     try {
+        if (argc > 1 && !std::strcmp(argv[1], "--jit")) {
+            if (!mjs::enable_jit(true)) {
+                std::wcout << "The JIT is not supported on this platform\n";
+            }
+            --argc;
+            ++argv;
+        }
         if (argc > 1) {
             return interpret_file(read_ascii_file(argv[1]));
         }
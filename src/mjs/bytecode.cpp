@@ -0,0 +1,1392 @@
+#include "bytecode.h"
+#include "interpreter.h"
+#include <ostream>
+#include <sstream>
+#include <unordered_map>
+#include <optional>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace mjs {
+
+std::wostream& operator<<(std::wostream& os, opcode op) {
+    switch (op) {
+#define MJS_OPCODE_NAME(name) case opcode::name: return os << #name;
+        MJS_OPCODES(MJS_OPCODE_NAME)
+#undef MJS_OPCODE_NAME
+    }
+    NOT_IMPLEMENTED(static_cast<int>(op));
+}
+
+class hoisting_visitor {
+public:
+    static declarations scan(const block_statement& bs) {
+        hoisting_visitor hv{};
+        hv(bs);
+        return std::move(hv.res_);
+    }
+
+    //
+    // Statements
+    //
+
+    void operator()(const block_statement& s) {
+        for (const auto& bs: s.l()) {
+            accept(*bs, *this);
+        }
+    }
+
+    void operator()(const variable_statement& s) {
+        for (const auto& d: s.l()) {
+            add_id(d.id());
+            if (auto init = d.init()) {
+                accept(*init, *this);
+            }
+        }
+    }
+
+    void operator()(const empty_statement&) {}
+
+    void operator()(const expression_statement& s) {
+        accept(s.e(), *this);
+    }
+
+    void operator()(const if_statement& s) {
+        accept(s.cond(), *this);
+        accept(s.if_s(), *this);
+        if (auto e = s.else_s()) {
+            accept(*e, *this);
+        }
+    }
+
+    void operator()(const while_statement& s){
+        accept(s.cond(), *this);
+        accept(s.s(), *this);
+    }
+
+    void operator()(const for_statement& s){
+        if (s.init()) accept(*s.init(), *this);
+        if (s.cond()) accept(*s.cond(), *this);
+        if (s.iter()) accept(*s.iter(), *this);
+        accept(s.s(), *this);
+    }
+
+    void operator()(const for_in_statement& s){
+        accept(s.init(), *this);
+        accept(s.e(), *this);
+        accept(s.s(), *this);
+    }
+
+    void operator()(const continue_statement&){}
+    void operator()(const break_statement&){}
+
+    void operator()(const return_statement& s){
+        if (s.e()) accept(*s.e(), *this);
+    }
+
+    void operator()(const with_statement& s){
+        res_.dynamic_scope = true;
+        // Only look for uses of "arguments", declarations inside with statements aren't hoisted
+        accept(s.e(), *this);
+        ++with_depth_;
+        accept(s.s(), *this);
+        --with_depth_;
+    }
+
+    void operator()(const function_definition& s) {
+        assert(!s.id().empty());
+        add_id(s.id());
+        // Nested functions have their own arguments object and declarations, but might access variables by name
+        hoisting_visitor nested{};
+        nested(s.block());
+        if (nested.res_.dynamic_scope) {
+            res_.dynamic_scope = true;
+        }
+        res_.nested_ids.insert(nested.used_ids_.begin(), nested.used_ids_.end());
+        used_ids_.insert(nested.used_ids_.begin(), nested.used_ids_.end());
+    }
+
+    void operator()(const statement& s) {
+        NOT_IMPLEMENTED(s);
+    }
+
+    //
+    // Expressions
+    //
+
+    void operator()(const identifier_expression& e) {
+        used_ids_.insert(e.id());
+        if (e.id() == L"arguments") {
+            res_.uses_arguments = true;
+        }
+    }
+
+    void operator()(const literal_expression&) {}
+
+    void operator()(const call_expression& e) {
+        // eval runs code in the calling scope
+        if (e.member().type() == expression_type::identifier && static_cast<const identifier_expression&>(e.member()).id() == L"eval") {
+            res_.uses_arguments = true;
+            res_.dynamic_scope = true;
+        }
+        accept(e.member(), *this);
+        for (const auto& a: e.arguments()) {
+            accept(*a, *this);
+        }
+    }
+
+    void operator()(const prefix_expression& e) {
+        accept(e.e(), *this);
+    }
+
+    void operator()(const postfix_expression& e) {
+        accept(e.e(), *this);
+    }
+
+    void operator()(const binary_expression& e) {
+        accept(e.lhs(), *this);
+        accept(e.rhs(), *this);
+    }
+
+    void operator()(const conditional_expression& e) {
+        accept(e.cond(), *this);
+        accept(e.lhs(), *this);
+        accept(e.rhs(), *this);
+    }
+
+    void operator()(const expression& e) {
+        NOT_IMPLEMENTED(e);
+    }
+
+private:
+    explicit hoisting_visitor() {}
+    declarations res_;
+    std::unordered_set<std::wstring> used_ids_; // Identifiers used by the code and nested functions
+    int with_depth_ = 0;
+
+    void add_id(const std::wstring& id) {
+        if (!with_depth_) {
+            res_.ids.push_back(id);
+        }
+    }
+};
+
+declarations scan_declarations(const block_statement& bs) {
+    return hoisting_visitor::scan(bs);
+}
+
+class bytecode_compiler {
+public:
+    explicit bytecode_compiler(const compile_options& options, const bytecode_compiler* parent = nullptr) : bc_(std::make_shared<bytecode>()), options_(options), parent_(parent), completion_values_(options.completion_values || options.statement_hooks), statement_hooks_(options.statement_hooks) {
+        if (completion_values_) {
+            // Reserve the completion register
+            const auto r = alloc();
+            assert(r == bytecode::completion_register); (void)r;
+            emit(opcode::load_undefined, bytecode::completion_register);
+        }
+    }
+
+    std::shared_ptr<const bytecode> global_code(const statement& s) {
+        stmt(s);
+        return finish(completion_values_);
+    }
+
+    std::shared_ptr<const bytecode> function_code(const function_definition& f) {
+        bc_->declarations_ = scan_declarations(f.block());
+        const auto& decls = bc_->declarations_;
+        if (!decls.dynamic_scope) {
+            // 10.1.3: The parameters, this, the arguments object unless a parameter has that name and then the declared
+            // functions and variables (that don't have the name of a parameter)
+            const auto& params = f.params();
+            for (auto it = params.begin(); it != params.end(); ++it) {
+                if (std::find(it + 1, params.end(), *it) != params.end()) {
+                    // The last parameter with the same name wins, the value of this one is never seen
+                    bc_->param_locations_.push_back(bytecode::local_location{false, alloc()});
+                } else {
+                    bc_->param_locations_.push_back(add_local(*it));
+                }
+            }
+            bc_->this_register_ = add_local(L"this").index;
+            if (decls.uses_arguments && !slots_.count(L"arguments")) {
+                bc_->arguments_register_ = add_local(L"arguments").index;
+            }
+            for (const auto& id: decls.ids) {
+                add_local(id);
+            }
+        }
+        stmt(f.block());
+        return finish(false);
+    }
+
+    std::shared_ptr<const bytecode> expression_code(const expression& e) {
+        const auto r = alloc();
+        expr(e, r);
+        emit(opcode::return_, r, 0, 0, static_cast<uint8_t>(completion_type::normal));
+        return finish(false);
+    }
+
+private:
+    using reg = uint16_t;
+    static constexpr uint32_t max_operand = UINT16_MAX;
+
+    std::shared_ptr<bytecode> bc_;
+    const compile_options options_;
+    const bytecode_compiler* const parent_; // Compiler of the code containing this function
+    std::unordered_map<std::wstring, bytecode::local_location> slots_; // Local variables
+    const bool completion_values_;
+    const bool statement_hooks_;
+    std::unordered_map<uint64_t, uint32_t> number_indices_;     // Bit pattern -> index in numbers_
+    std::unordered_map<std::wstring, uint32_t> string_indices_; // Index in strings_
+    uint32_t next_reg_ = 0;
+    uint32_t for_in_depth_ = 0;
+    int with_depth_ = 0;
+
+    struct loop_context {
+        int with_depth;                     // with statements entered outside the loop
+        std::vector<uint32_t> breaks;       // jumps to patch with the loop end
+        std::vector<uint32_t> continues;    // jumps to patch with the continue target
+    };
+    std::vector<loop_context> loops_;
+
+    // Registers allocated in the lifetime of a temp_regs are freed when it's destroyed
+    class temp_regs {
+    public:
+        explicit temp_regs(bytecode_compiler& c) : c_(c), saved_(c.next_reg_) {}
+        ~temp_regs() { c_.next_reg_ = saved_; }
+        temp_regs(const temp_regs&) = delete;
+        temp_regs& operator=(const temp_regs&) = delete;
+    private:
+        bytecode_compiler& c_;
+        uint32_t saved_;
+    };
+
+    std::shared_ptr<const bytecode> finish(bool completion_value) {
+        if (completion_value) {
+            emit(opcode::return_, bytecode::completion_register, 0, 0, static_cast<uint8_t>(completion_type::normal));
+        } else {
+            const auto r = alloc();
+            emit(opcode::load_undefined, r);
+            emit(opcode::return_, r, 0, 0, static_cast<uint8_t>(completion_type::normal));
+        }
+        assert(loops_.empty() && !with_depth_ && !for_in_depth_);
+        return bc_;
+    }
+
+    //
+    // Scope resolution
+    //
+
+    // Makes 'id' a local variable (if it isn't already). Only variables nested functions might access are put in the
+    // environment, this and arguments never are since every function has its own.
+    bytecode::local_location add_local(const std::wstring& id) {
+        if (const auto it = slots_.find(id); it != slots_.end()) {
+            return it->second;
+        }
+        bytecode::local_location loc;
+        if (id != L"this" && id != L"arguments" && bc_->declarations_.nested_ids.count(id)) {
+            if (bc_->environment_size_ == max_operand) {
+                NOT_IMPLEMENTED("Too many local variables");
+            }
+            loc = bytecode::local_location{true, static_cast<uint16_t>(bc_->environment_size_++)};
+        } else {
+            loc = bytecode::local_location{false, alloc()};
+        }
+        slots_.emplace(id, loc);
+        return loc;
+    }
+
+    // Where an identifier is found
+    struct variable_location {
+        enum { name, local, slot } kind; // name: The identifier is looked up by name in the scope chain at runtime
+        uint32_t depth;     // slot: Number of environments to go up
+        uint32_t index;     // local: register, slot: index in the environment
+    };
+
+    // Resolves the identifier statically (10.1.4) if possible. Only possible for variables declared in this or
+    // enclosing functions that don't have their variables in activation objects (see declarations::dynamic_scope).
+    // Local variables are never visible to code looking up names at runtime.
+    variable_location resolve(const std::wstring& id) const {
+        uint32_t depth = 0;
+        for (auto c = this; c && !c->slots_.empty(); c = c->parent_) {
+            if (const auto it = c->slots_.find(id); it != c->slots_.end()) {
+                if (!it->second.in_environment) {
+                    // Variables used by nested functions are put in the environment
+                    assert(c == this);
+                    return variable_location{variable_location::local, 0, it->second.index};
+                }
+                return variable_location{variable_location::slot, depth, it->second.index};
+            }
+            // Functions without an environment run with the environment of the code containing them
+            if (c->bc_->environment_size_) {
+                ++depth;
+            }
+        }
+        return variable_location{variable_location::name, 0, 0};
+    }
+
+    //
+    // Emitting code
+    //
+
+    reg alloc(uint32_t count = 1) {
+        const uint32_t r = next_reg_;
+        if (r + count > max_operand) {
+            NOT_IMPLEMENTED("Too many registers needed");
+        }
+        next_reg_ += count;
+        bc_->register_count_ = std::max(bc_->register_count_, next_reg_);
+        return static_cast<reg>(r);
+    }
+
+    uint32_t here() const {
+        return static_cast<uint32_t>(bc_->code_.size());
+    }
+
+    uint32_t emit(opcode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint8_t x = 0) {
+        assert(a <= max_operand && b <= max_operand && c <= max_operand);
+        bc_->code_.push_back(instruction{op, x, static_cast<uint16_t>(a), static_cast<uint16_t>(b), static_cast<uint16_t>(c)});
+        return here() - 1;
+    }
+
+    // Emits an instruction with a 32-bit bc operand
+    uint32_t emit_bc(opcode op, uint32_t a, uint32_t bc, uint8_t x = 0) {
+        return emit(op, a, bc & 0xffff, bc >> 16, x);
+    }
+
+    void emit_data(uint32_t bc) {
+        emit_bc(opcode::data, 0, bc);
+    }
+
+    void patch(uint32_t pos, uint32_t target) {
+        auto& i = bc_->code_[pos];
+        i.b = static_cast<uint16_t>(target & 0xffff);
+        i.c = static_cast<uint16_t>(target >> 16);
+    }
+
+    uint32_t emit_jump(opcode op, reg cond = 0) {
+        return emit_bc(op, cond, 0);
+    }
+
+    uint32_t node_index(const syntax_node& n) {
+        const auto index = static_cast<uint32_t>(bc_->nodes_.size());
+        if (index > max_operand) {
+            NOT_IMPLEMENTED("Too many syntax nodes referenced");
+        }
+        bc_->nodes_.push_back(&n);
+        return index;
+    }
+
+    // Constants are only stored once (numbers are compared bitwise to keep -0 and 0 apart)
+    uint32_t number_index(double d) {
+        uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        const auto [it, inserted] = number_indices_.emplace(bits, static_cast<uint32_t>(bc_->numbers_.size()));
+        if (inserted) {
+            bc_->numbers_.push_back(d);
+        }
+        return it->second;
+    }
+
+    uint32_t string_index(const std::wstring& s) {
+        const auto [it, inserted] = string_indices_.emplace(s, static_cast<uint32_t>(bc_->strings_.size()));
+        if (inserted) {
+            bc_->strings_.push_back(s);
+        }
+        return it->second;
+    }
+
+
+    void set_completion_undefined() {
+        if (completion_values_) {
+            emit(opcode::load_undefined, bytecode::completion_register);
+        }
+    }
+
+    void statement_done(const statement& s, completion_type t = completion_type::normal, reg value = bytecode::completion_register) {
+        if (statement_hooks_) {
+            emit_bc(opcode::statement_executed, value, node_index(s), static_cast<uint8_t>(t));
+        }
+    }
+
+    //
+    // Constant folding
+    //
+
+    // A value known when compiling, i.e. the result of an expression only involving literals
+    struct constant {
+        value_type   type;
+        double       n; // number (boolean: 0 or 1)
+        std::wstring s; // string
+    };
+
+    static constant number_constant(double n) {
+        return constant{value_type::number, n, {}};
+    }
+
+    static constant boolean_constant(bool b) {
+        return constant{value_type::boolean, b ? 1.0 : 0.0, {}};
+    }
+
+    static constant string_constant(std::wstring s) {
+        return constant{value_type::string, 0, std::move(s)};
+    }
+
+    static const wchar_t* typeof_name(value_type t) {
+        switch (t) {
+        case value_type::undefined: return L"undefined";
+        case value_type::boolean:   return L"boolean";
+        case value_type::number:    return L"number";
+        case value_type::string:    return L"string";
+        default:                    return L"object";
+        }
+    }
+
+    static bool to_boolean(const constant& c) {
+        switch (c.type) {
+        case value_type::boolean:   return c.n != 0;
+        case value_type::number:    return c.n != 0 && !std::isnan(c.n);
+        case value_type::string:    return !c.s.empty();
+        default:                    return false;
+        }
+    }
+
+    static double to_number(const constant& c) {
+        switch (c.type) {
+        case value_type::undefined: return NAN;
+        case value_type::null:      return +0.0;
+        case value_type::string:    return mjs::to_number(std::wstring_view{c.s});
+        default:                    return c.n;
+        }
+    }
+
+    static std::wstring to_string(const constant& c) {
+        switch (c.type) {
+        case value_type::undefined: return L"undefined";
+        case value_type::null:      return L"null";
+        case value_type::boolean:   return c.n ? L"true" : L"false";
+        case value_type::number:
+            {
+                wchar_t buffer[number_buffer_size];
+                return std::wstring(buffer, format_number(buffer, c.n));
+            }
+        default:                    return c.s;
+        }
+    }
+
+    // 11.9.3 for primitive values
+    static bool equal(const constant& l, const constant& r) {
+        if (l.type == r.type) {
+            return l.type == value_type::string ? l.s == r.s : l.n == r.n || l.type == value_type::undefined || l.type == value_type::null;
+        }
+        const auto is_nullish = [](const constant& c) { return c.type == value_type::undefined || c.type == value_type::null; };
+        if (is_nullish(l) || is_nullish(r)) {
+            return is_nullish(l) && is_nullish(r);
+        }
+        // The remaining combinations of booleans, numbers and strings are compared as numbers
+        return to_number(l) == to_number(r);
+    }
+
+    static constant literal_constant(const literal_expression& e) {
+        switch (e.t().type()) {
+        case token_type::undefined_:        return constant{value_type::undefined, 0, {}};
+        case token_type::null_:             return constant{value_type::null, 0, {}};
+        case token_type::true_:             return boolean_constant(true);
+        case token_type::false_:            return boolean_constant(false);
+        case token_type::numeric_literal:   return number_constant(e.t().dvalue());
+        case token_type::string_literal:    return string_constant(e.t().text());
+        default: NOT_IMPLEMENTED(e);
+        }
+    }
+
+    // Returns the value of 'e' if it can be computed when compiling (without side effects and exactly as the
+    // interpreter would). Relational comparison of strings is left to the interpreter.
+    static std::optional<constant> constant_value(const expression& e) {
+        switch (e.type()) {
+        case expression_type::literal:
+            return literal_constant(static_cast<const literal_expression&>(e));
+        case expression_type::prefix:
+            {
+                const auto& pe = static_cast<const prefix_expression&>(e);
+                if (pe.op() != token_type::typeof_ && pe.op() != token_type::void_ && pe.op() != token_type::plus && pe.op() != token_type::minus && pe.op() != token_type::tilde && pe.op() != token_type::not_) {
+                    return std::nullopt;
+                }
+                const auto c = constant_value(pe.e());
+                if (!c) {
+                    return std::nullopt;
+                }
+                switch (pe.op()) {
+                case token_type::typeof_:   return string_constant(typeof_name(c->type));
+                case token_type::void_:     return constant{value_type::undefined, 0, {}};
+                case token_type::plus:      return number_constant(to_number(*c));
+                case token_type::minus:     return number_constant(-to_number(*c));
+                case token_type::tilde:     return number_constant(static_cast<double>(~to_int32(to_number(*c))));
+                default:                    return boolean_constant(!to_boolean(*c));
+                }
+            }
+        case expression_type::binary:
+            return binary_constant(static_cast<const binary_expression&>(e));
+        case expression_type::conditional:
+            {
+                const auto& ce = static_cast<const conditional_expression&>(e);
+                if (const auto c = constant_value(ce.cond())) {
+                    return constant_value(to_boolean(*c) ? ce.lhs() : ce.rhs());
+                }
+            }
+            return std::nullopt;
+        default:
+            return std::nullopt;
+        }
+    }
+
+    static std::optional<constant> binary_constant(const binary_expression& e) {
+        const auto op = e.op();
+        if (operator_precedence(op) == assignment_precedence || as_member(e)) {
+            return std::nullopt;
+        }
+        auto l = constant_value(e.lhs());
+        if (!l) {
+            return std::nullopt;
+        }
+        if (op == token_type::andand || op == token_type::oror) {
+            // The right operand is only needed if it's evaluated
+            if (to_boolean(*l) == (op == token_type::oror)) {
+                return l;
+            }
+            return constant_value(e.rhs());
+        }
+        auto r = constant_value(e.rhs());
+        if (!r) {
+            return std::nullopt;
+        }
+        switch (op) {
+        case token_type::comma:
+            return r;
+        case token_type::plus:
+            if (l->type == value_type::string || r->type == value_type::string) {
+                return string_constant(to_string(*l) + to_string(*r));
+            }
+            break;
+        case token_type::lt:
+        case token_type::ltequal:
+        case token_type::gt:
+        case token_type::gtequal:
+            if (l->type == value_type::string && r->type == value_type::string) {
+                return std::nullopt;
+            }
+            break;
+        case token_type::equalequal:    return boolean_constant(equal(*l, *r));
+        case token_type::notequal:      return boolean_constant(!equal(*l, *r));
+        default:
+            break;
+        }
+        const auto ln = to_number(*l);
+        const auto rn = to_number(*r);
+        switch (op) {
+        case token_type::plus:          return number_constant(ln + rn);
+        case token_type::minus:         return number_constant(ln - rn);
+        case token_type::multiply:      return number_constant(ln * rn);
+        case token_type::divide:        return number_constant(ln / rn);
+        case token_type::mod:           return number_constant(std::fmod(ln, rn));
+        case token_type::lshift:        return number_constant(static_cast<double>(to_int32(ln) << (to_uint32(rn) & 0x1f)));
+        case token_type::rshift:        return number_constant(static_cast<double>(to_int32(ln) >> (to_uint32(rn) & 0x1f)));
+        case token_type::rshiftshift:   return number_constant(static_cast<double>(to_uint32(ln) >> (to_uint32(rn) & 0x1f)));
+        case token_type::and_:          return number_constant(static_cast<double>(to_int32(ln) & to_int32(rn)));
+        case token_type::xor_:          return number_constant(static_cast<double>(to_int32(ln) ^ to_int32(rn)));
+        case token_type::or_:           return number_constant(static_cast<double>(to_int32(ln) | to_int32(rn)));
+        case token_type::lt:            return boolean_constant(ln < rn);
+        case token_type::ltequal:       return boolean_constant(ln <= rn);
+        case token_type::gt:            return boolean_constant(ln > rn);
+        case token_type::gtequal:       return boolean_constant(ln >= rn);
+        default:                        return std::nullopt;
+        }
+    }
+
+    // Returns the truth value of the condition 'e' if it's constant
+    static std::optional<bool> constant_condition(const expression& e) {
+        if (const auto c = constant_value(e)) {
+            return to_boolean(*c);
+        }
+        return std::nullopt;
+    }
+
+    void load_constant(const constant& c, reg dst) {
+        switch (c.type) {
+        case value_type::undefined:         emit(opcode::load_undefined, dst); return;
+        case value_type::null:              emit(opcode::load_null, dst); return;
+        case value_type::boolean:           emit(opcode::load_boolean, dst, 0, 0, c.n ? 1 : 0); return;
+        case value_type::number:            emit_bc(opcode::load_number, dst, number_index(c.n)); return;
+        case value_type::string:            emit_bc(opcode::load_string, dst, string_index(c.s)); return;
+        default: NOT_IMPLEMENTED(c.type);
+        }
+    }
+
+    //
+    // Expressions
+    //
+
+    static opcode binary_opcode(token_type op) {
+        switch (op) {
+        case token_type::plus:          return opcode::add;
+        case token_type::minus:         return opcode::sub;
+        case token_type::multiply:      return opcode::mul;
+        case token_type::divide:        return opcode::div;
+        case token_type::mod:           return opcode::mod;
+        case token_type::lshift:        return opcode::shl;
+        case token_type::rshift:        return opcode::sar;
+        case token_type::rshiftshift:   return opcode::shr;
+        case token_type::and_:          return opcode::bit_and;
+        case token_type::xor_:          return opcode::bit_xor;
+        case token_type::or_:           return opcode::bit_or;
+        case token_type::lt:            return opcode::lt;
+        case token_type::ltequal:       return opcode::le;
+        case token_type::gt:            return opcode::gt;
+        case token_type::gtequal:       return opcode::ge;
+        case token_type::equalequal:    return opcode::eq;
+        case token_type::notequal:      return opcode::ne;
+        default: NOT_IMPLEMENTED(op);
+        }
+    }
+
+    // Returns the variant of the binary operator 'op' taking a number constant as its right operand (or nop if there isn't one)
+    static opcode with_number_operand(opcode op) {
+        switch (op) {
+        case opcode::add:               return opcode::add_number;
+        case opcode::sub:               return opcode::sub_number;
+        case opcode::mul:               return opcode::mul_number;
+        case opcode::bit_and:           return opcode::bit_and_number;
+        default:                        return opcode::nop;
+        }
+    }
+
+    // Returns the comparison and jump instruction for 'op' (or nop if there isn't one)
+    static opcode compare_jump_opcode(token_type op) {
+        switch (op) {
+        case token_type::lt:            return opcode::jump_if_lt;
+        case token_type::ltequal:       return opcode::jump_if_le;
+        case token_type::gt:            return opcode::jump_if_gt;
+        case token_type::gtequal:       return opcode::jump_if_ge;
+        default:                        return opcode::nop;
+        }
+    }
+
+    // Does 'e' mention the identifier 'id' anywhere?
+    static bool refers_to(const expression& e, const std::wstring& id) {
+        switch (e.type()) {
+        case expression_type::identifier:
+            return static_cast<const identifier_expression&>(e).id() == id;
+        case expression_type::literal:
+            return false;
+        case expression_type::call:
+            {
+                const auto& ce = static_cast<const call_expression&>(e);
+                return refers_to(ce.member(), id) || std::any_of(ce.arguments().begin(), ce.arguments().end(), [&id](const auto& a) { return refers_to(*a, id); });
+            }
+        case expression_type::prefix:
+            return refers_to(static_cast<const prefix_expression&>(e).e(), id);
+        case expression_type::postfix:
+            return refers_to(static_cast<const postfix_expression&>(e).e(), id);
+        case expression_type::binary:
+            return refers_to(static_cast<const binary_expression&>(e).lhs(), id) || refers_to(static_cast<const binary_expression&>(e).rhs(), id);
+        case expression_type::conditional:
+            {
+                const auto& ce = static_cast<const conditional_expression&>(e);
+                return refers_to(ce.cond(), id) || refers_to(ce.lhs(), id) || refers_to(ce.rhs(), id);
+            }
+        }
+        NOT_IMPLEMENTED(e);
+    }
+
+    // Returns the member expression 'e' is ("o.name" or "o[key]") or nullptr
+    static const binary_expression* as_member(const expression& e) {
+        if (e.type() != expression_type::binary) {
+            return nullptr;
+        }
+        const auto& be = static_cast<const binary_expression&>(e);
+        return be.op() == token_type::dot || be.op() == token_type::lbracket ? &be : nullptr;
+    }
+
+    // Does the member expression have a fixed name (i.e. can the inline cache be used)?
+    static bool has_fixed_name(const binary_expression& be) {
+        return be.rhs().type() == expression_type::literal && static_cast<const literal_expression&>(be.rhs()).t().type() == token_type::string_literal;
+    }
+
+    // The parts of a reference to a property or variable
+    struct reference_regs {
+        enum { name, local, slot, member, element, invalid } kind;
+        reg      object;    // member/element (slot: depth)
+        reg      key;       // element (local: register, slot: index)
+        uint32_t node;      // name/member/invalid
+    };
+
+    // Evaluates the base object (and key) of the reference 'e' denotes into newly allocated registers
+    reference_regs eval_reference(const expression& e) {
+        if (e.type() == expression_type::identifier) {
+            return identifier_reference(static_cast<const identifier_expression&>(e));
+        } else if (const auto be = as_member(e)) {
+            const auto o = alloc();
+            expr(be->lhs(), o);
+            if (has_fixed_name(*be)) {
+                return reference_regs{reference_regs::member, o, 0, node_index(*be)};
+            }
+            const auto k = alloc();
+            expr(be->rhs(), k);
+            // Convert the key once (and before evaluating anything else) even if it's used twice (e.g. "o[k] += 1")
+            emit(opcode::to_property_key, k);
+            return reference_regs{reference_regs::element, o, k, 0};
+        }
+        const auto r = alloc();
+        expr(e, r);
+        return reference_regs{reference_regs::invalid, 0, 0, node_index(e)};
+    }
+
+    // Reference to the variable declared by 'd' in the statement 's'
+    reference_regs declared_variable(const declaration& d, const statement& s) {
+        if (const auto loc = resolve(d.id()); loc.kind != variable_location::name) {
+            return variable_reference(loc);
+        }
+        // Declarations don't have an identifier node to refer to
+        bc_->own_nodes_.push_back(std::make_unique<identifier_expression>(s.extend(), d.id()));
+        return identifier_reference(static_cast<const identifier_expression&>(*bc_->own_nodes_.back()));
+    }
+
+    reference_regs identifier_reference(const identifier_expression& e) {
+        if (const auto loc = resolve(e.id()); loc.kind != variable_location::name) {
+            return variable_reference(loc);
+        }
+        return reference_regs{reference_regs::name, 0, 0, node_index(e)};
+    }
+
+    static reference_regs variable_reference(const variable_location& loc) {
+        assert(loc.kind != variable_location::name);
+        return reference_regs{loc.kind == variable_location::local ? reference_regs::local : reference_regs::slot, static_cast<reg>(loc.depth), static_cast<reg>(loc.index), 0};
+    }
+
+    // Returns the register holding 'e' if it's a local variable kept in a register
+    std::optional<reg> local_register(const expression& e) const {
+        if (e.type() == expression_type::identifier) {
+            if (const auto loc = resolve(static_cast<const identifier_expression&>(e).id()); loc.kind == variable_location::local) {
+                return static_cast<reg>(loc.index);
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Returns the index of the number constant 'e' evaluates to if it can be used as an operand
+    std::optional<reg> number_operand(const expression& e) {
+        if (e.type() != expression_type::literal && e.type() != expression_type::prefix && e.type() != expression_type::binary) {
+            return std::nullopt;
+        }
+        if (const auto c = constant_value(e); c && c->type == value_type::number && bc_->numbers_.size() <= max_operand) {
+            return static_cast<reg>(number_index(c->n));
+        }
+        return std::nullopt;
+    }
+
+    void move(reg dst, reg src) {
+        if (dst != src) {
+            emit(opcode::move, dst, src);
+        }
+    }
+
+    void get_reference(const reference_regs& ref, reg dst) {
+        switch (ref.kind) {
+        case reference_regs::name:      emit_bc(opcode::get_name, dst, ref.node); break;
+        case reference_regs::local:     move(dst, ref.key); break;
+        case reference_regs::slot:      emit(opcode::get_slot, dst, ref.object, ref.key); break;
+        case reference_regs::member:    emit(opcode::get_member, dst, ref.object, ref.node); break;
+        case reference_regs::element:   emit(opcode::get_element, dst, ref.object, ref.key); break;
+        case reference_regs::invalid:   emit_bc(opcode::invalid_reference, 0, ref.node); break;
+        }
+    }
+
+    void put_reference(const reference_regs& ref, reg src) {
+        switch (ref.kind) {
+        case reference_regs::name:      emit_bc(opcode::put_name, src, ref.node); break;
+        case reference_regs::local:     move(ref.key, src); break;
+        case reference_regs::slot:      emit(opcode::put_slot, src, ref.object, ref.key); break;
+        case reference_regs::member:    emit(opcode::put_member, src, ref.object, ref.node); break;
+        case reference_regs::element:   emit(opcode::put_element, src, ref.object, ref.key); break;
+        case reference_regs::invalid:   emit_bc(opcode::invalid_reference, 0, ref.node); break;
+        }
+    }
+
+    // Stores 'src' in the reference denoted by 'e'
+    void assign(const expression& e, reg src) {
+        temp_regs t{*this};
+        put_reference(eval_reference(e), src);
+    }
+
+    void expr(const expression& e, reg dst) {
+        if (e.type() == expression_type::prefix || e.type() == expression_type::binary || e.type() == expression_type::conditional) {
+            // Operators only applied to literals are evaluated when compiling
+            if (const auto c = constant_value(e)) {
+                load_constant(*c, dst);
+                return;
+            }
+        }
+        switch (e.type()) {
+        case expression_type::identifier:
+            get_reference(identifier_reference(static_cast<const identifier_expression&>(e)), dst);
+            return;
+        case expression_type::literal:
+            load_constant(literal_constant(static_cast<const literal_expression&>(e)), dst);
+            return;
+        case expression_type::call:
+            call(static_cast<const call_expression&>(e), dst);
+            return;
+        case expression_type::prefix:
+            prefix(static_cast<const prefix_expression&>(e), dst);
+            return;
+        case expression_type::postfix:
+            postfix(static_cast<const postfix_expression&>(e), dst);
+            return;
+        case expression_type::binary:
+            binary(static_cast<const binary_expression&>(e), dst);
+            return;
+        case expression_type::conditional:
+            conditional(static_cast<const conditional_expression&>(e), dst);
+            return;
+        }
+        NOT_IMPLEMENTED(e);
+    }
+
+    // Evaluates the function (and this value) into 'base' and 'base+1' and the arguments into the following registers
+    void call_operands(const expression& member, const expression_list& arguments, reg base, bool want_this) {
+        if (want_this && member.type() == expression_type::identifier && resolve(static_cast<const identifier_expression&>(member).id()).kind == variable_location::name) {
+            emit_bc(opcode::get_name_this, base, node_index(member));
+        } else if (const auto be = as_member(member); want_this && be) {
+            expr(be->lhs(), base + 1);
+            if (has_fixed_name(*be)) {
+                emit(opcode::get_member_this, base, base + 1, node_index(*be));
+            } else {
+                expr(be->rhs(), base);
+                emit(opcode::get_element_this, base, base + 1, base);
+            }
+        } else {
+            expr(member, base);
+            emit(opcode::load_null, base + 1);
+        }
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            expr(*arguments[i], static_cast<reg>(base + 2 + i));
+        }
+    }
+
+    void call(const call_expression& e, reg dst) {
+        temp_regs t{*this};
+        const auto argc = static_cast<uint32_t>(e.arguments().size());
+        const auto base = alloc(2 + argc);
+        call_operands(e.member(), e.arguments(), base, true);
+        emit(opcode::call, dst, base, argc);
+        emit_data(node_index(e));
+    }
+
+    void new_expression(const expression& e, reg dst) {
+        temp_regs t{*this};
+        if (e.type() == expression_type::call) {
+            const auto& ce = static_cast<const call_expression&>(e);
+            const auto argc = static_cast<uint32_t>(ce.arguments().size());
+            const auto base = alloc(2 + argc);
+            call_operands(ce.member(), ce.arguments(), base, false);
+            emit(opcode::construct, dst, base, argc);
+        } else {
+            const auto base = alloc(2);
+            expr(e, base);
+            emit(opcode::construct, dst, base, 0);
+        }
+        emit_data(node_index(e));
+    }
+
+    void prefix(const prefix_expression& e, reg dst) {
+        switch (e.op()) {
+        case token_type::new_:
+            new_expression(e.e(), dst);
+            return;
+        case token_type::plusplus:
+        case token_type::minusminus:
+            {
+                temp_regs t{*this};
+                const auto ref = eval_reference(e.e());
+                get_reference(ref, dst);
+                emit(e.op() == token_type::plusplus ? opcode::inc : opcode::dec, dst, dst);
+                put_reference(ref, dst);
+            }
+            return;
+        case token_type::delete_:
+            {
+                temp_regs t{*this};
+                const auto ref = eval_reference(e.e());
+                switch (ref.kind) {
+                case reference_regs::name:      emit_bc(opcode::delete_name, dst, ref.node); break;
+                case reference_regs::local:
+                case reference_regs::slot:      emit(opcode::load_boolean, dst, 0, 0, 0); break; // Variables can't be deleted
+                case reference_regs::member:    emit(opcode::delete_member, dst, ref.object, ref.node); break;
+                case reference_regs::element:   emit(opcode::delete_element, dst, ref.object, ref.key); break;
+                case reference_regs::invalid:   emit(opcode::load_boolean, dst, 0, 0, 1); break;
+                }
+            }
+            return;
+        case token_type::void_:
+            expr(e.e(), dst);
+            emit(opcode::load_undefined, dst);
+            return;
+        case token_type::typeof_:   expr(e.e(), dst); emit(opcode::typeof_, dst, dst); return;
+        case token_type::plus:      expr(e.e(), dst); emit(opcode::plus, dst, dst); return;
+        case token_type::minus:     expr(e.e(), dst); emit(opcode::neg, dst, dst); return;
+        case token_type::tilde:     expr(e.e(), dst); emit(opcode::bit_not, dst, dst); return;
+        case token_type::not_:      expr(e.e(), dst); emit(opcode::not_, dst, dst); return;
+        default:
+            NOT_IMPLEMENTED(e);
+        }
+    }
+
+    void postfix(const postfix_expression& e, reg dst) {
+        if (e.op() != token_type::plusplus && e.op() != token_type::minusminus) {
+            NOT_IMPLEMENTED(e);
+        }
+        temp_regs t{*this};
+        const auto ref = eval_reference(e.e());
+        const auto r = alloc();
+        get_reference(ref, r);
+        emit(opcode::plus, dst, r);
+        emit(e.op() == token_type::plusplus ? opcode::inc : opcode::dec, r, dst);
+        put_reference(ref, r);
+    }
+
+    void binary(const binary_expression& e, reg dst) {
+        const auto op = e.op();
+        if (op == token_type::comma) {
+            expr(e.lhs(), dst);
+            expr(e.rhs(), dst);
+        } else if (operator_precedence(op) == assignment_precedence) {
+            temp_regs t{*this};
+            const auto ref = eval_reference(e.lhs());
+            if (op != token_type::equal) {
+                get_reference(ref, dst);
+                binary_op(binary_opcode(without_assignment(op)), dst, dst, e.rhs());
+            } else {
+                expr(e.rhs(), dst);
+            }
+            put_reference(ref, dst);
+        } else if (op == token_type::andand || op == token_type::oror) {
+            if (constant_value(e.lhs())) {
+                // Otherwise the whole expression would have been constant
+                expr(e.rhs(), dst);
+                return;
+            }
+            expr(e.lhs(), dst);
+            const auto j = emit_jump(op == token_type::andand ? opcode::jump_if_false : opcode::jump_if_true, dst);
+            expr(e.rhs(), dst);
+            patch(j, here());
+        } else if (as_member(e)) {
+            expr(e.lhs(), dst);
+            if (has_fixed_name(e)) {
+                emit(opcode::get_member, dst, dst, node_index(e));
+            } else {
+                temp_regs t{*this};
+                const auto k = alloc();
+                expr(e.rhs(), k);
+                emit(opcode::get_element, dst, dst, k);
+            }
+        } else {
+            binary_op(binary_opcode(op), dst, left_operand(e, dst), e.rhs());
+        }
+    }
+
+    // Returns the register holding the left operand of 'e' (evaluating it into 'dst' if needed). Local variables are
+    // used directly, but only if evaluating the right operand can't change them.
+    reg left_operand(const binary_expression& e, reg dst) {
+        if (const auto l = local_register(e.lhs()); l && (e.rhs().type() == expression_type::identifier || constant_value(e.rhs()))) {
+            return *l;
+        }
+        expr(e.lhs(), dst);
+        return dst;
+    }
+
+    // Emits dst = l op rhs, number constants and local variables are used directly as the right operand
+    void binary_op(opcode op, reg dst, reg l, const expression& rhs) {
+        if (op == opcode::div) {
+            // Dividing by a power of two is the same as multiplying by its (exact) reciprocal
+            if (const auto c = constant_value(rhs); c && c->type == value_type::number && bc_->numbers_.size() <= max_operand) {
+                int exp;
+                if (const double recip = 1 / c->n; std::abs(std::frexp(c->n, &exp)) == 0.5 && std::isfinite(recip)) {
+                    emit(opcode::mul_number, dst, l, static_cast<reg>(number_index(recip)));
+                    return;
+                }
+            }
+        }
+        if (const auto nop = with_number_operand(op); nop != opcode::nop) {
+            if (const auto k = number_operand(rhs)) {
+                emit(nop, dst, l, *k);
+                return;
+            }
+        }
+        temp_regs t{*this};
+        auto r = local_register(rhs);
+        if (!r) {
+            r = alloc();
+            expr(rhs, *r);
+        }
+        emit(op, dst, l, *r);
+    }
+
+    // Evaluates 'e' only for its side effects. Local variables kept in registers are updated in place when that
+    // can't change the result (e.g. "++i", "s += x" or "x = f(x)").
+    void effect(const expression& e) {
+        temp_regs t{*this};
+        if (e.type() == expression_type::prefix || e.type() == expression_type::postfix) {
+            // The value of a postfix expression isn't needed, so it's the same as the prefix form
+            const auto op = e.type() == expression_type::prefix ? static_cast<const prefix_expression&>(e).op() : static_cast<const postfix_expression&>(e).op();
+            const auto& operand = e.type() == expression_type::prefix ? static_cast<const prefix_expression&>(e).e() : static_cast<const postfix_expression&>(e).e();
+            if (const auto r = local_register(operand); r && (op == token_type::plusplus || op == token_type::minusminus)) {
+                emit(op == token_type::plusplus ? opcode::inc : opcode::dec, *r, *r);
+                return;
+            }
+        } else if (e.type() == expression_type::binary && operator_precedence(static_cast<const binary_expression&>(e).op()) == assignment_precedence) {
+            const auto& be = static_cast<const binary_expression&>(e);
+            if (const auto r = local_register(be.lhs()); r && updates_in_place(be)) {
+                expr(e, *r);
+                return;
+            }
+        }
+        expr(e, alloc());
+    }
+
+    // Can the assignment 'e' to a local variable be done by evaluating it directly into the variable's register?
+    // Only if the variable isn't read after the register has been written.
+    bool updates_in_place(const binary_expression& e) const {
+        const auto& id = static_cast<const identifier_expression&>(e.lhs()).id();
+        const auto& rhs = e.rhs();
+        if (e.op() != token_type::equal) {
+            // The old value is read before the right operand is evaluated, which mustn't assign to the variable
+            return rhs.type() == expression_type::identifier || rhs.type() == expression_type::literal || !refers_to(rhs, id);
+        }
+        if (rhs.type() == expression_type::call || (rhs.type() == expression_type::prefix && static_cast<const prefix_expression&>(rhs).op() == token_type::new_)) {
+            // Operands are evaluated into temporary registers, only the call itself writes the result
+            return true;
+        }
+        if (rhs.type() == expression_type::binary) {
+            // An operator whose left operand is a local variable (used directly, see left_operand) only writes the
+            // result (e.g. "x = x + 1")
+            const auto& be = static_cast<const binary_expression&>(rhs);
+            if (be.op() != token_type::comma && be.op() != token_type::andand && be.op() != token_type::oror && operator_precedence(be.op()) != assignment_precedence && !as_member(be)
+                && local_register(be.lhs()) && (be.rhs().type() == expression_type::identifier || constant_value(be.rhs()))) {
+                return true;
+            }
+        }
+        return !refers_to(rhs, id);
+    }
+
+    void conditional(const conditional_expression& e, reg dst) {
+        if (const auto c = constant_condition(e.cond())) {
+            expr(*c ? e.lhs() : e.rhs(), dst);
+            return;
+        }
+        expr(e.cond(), dst);
+        const auto jf = emit_jump(opcode::jump_if_false, dst);
+        expr(e.lhs(), dst);
+        const auto je = emit_jump(opcode::jump);
+        patch(jf, here());
+        expr(e.rhs(), dst);
+        patch(je, here());
+    }
+
+    //
+    // Statements
+    //
+
+    void stmt(const statement& s) {
+        switch (s.type()) {
+        case statement_type::block:                 block(static_cast<const block_statement&>(s)); break;
+        case statement_type::variable:              variable(static_cast<const variable_statement&>(s)); break;
+        case statement_type::empty:                 set_completion_undefined(); break;
+        case statement_type::expression:            expression_stmt(static_cast<const expression_statement&>(s)); break;
+        case statement_type::if_:                   if_stmt(static_cast<const if_statement&>(s)); break;
+        case statement_type::while_:                while_stmt(static_cast<const while_statement&>(s)); break;
+        case statement_type::for_:                  for_stmt(static_cast<const for_statement&>(s)); break;
+        case statement_type::for_in:                for_in_stmt(static_cast<const for_in_statement&>(s)); break;
+        case statement_type::continue_:             jump_stmt(s, completion_type::continue_); return;
+        case statement_type::break_:                jump_stmt(s, completion_type::break_); return;
+        case statement_type::return_:               return_stmt(static_cast<const return_statement&>(s)); return;
+        case statement_type::with:                  with_stmt(static_cast<const with_statement&>(s)); break;
+        case statement_type::function_definition:
+            function_definition_stmt(static_cast<const function_definition&>(s));
+            break;
+        default:
+            NOT_IMPLEMENTED(s);
+        }
+        statement_done(s);
+    }
+
+    void function_definition_stmt(const function_definition& s) {
+        const auto index = static_cast<uint32_t>(bc_->functions_.size());
+        bc_->functions_.push_back(bytecode::function_entry{&s, bytecode_compiler{options_, this}.function_code(s)});
+        if (const auto loc = resolve(s.id()); loc.kind != variable_location::name) {
+            temp_regs t{*this};
+            const auto r = alloc();
+            emit_bc(opcode::make_function, r, index);
+            put_reference(variable_reference(loc), r);
+        } else {
+            emit_bc(opcode::define_function, 0, index);
+        }
+        set_completion_undefined();
+    }
+
+    void block(const block_statement& s) {
+        if (s.l().empty()) {
+            set_completion_undefined();
+        }
+        for (const auto& bs: s.l()) {
+            stmt(*bs);
+        }
+    }
+
+    void variable(const variable_statement& s) {
+        for (const auto& d: s.l()) {
+            if (d.init()) {
+                temp_regs t{*this};
+                const auto ref = declared_variable(d, s);
+                if (ref.kind == reference_regs::local && !refers_to(*d.init(), d.id())) {
+                    expr(*d.init(), ref.key);
+                    continue;
+                }
+                const auto r = alloc();
+                expr(*d.init(), r);
+                put_reference(ref, r);
+            }
+        }
+        set_completion_undefined();
+    }
+
+    void expression_stmt(const expression_statement& s) {
+        if (completion_values_) {
+            expr(s.e(), bytecode::completion_register);
+        } else {
+            effect(s.e());
+        }
+    }
+
+    // Evaluates 'e' and jumps if ToBoolean of the result is 'when', returns the position to patch with the target
+    uint32_t cond_jump(const expression& e, bool when) {
+        temp_regs t{*this};
+        if (e.type() == expression_type::binary) {
+            // Comparisons jump directly on the result
+            const auto& be = static_cast<const binary_expression&>(e);
+            if (const auto op = compare_jump_opcode(be.op()); op != opcode::nop) {
+                const auto l = left_operand(be, alloc());
+                uint8_t x = when ? 1 : 0;
+                reg r;
+                if (const auto k = number_operand(be.rhs())) {
+                    r = *k;
+                    x |= 2;
+                } else if (const auto lr = local_register(be.rhs())) {
+                    r = *lr;
+                } else {
+                    r = alloc();
+                    expr(be.rhs(), r);
+                }
+                emit(op, l, r, 0, x);
+                emit_data(0);
+                return here() - 1;
+            }
+        }
+        const auto r = alloc();
+        expr(e, r);
+        return emit_jump(when ? opcode::jump_if_true : opcode::jump_if_false, r);
+    }
+
+    void if_stmt(const if_statement& s) {
+        if (const auto c = constant_condition(s.cond())) {
+            // Only the branch that's taken is compiled
+            if (*c) {
+                stmt(s.if_s());
+            } else if (const auto else_s = s.else_s()) {
+                stmt(*else_s);
+            } else {
+                set_completion_undefined();
+            }
+            return;
+        }
+        const auto jf = cond_jump(s.cond(), false);
+        stmt(s.if_s());
+        const auto else_s = s.else_s();
+        if (else_s || completion_values_) {
+            const auto je = emit_jump(opcode::jump);
+            patch(jf, here());
+            if (else_s) {
+                stmt(*else_s);
+            } else {
+                set_completion_undefined();
+            }
+            patch(je, here());
+        } else {
+            patch(jf, here());
+        }
+    }
+
+    // Loops are laid out with the condition at the end, so each iteration only takes one jump
+    void begin_loop() {
+        loops_.push_back(loop_context{with_depth_, {}, {}});
+    }
+
+    void end_loop(uint32_t continue_target, uint32_t break_target) {
+        auto& l = loops_.back();
+        for (const auto j: l.continues) patch(j, continue_target);
+        for (const auto j: l.breaks) patch(j, break_target);
+        loops_.pop_back();
+    }
+
+    void while_stmt(const while_statement& s) {
+        const auto c = constant_condition(s.cond());
+        if (c && !*c) {
+            set_completion_undefined();
+            return;
+        }
+        const auto jc = c ? UINT32_MAX : emit_jump(opcode::jump);
+        const auto top = here();
+        begin_loop();
+        stmt(s.s());
+        const auto cont = here();
+        if (c) {
+            patch(emit_jump(opcode::jump), top);
+        } else {
+            patch(jc, cont);
+            patch(cond_jump(s.cond(), true), top);
+        }
+        end_loop(cont, here());
+        set_completion_undefined();
+    }
+
+    void for_stmt(const for_statement& s) {
+        if (const auto init = s.init()) {
+            if (init->type() == statement_type::expression) {
+                effect(static_cast<const expression_statement&>(*init).e());
+            } else {
+                stmt(*init);
+            }
+        }
+        set_completion_undefined();
+        // A constant condition is either left out or the loop is never entered
+        const auto c = s.cond() ? constant_condition(*s.cond()) : std::optional<bool>{true};
+        if (c && !*c) {
+            return;
+        }
+        const auto cond = c ? nullptr : s.cond();
+        const auto jc = cond ? emit_jump(opcode::jump) : UINT32_MAX;
+        const auto top = here();
+        begin_loop();
+        stmt(s.s());
+        const auto cont = here();
+        if (s.iter()) {
+            effect(*s.iter());
+        }
+        if (cond) {
+            patch(jc, here());
+            patch(cond_jump(*cond, true), top);
+        } else {
+            patch(emit_jump(opcode::jump), top);
+        }
+        end_loop(cont, here());
+    }
+
+    void for_in_stmt(const for_in_statement& s) {
+        set_completion_undefined();
+        temp_regs t{*this};
+        const auto name = alloc();
+        const expression* lhs = nullptr;
+        reference_regs var{};
+        if (s.init().type() == statement_type::expression) {
+            lhs = &static_cast<const expression_statement&>(s.init()).e();
+        } else {
+            assert(s.init().type() == statement_type::variable);
+            const auto& vs = static_cast<const variable_statement&>(s.init());
+            assert(vs.l().size() == 1);
+            const auto& d = vs.l()[0];
+            var = declared_variable(d, vs);
+            // The initial assignment happens before the object is evaluated
+            if (d.init()) {
+                expr(*d.init(), name);
+            } else {
+                emit(opcode::load_undefined, name);
+            }
+            put_reference(var, name);
+        }
+        const auto o = alloc();
+        expr(s.e(), o);
+        const auto state = for_in_depth_++;
+        bc_->for_in_count_ = std::max(bc_->for_in_count_, for_in_depth_);
+        emit(opcode::for_in_start, o, state);
+        const auto next = emit(opcode::for_in_next, name, state);
+        emit_data(0);
+        if (lhs) {
+            assign(*lhs, name);
+        } else {
+            put_reference(var, name);
+        }
+        begin_loop();
+        stmt(s.s());
+        patch(emit_jump(opcode::jump), next);
+        patch(next + 1, here());
+        end_loop(next, here());
+        --for_in_depth_;
+    }
+
+    void jump_stmt(const statement& s, completion_type type) {
+        set_completion_undefined();
+        if (loops_.empty()) {
+            // Not in a loop (in this code), complete abruptly
+            temp_regs t{*this};
+            const auto r = alloc();
+            emit(opcode::load_undefined, r);
+            statement_done(s, type, r);
+            emit(opcode::return_, r, 0, 0, static_cast<uint8_t>(type));
+            return;
+        }
+        statement_done(s, type);
+        auto& l = loops_.back();
+        for (int i = l.with_depth; i < with_depth_; ++i) {
+            emit(opcode::leave_with);
+        }
+        (type == completion_type::break_ ? l.breaks : l.continues).push_back(emit_jump(opcode::jump));
+    }
+
+    void return_stmt(const return_statement& s) {
+        temp_regs t{*this};
+        const auto r = alloc();
+        if (s.e()) {
+            expr(*s.e(), r);
+        } else {
+            emit(opcode::load_undefined, r);
+        }
+        statement_done(s, completion_type::return_, r);
+        // Any with statements are left when the code stops running
+        emit(opcode::return_, r, 0, 0, static_cast<uint8_t>(completion_type::return_));
+    }
+
+    void with_stmt(const with_statement& s) {
+        {
+            temp_regs t{*this};
+            const auto r = alloc();
+            expr(s.e(), r);
+            emit(opcode::enter_with, r);
+        }
+        ++with_depth_;
+        stmt(s.s());
+        --with_depth_;
+        emit(opcode::leave_with);
+    }
+};
+
+std::shared_ptr<const bytecode> compile(const statement& s, const compile_options& options) {
+    return bytecode_compiler{options}.global_code(s);
+}
+
+std::shared_ptr<const bytecode> compile_function(const function_definition& f, const compile_options& options) {
+    return bytecode_compiler{options}.function_code(f);
+}
+
+std::shared_ptr<const bytecode> compile(const expression& e) {
+    return bytecode_compiler{compile_options{}}.expression_code(e);
+}
+
+} // namespace mjs
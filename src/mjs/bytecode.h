@@ -0,0 +1,206 @@
+#ifndef MJS_BYTECODE_H
+#define MJS_BYTECODE_H
+
+#include "parser.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_set>
+#include <iosfwd>
+
+namespace mjs {
+
+class jit_code;
+
+// Instructions of the register machine the interpreter runs (see interpreter.cpp). Registers hold values (never references),
+// "bc" is the 32-bit operand formed by b (low part) and c and "x" is a small immediate. Instructions marked (+data) are
+// followed by a data instruction whose bc operand is an additional operand.
+// The "_number" and "jump_if_<comparison>" instructions combine common sequences (an operator with a constant operand,
+// a comparison followed by a conditional jump). Like the plain operators they handle numbers inline and fall back to
+// the generic operation for other operand types. Only the most common combinations have instructions of their own to
+// keep the dispatch loop small.
+#define MJS_OPCODES(X) \
+    X(nop)                  /*                                                                          */ \
+    X(data)                 /* Extra operand of the previous instruction, never executed                */ \
+    X(load_undefined)       /* a = undefined                                                            */ \
+    X(load_null)            /* a = null                                                                 */ \
+    X(load_boolean)         /* a = x != 0                                                               */ \
+    X(load_number)          /* a = number constant bc                                                   */ \
+    X(load_string)          /* a = string constant bc                                                   */ \
+    X(move)                 /* a = b                                                                    */ \
+    X(get_name)             /* a = value of the identifier node bc                                      */ \
+    X(put_name)             /* identifier node bc = a                                                   */ \
+    X(get_name_this)        /* a = value of the identifier node bc, a+1 = this value when calling it    */ \
+    X(delete_name)          /* a = delete identifier node bc                                            */ \
+    X(get_slot)             /* a = slot c of the environment b levels up                                */ \
+    X(put_slot)             /* slot c of the environment b levels up = a                                */ \
+    X(get_member)           /* a = b.name (c is the index of the member expression node)                */ \
+    X(put_member)           /* b.name = a                                                               */ \
+    X(get_member_this)      /* a = b.name, a+1 = ToObject(b)                                            */ \
+    X(delete_member)        /* a = delete b.name                                                        */ \
+    X(get_element)          /* a = b[c]                                                                 */ \
+    X(put_element)          /* b[c] = a                                                                 */ \
+    X(get_element_this)     /* a = b[c], a+1 = ToObject(b)                                              */ \
+    X(delete_element)       /* a = delete b[c]                                                          */ \
+    X(to_property_key)      /* a = a converted to an array index or a string                            */ \
+    X(add)                  /* a = b + c                                                                */ \
+    X(sub)                  /* a = b - c                                                                */ \
+    X(mul)                  /* a = b * c                                                                */ \
+    X(div)                  /* a = b / c                                                                */ \
+    X(mod)                  /* a = b % c                                                                */ \
+    X(shl)                  /* a = b << c                                                               */ \
+    X(sar)                  /* a = b >> c                                                               */ \
+    X(shr)                  /* a = b >>> c                                                              */ \
+    X(bit_and)              /* a = b & c                                                                */ \
+    X(bit_xor)              /* a = b ^ c                                                                */ \
+    X(bit_or)               /* a = b | c                                                                */ \
+    X(lt)                   /* a = b < c                                                                */ \
+    X(le)                   /* a = b <= c                                                               */ \
+    X(gt)                   /* a = b > c                                                                */ \
+    X(ge)                   /* a = b >= c                                                               */ \
+    X(eq)                   /* a = b == c                                                               */ \
+    X(ne)                   /* a = b != c                                                               */ \
+    X(add_number)           /* a = b + number constant c                                                */ \
+    X(sub_number)           /* a = b - number constant c                                                */ \
+    X(mul_number)           /* a = b * number constant c                                                */ \
+    X(bit_and_number)       /* a = b & number constant c                                                */ \
+    X(jump_if_lt)           /* if ((a < b) == (x & 1)) goto +data, b is a number constant if x & 2      */ \
+    X(jump_if_le)           /* if ((a <= b) == (x & 1)) goto +data, b is a number constant if x & 2     */ \
+    X(jump_if_gt)           /* if ((a > b) == (x & 1)) goto +data, b is a number constant if x & 2      */ \
+    X(jump_if_ge)           /* if ((a >= b) == (x & 1)) goto +data, b is a number constant if x & 2     */ \
+    X(plus)                 /* a = ToNumber(b)                                                          */ \
+    X(neg)                  /* a = -b                                                                   */ \
+    X(bit_not)              /* a = ~b                                                                   */ \
+    X(not_)                 /* a = !b                                                                   */ \
+    X(typeof_)              /* a = typeof b                                                             */ \
+    X(inc)                  /* a = ToNumber(b) + 1                                                      */ \
+    X(dec)                  /* a = ToNumber(b) - 1                                                      */ \
+    X(jump)                 /* goto bc                                                                  */ \
+    X(jump_if_true)         /* if (a) goto bc                                                           */ \
+    X(jump_if_false)        /* if (!a) goto bc                                                          */ \
+    X(call)                 /* a = b(c arguments starting at b+2) with this = b+1 (+data: call node)    */ \
+    X(construct)            /* a = new b(c arguments starting at b+2) (+data: node of the operand)      */ \
+    X(define_function)      /* Put a function created from nested function bc in the active scope       */ \
+    X(make_function)        /* a = function created from nested function bc                             */ \
+    X(enter_with)           /* Add ToObject(a) to the front of the scope chain                          */ \
+    X(leave_with)           /* Remove the object added by the last enter_with                           */ \
+    X(for_in_start)         /* Start enumerating the properties of ToObject(a) using for-in state b     */ \
+    X(for_in_next)          /* a = next property name from for-in state b, if none goto +data          */ \
+    X(invalid_reference)    /* Report that expression node bc isn't a valid left hand side              */ \
+    X(statement_executed)   /* Report that statement node bc completed with type x and value a          */ \
+    X(return_)              /* Stop executing with completion type x and value a                        */
+
+enum class opcode : uint8_t {
+#define MJS_OPCODE_ENUM(name) name,
+    MJS_OPCODES(MJS_OPCODE_ENUM)
+#undef MJS_OPCODE_ENUM
+};
+
+std::wostream& operator<<(std::wostream& os, opcode op);
+
+struct instruction {
+    opcode   op;
+    uint8_t  x;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+
+    uint32_t bc() const { return b | static_cast<uint32_t>(c) << 16; }
+};
+static_assert(sizeof(instruction) == 8);
+
+// Variables and functions declared by code (not counting nested functions) and how they can be accessed
+struct declarations {
+    std::vector<std::wstring> ids;          // Declared variables and functions
+    bool uses_arguments = false;            // Whether the code might access the "arguments" object (directly or through eval)
+    bool dynamic_scope = false;             // Whether the code or a nested function uses with or eval, and so might access variables by name
+    std::unordered_set<std::wstring> nested_ids; // Identifiers used by nested functions (variables they might capture)
+};
+
+declarations scan_declarations(const block_statement& bs);
+
+// Compiled code of a program (or part of one), eval code or a function body. Refers to the syntax tree it was compiled
+// from (for names, inline caches and error reporting), so the syntax tree must outlive it. Always owned by a shared_ptr.
+class bytecode : public std::enable_shared_from_this<bytecode> {
+public:
+    // Register holding the completion value of the last statement when compiled with completion values
+    static constexpr uint16_t completion_register = 0;
+
+    const instruction* code() const { return code_.data(); }
+    uint32_t code_size() const { return static_cast<uint32_t>(code_.size()); }
+    uint32_t register_count() const { return register_count_; }
+    uint32_t for_in_count() const { return for_in_count_; }
+
+    double number(uint32_t index) const { return numbers_[index]; }
+    const std::wstring& string_constant(uint32_t index) const { return strings_[index]; }
+    uint32_t string_count() const { return static_cast<uint32_t>(strings_.size()); }
+
+    template<typename T>
+    const T& node(uint32_t index) const {
+        return static_cast<const T&>(*nodes_[index]);
+    }
+
+    // Function definitions in the code and their compiled bodies
+    struct function_entry {
+        const function_definition*      definition;
+        std::shared_ptr<const bytecode> code;
+    };
+    const function_entry& function(uint32_t index) const { return functions_[index]; }
+
+    // The following are only valid for function code
+
+    const struct declarations& declarations() const { return declarations_; }
+
+    // Unless the declarations have a dynamic scope, local variables aren't kept in an activation object. Variables that
+    // nested functions might access are stored in slots of an environment created for each call, all others (and this
+    // and the arguments object) in registers.
+    struct local_location {
+        bool     in_environment;
+        uint16_t index;             // Slot or register
+    };
+    const std::vector<local_location>& param_locations() const { return param_locations_; }
+    uint32_t environment_size() const { return environment_size_; } // No environment is needed if 0
+    uint32_t this_register() const { return this_register_; }
+    uint32_t arguments_register() const { return arguments_register_; } // UINT32_MAX if the arguments object isn't used
+
+    // Machine code compiled from the bytecode (see jit.h), created the first time the code is run with the JIT enabled
+    const std::shared_ptr<const jit_code>& compiled() const { return compiled_; }
+    void compiled(const std::shared_ptr<const jit_code>& c) const { compiled_ = c; }
+
+private:
+    friend class bytecode_compiler;
+
+    std::vector<instruction>                  code_;
+    std::vector<double>                       numbers_;
+    std::vector<std::wstring>                 strings_;
+    std::vector<const syntax_node*>           nodes_;
+    std::vector<std::unique_ptr<syntax_node>> own_nodes_; // Nodes created by the compiler (e.g. for declared variables)
+    std::vector<function_entry>               functions_;
+    struct declarations                       declarations_;
+    uint32_t                                  register_count_ = 0;
+    uint32_t                                  for_in_count_ = 0;
+    std::vector<local_location>               param_locations_;
+    uint32_t                                  environment_size_ = 0;
+    uint32_t                                  this_register_ = UINT32_MAX;
+    uint32_t                                  arguments_register_ = UINT32_MAX;
+    mutable std::shared_ptr<const jit_code>   compiled_;
+};
+
+struct compile_options {
+    bool completion_values = false; // Keep track of the completion value of statements (in bytecode::completion_register)
+    bool statement_hooks = false;   // Emit statement_executed after every statement (implies completion_values)
+};
+
+// Compiles global or eval code, the code returns the completion of 's'
+std::shared_ptr<const bytecode> compile(const statement& s, const compile_options& options);
+
+// Compiles a function defined in global code (nested functions are compiled with the code containing them), the code
+// returns the completion of the return statement executed (if any)
+std::shared_ptr<const bytecode> compile_function(const function_definition& f, const compile_options& options);
+
+// Compiles an expression, the code returns a normal completion with its value
+std::shared_ptr<const bytecode> compile(const expression& e);
+
+} // namespace mjs
+
+#endif
@@ -3,20 +3,50 @@
 
 #include "gc_heap.h"
 #include "value.h"
+#include <type_traits>
 
 namespace mjs {
 
+// Non-owning view of the arguments of a function call. The values must outlive the call.
+class value_span {
+public:
+    value_span() : data_(nullptr), size_(0) {}
+    value_span(const value* data, size_t size) : data_(data), size_(size) {}
+    value_span(const std::vector<value>& v) : data_(v.data()), size_(v.size()) {}
+
+    const value* begin() const { return data_; }
+    const value* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return !size_; }
+
+    const value& operator[](size_t index) const { assert(index < size_); return data_[index]; }
+    const value& front() const { assert(size_); return data_[0]; }
+    const value& back() const { assert(size_); return data_[size_ - 1]; }
+
+private:
+    const value* data_;
+    size_t size_;
+};
+
 // alignas needed so impl<F> will be construct with proper alignment
 class alignas(uint64_t) gc_function {
 public:
+    // 'f' is called with the this value and the arguments as a value_span (or a std::vector<value> for compatibility, at
+    // the cost of copying the arguments for each call)
     template<typename F>
     static gc_heap_ptr<gc_function> make(gc_heap& h, const F& f) {
-        auto p = h.allocate_and_construct<gc_function>(sizeof(gc_function) + sizeof(impl<F>));
-        new (p->get_model()) impl<F>{f};
-        return p;
+        if constexpr (std::is_invocable_r_v<value, const F&, const value&, const value_span&>) {
+            auto p = h.allocate_and_construct<gc_function>(sizeof(gc_function) + sizeof(impl<F>));
+            new (p->get_model()) impl<F>{f};
+            return p;
+        } else {
+            return make(h, [f](const value& this_, const value_span& args) {
+                return f(this_, std::vector<value>(args.begin(), args.end()));
+            });
+        }
     }
 
-    value call(const value& this_, const std::vector<value>& args) const {
+    value call(const value& this_, const value_span& args) const {
         return get_model()->call(this_, args);
     }
 
@@ -26,7 +56,7 @@ private:
     class model {
     public:
         virtual void destroy() = 0;
-        virtual value call(const value& this_, const std::vector<value>& args) = 0;
+        virtual value call(const value& this_, const value_span& args) = 0;
         virtual void move(model* to) = 0;
     };
     template<typename F>
@@ -35,7 +65,7 @@ private:
         explicit impl(const F& f) : f(f) {}
         explicit impl(F&& f) : f(std::move(f)) {}
         void destroy() override { f.~F(); }
-        value call(const value& this_, const std::vector<value>& args) override { return f(this_, args); }
+        value call(const value& this_, const value_span& args) override { return f(this_, args); }
         void move(model* to) override { new (to) impl<F>(std::move(*this)); }
     private:
         F f;
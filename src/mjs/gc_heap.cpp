@@ -1,4 +1,5 @@
 #include "gc_heap.h"
+#include "value_representation.h"
 #include <algorithm>
 #include <iomanip>
 #include <sstream>
@@ -70,6 +71,7 @@ gc_heap::gc_heap(uint32_t capacity) : storage_(static_cast<slot*>(std::malloc(ca
 
 gc_heap::~gc_heap() {
     assert(gc_state_.initial_state());
+    assert(root_ranges_.empty());
     run_destructors();
     std::free(storage_);
 }
@@ -145,6 +147,11 @@ void gc_heap::garbage_collect() {
             register_fixup(p->pos_);
         }
     }
+    for (const auto& [first, last]: root_ranges_) {
+        for (auto p = first; p != last; ++p) {
+            p->fixup(*this);
+        }
+    }
 
     if (!gc_state_.pending_fixups.empty()) {
         gc_heap new_heap{capacity_}; // TODO: Allow resize
@@ -159,6 +166,13 @@ void gc_heap::garbage_collect() {
             *ppos = gc_move(*ppos);
         }
 
+        // Every reachable object has now been moved, so weak pointers either follow their object or are cleared
+        for (auto ppos: gc_state_.weak_fixups) {
+            const auto& a = storage_[*ppos-1].allocation;
+            *ppos = a.type == gc_moved_type_index ? storage_[*ppos].new_position : 0;
+        }
+        gc_state_.weak_fixups.clear();
+
         std::swap(storage_, new_heap.storage_);
         std::swap(next_free_, new_heap.next_free_);
         gc_state_.new_heap = nullptr;
@@ -236,10 +250,30 @@ uint32_t gc_heap::gc_move(const uint32_t pos) {
     return new_pos;
 }
 
+void gc_heap::add_root_range(value_representation* first, value_representation* last) {
+    assert(!is_internal(first) && first <= last);
+    root_ranges_.emplace_back(first, last);
+}
+
+void gc_heap::remove_root_range(value_representation* first) {
+    // Search from the back since ranges are usually removed in LIFO order
+    for (size_t i = root_ranges_.size(); i--;) {
+        if (root_ranges_[i].first == first) {
+            root_ranges_.erase(root_ranges_.begin() + i);
+            return;
+        }
+    }
+    assert(!"Root range not found!");
+}
+
 void gc_heap::register_fixup(uint32_t& pos) {
     gc_state_.pending_fixups.push_back(&pos);
 }
 
+void gc_heap::register_weak_fixup(uint32_t& pos) {
+    gc_state_.weak_fixups.push_back(&pos);
+}
+
 uint32_t gc_heap::allocate(size_t num_bytes) {
     if (!num_bytes || num_bytes >= UINT32_MAX) {
         assert(!"Invalid allocation size");
@@ -260,12 +294,18 @@ uint32_t gc_heap::allocate(size_t num_bytes) {
 
 void gc_heap::attach(gc_heap_ptr_untyped& p) {
     assert(p.heap_ == this && p.pos_ > 0 && p.pos_ < next_free_);
+    p.index_ = pointers_.size();
     pointers_.insert(p);
 }
 
 void gc_heap::detach(gc_heap_ptr_untyped& p) {
     assert(p.heap_ == this);
-    pointers_.erase(p);
+    // Pointers remember their position in the set, so they can be removed without searching (objects in the heap, and
+    // their internal pointers, are often destroyed oldest first)
+    assert(p.index_ < pointers_.size() && pointers_.data()[p.index_] == &p && "Pointer not found in set!");
+    if (auto moved = pointers_.erase(p.index_)) {
+        moved->index_ = p.index_;
+    }
 }
 
 } // namespace mjs
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 #include <algorithm>
 #include <ostream>
 #include <typeinfo>
@@ -18,7 +19,7 @@ class gc_heap;
 class gc_heap_ptr_untyped;
 template<typename T>
 class gc_heap_ptr;
-template<typename T>
+template<typename T, bool Weak = false>
 class gc_heap_ptr_untracked;
 class value_representation;
 
@@ -164,7 +165,7 @@ class gc_heap {
 public:
     friend gc_heap_ptr_untyped;
     friend value_representation;
-    template<typename> friend class gc_heap_ptr_untracked;
+    template<typename, bool> friend class gc_heap_ptr_untracked;
 
     static constexpr uint32_t slot_size = sizeof(uint64_t);
     static constexpr uint32_t bytes_to_slots(size_t bytes) { return static_cast<uint32_t>((bytes + slot_size - 1) / slot_size); }
@@ -185,6 +186,12 @@ public:
         return allocate_and_construct<T>(sizeof(T), std::forward<Args>(args)...);
     }
 
+    // Registers the value_representations in [first, last), which must live outside the heap, as roots until
+    // remove_root_range(first) is called. The range must not move while registered. Ranges are expected to be
+    // removed in the opposite order of being added (e.g. interpreter registers).
+    void add_root_range(value_representation* first, value_representation* last);
+    void remove_root_range(value_representation* first);
+
 private:
     static constexpr uint32_t uninitialized_type_index = UINT32_MAX;
     static constexpr uint32_t gc_moved_type_index      = uninitialized_type_index-1;
@@ -229,19 +236,22 @@ private:
             set_.push_back(&p);
         }
 
-        void erase(const gc_heap_ptr_untyped& p) {
-            // Search from the back since objects tend to be short lived
-            for (size_t i = set_.size(); i--;) {
-                if (set_[i] == &p) {
-                    set_.erase(set_.begin() + i);
-                    return;
-                }
+        // Removes the pointer at 'index' by moving the last pointer there, returns the pointer that now has 'index'
+        // (nullptr if it was the last one)
+        gc_heap_ptr_untyped* erase(uint32_t index) {
+            assert(index < size());
+            const auto last = set_.back();
+            set_.pop_back();
+            if (index == size()) {
+                return nullptr;
             }
-            assert(!"Pointer not found in set!");
+            set_[index] = last;
+            return last;
         }
     };
 
     pointer_set pointers_;
+    std::vector<std::pair<value_representation*, value_representation*>> root_ranges_;
     slot*       storage_;
     uint32_t    capacity_;
     uint32_t    next_free_ = 0;
@@ -249,12 +259,13 @@ private:
     // Only valid during GC
     struct gc_state {
 #ifndef NDEBUG
-        bool initial_state() const { return level == 0 && new_heap == nullptr && pending_fixups.empty(); }
+        bool initial_state() const { return level == 0 && new_heap == nullptr && pending_fixups.empty() && weak_fixups.empty(); }
 #endif
 
         uint32_t level = 0;                     // recursion depth
         gc_heap* new_heap = nullptr;            // the "new_heap" is only kept for allocation purposes, no references to it should be kept
         std::vector<uint32_t*> pending_fixups;  // pending fixup addresses
+        std::vector<uint32_t*> weak_fixups;     // weak pointer addresses, resolved once all live objects have been moved
     } gc_state_;
 
     void run_destructors();
@@ -273,6 +284,7 @@ private:
     uint32_t gc_move(uint32_t pos);
 
     void register_fixup(uint32_t& pos);
+    void register_weak_fixup(uint32_t& pos);
 
     template<typename T>
     gc_heap_ptr<T> unsafe_create_from_position(uint32_t pos);
@@ -282,7 +294,7 @@ class gc_heap_ptr_untyped {
 public:
     friend gc_heap;
     friend value_representation;
-    template<typename> friend class gc_heap_ptr_untracked;
+    template<typename, bool> friend class gc_heap_ptr_untracked;
 
     gc_heap_ptr_untyped() : heap_(nullptr), pos_(0) {
     }
@@ -329,6 +341,7 @@ protected:
 private:
     gc_heap* heap_;
     uint32_t pos_;
+    uint32_t index_; // Position in gc_heap::pointers_ (only valid while attached)
 };
 
 template<typename T>
@@ -350,7 +363,9 @@ private:
     explicit gc_heap_ptr(const gc_heap_ptr_untyped& p) : gc_heap_ptr_untyped(p) {}
 };
 
-template<typename T>
+// Untracked pointer for use inside objects living in the GC heap. The owning object must call fixup() from its own fixup function.
+// Weak pointers don't keep the pointed-to object alive, if it isn't otherwise reachable the pointer becomes null after garbage collection.
+template<typename T, bool Weak>
 class gc_heap_ptr_untracked {
     // TODO: Add debug mode where e.g. the MSB of pos_ is set when the pointer is copied
     //       Then check that 1) it is set in fixup 2) NOT set in the destructor
@@ -364,6 +379,9 @@ public:
 
     explicit operator bool() const { return pos_; }
 
+    bool operator==(const gc_heap_ptr_untracked& rhs) const { return pos_ == rhs.pos_; }
+    bool operator!=(const gc_heap_ptr_untracked& rhs) const { return pos_ != rhs.pos_; }
+
     T& dereference(gc_heap& h) const {
         assert(pos_ > 0 && pos_ < h.next_free_ && gc_type_info_registration<T>::get().is_convertible(h.storage_[pos_-1].allocation.type_info()));
         return *reinterpret_cast<T*>(&h.storage_[pos_]);
@@ -376,7 +394,11 @@ public:
 
     void fixup(gc_heap& old_heap) {
         if (pos_) {
-            old_heap.register_fixup(pos_);
+            if constexpr (Weak) {
+                old_heap.register_weak_fixup(pos_);
+            } else {
+                old_heap.register_fixup(pos_);
+            }
         }
     }
 
@@ -0,0 +1,86 @@
+#include "gc_shape.h"
+#include <atomic>
+
+namespace mjs {
+
+static_assert(!gc_type_info_registration<gc_shape>::needs_destroy);
+static_assert(gc_type_info_registration<gc_shape>::needs_fixup);
+
+uint32_t gc_shape::next_id() {
+    static std::atomic<uint32_t> id{0};
+    const uint32_t res = ++id;
+    assert(res != 0 && "Shape ids exhausted");
+    return res;
+}
+
+void gc_shape::fixup() {
+    parent_.fixup(heap_);
+    key_.fixup(heap_);
+    transitions_.fixup(heap_);
+}
+
+gc_heap_ptr<gc_shape> gc_shape::add(const gc_heap_ptr<gc_shape>& shape, const string& key, property_attribute attributes) {
+    auto& h = shape.heap();
+    const gc_heap_ptr_untracked<gc_string> key_pos{key.unsafe_raw_get()};
+    uint32_t free_index = UINT32_MAX;
+    if (shape->transitions_) {
+        auto& transitions = shape->transitions_.dereference(h);
+        for (uint32_t i = 0; i < transitions.length(); ++i) {
+            const auto& t = transitions[i];
+            if (!t) {
+                // Collected
+                free_index = i;
+                continue;
+            }
+            const auto& child = t.dereference(h);
+            if (child.attributes_ == attributes && (child.key_ == key_pos || child.key() == key)) {
+                return t.track(h);
+            }
+        }
+    }
+
+    auto child = h.make<gc_shape>(shape, key, attributes);
+    if (free_index != UINT32_MAX) {
+        shape->transitions_.dereference(h)[free_index] = child;
+    } else if (!shape->transitions_) {
+        auto transitions = transition_vector::make(h, 2);
+        transitions->push_back(child);
+        shape->transitions_ = transitions;
+    } else if (auto& transitions = shape->transitions_.dereference(h); transitions.length() < transitions.capacity()) {
+        transitions.push_back(child);
+    } else {
+        auto nt = transitions.copy_with_capacity(transitions.capacity() * 2);
+        nt->push_back(child);
+        shape->transitions_ = nt;
+    }
+    return child;
+}
+
+const gc_shape* gc_shape::find(const string& key) const {
+    // Compare by position first, interned keys can't match any other interned key and
+    // keys with different (already calculated) hashes can't match either
+    const auto& raw_key = key.unsafe_raw_get();
+    const gc_heap_ptr_untracked<gc_string> key_pos{raw_key};
+    const bool interned = raw_key->interned();
+    for (const gc_shape* s = this; !s->is_root(); s = &s->parent()) {
+        if (s->key_ == key_pos) {
+            return s;
+        }
+        const auto& k = s->key_.dereference(heap_);
+        if (!(interned && k.interned()) && !(raw_key->has_hash() && k.has_hash() && k.hash() != raw_key->hash()) && string_equal(k.view(), raw_key->view())) {
+            return s;
+        }
+    }
+    return nullptr;
+}
+
+const gc_shape* gc_shape::find(const std::wstring_view& key) const {
+    for (const gc_shape* s = this; !s->is_root(); s = &s->parent()) {
+        if (string_equal(s->key_view(), key)) {
+            return s;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace mjs
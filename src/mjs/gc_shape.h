@@ -0,0 +1,83 @@
+#ifndef MJS_GC_SHAPE_H
+#define MJS_GC_SHAPE_H
+
+#include "gc_heap.h"
+#include "gc_vector.h"
+#include "string.h"
+#include "property_attribute.h"
+
+namespace mjs {
+
+// Describes the layout of an object: the names and attributes of its properties and their positions
+// (slots) in its value array. Shapes are immutable and form a tree, each shape adding one property to its
+// parent. Objects that get the same properties in the same order (from the same root) share shapes.
+class gc_shape {
+public:
+    static gc_heap_ptr<gc_shape> make_root(gc_heap& h) {
+        return h.make<gc_shape>(h);
+    }
+
+    // Returns the shape of an object with this shape that got the property 'key' added
+    static gc_heap_ptr<gc_shape> add(const gc_heap_ptr<gc_shape>& shape, const string& key, property_attribute attributes);
+
+    // Number of properties (and slots) of objects with this shape
+    uint32_t property_count() const { return property_count_; }
+
+    // Returns the shape that added the property called 'key' (nullptr if there is no such property)
+    const gc_shape* find(const string& key) const;
+    const gc_shape* find(const std::wstring_view& key) const;
+
+    // The following are only valid for non-root shapes
+
+    // The shape before the last property was added
+    const gc_shape& parent() const { return parent_.dereference(heap_); }
+    gc_heap_ptr<gc_shape> parent_ptr() const { return parent_.track(heap_); }
+
+    // The last property added
+    gc_heap_ptr<gc_string> key() const { return key_.track(heap_); }
+    std::wstring_view key_view() const { return key_.dereference(heap_).view(); }
+    property_attribute attributes() const { return attributes_; }
+    uint32_t slot() const { assert(property_count_); return property_count_ - 1; }
+
+    bool is_root() const { return !parent_; }
+
+    // Unique (non-zero) id of the shape. Unlike its position in the heap it doesn't change when garbage is collected, so
+    // it can be remembered by inline caches (see property_cache.h).
+    uint32_t id() const { return id_; }
+
+private:
+    friend gc_type_info_registration<gc_shape>;
+
+    using transition_vector = gc_vector<gc_heap_ptr_untracked<gc_shape, true>>;
+
+    gc_heap& heap_;
+    uint32_t id_;
+    gc_heap_ptr_untracked<gc_shape> parent_;
+    gc_heap_ptr_untracked<gc_string> key_;
+    property_attribute attributes_;
+    uint32_t property_count_;
+    // Shapes that have this one as parent. The references are weak, so shapes no object uses (any longer) can be collected.
+    gc_heap_ptr_untracked<transition_vector> transitions_;
+
+    static uint32_t next_id();
+
+    explicit gc_shape(gc_heap& h) : heap_(h), id_(next_id()), attributes_(property_attribute::none), property_count_(0) {
+    }
+
+    explicit gc_shape(const gc_heap_ptr<gc_shape>& parent, const string& key, property_attribute attributes)
+        : heap_(parent.heap())
+        , id_(next_id())
+        , parent_(parent)
+        , key_(key.unsafe_raw_get())
+        , attributes_(attributes)
+        , property_count_(parent->property_count_ + 1) {
+    }
+
+    gc_shape(gc_shape&&) = default;
+
+    void fixup();
+};
+
+} // namespace mjs
+
+#endif
@@ -0,0 +1,96 @@
+#include "gc_string_table.h"
+
+namespace mjs {
+
+static_assert(!gc_type_info_registration<gc_string_table>::needs_destroy);
+static_assert(gc_type_info_registration<gc_string_table>::needs_fixup);
+
+gc_string_table::gc_string_table(gc_string_table&& other) : heap_(other.heap_), capacity_(other.capacity_), used_(other.used_) {
+    static_assert(sizeof(gc_string_table::entry_representation) == gc_heap::slot_size);
+    std::memcpy(entries(), other.entries(), capacity_ * sizeof(entry_representation));
+}
+
+void gc_string_table::fixup() {
+    for (uint32_t i = 0; i < capacity_; ++i) {
+        entries()[i].str.fixup(heap_);
+    }
+}
+
+uint32_t gc_string_table::lookup(const std::wstring_view& s, uint32_t hash) const {
+    const uint32_t mask = capacity_ - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+        const auto& e = entries()[i];
+        if (!e.hash || (e.hash == hash && e.str && string_equal(e.str.dereference(heap_).view(), s))) {
+            return i;
+        }
+    }
+}
+
+uint32_t gc_string_table::count_live() const {
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < capacity_; ++i) {
+        if (entries()[i].str) {
+            ++live;
+        }
+    }
+    return live;
+}
+
+void gc_string_table::insert_unique(uint32_t hash, const gc_heap_ptr_untracked<gc_string, true>& str) {
+    const uint32_t mask = capacity_ - 1;
+    uint32_t i = hash & mask;
+    while (entries()[i].hash) {
+        i = (i + 1) & mask;
+    }
+    entries()[i] = entry_representation{hash, str};
+    ++used_;
+    assert(used_ < capacity_);
+}
+
+void gc_string_table::make_room(gc_heap_ptr<gc_string_table>& table) {
+    // Keep the load factor below 3/4. Tombstones left by collected strings are dropped when rebuilding.
+    if ((table->used_ + 1) * 4 <= table->capacity_ * 3) {
+        return;
+    }
+    const auto& old = *table;
+    const auto live = old.count_live();
+    auto nt = make(table.heap(), live * 2 >= old.capacity_ ? old.capacity_ * 2 : old.capacity_);
+    for (uint32_t i = 0; i < old.capacity_; ++i) {
+        if (const auto& e = old.entries()[i]; e.str) {
+            nt->insert_unique(e.hash, e.str);
+        }
+    }
+    table = nt;
+}
+
+string gc_string_table::intern(gc_heap_ptr<gc_string_table>& table, const std::wstring_view& s, uint32_t hash) {
+    auto& h = table.heap();
+    if (const auto& e = table->entries()[table->lookup(s, hash)]; e.hash) {
+        return string{e.str.track(h)};
+    }
+    make_room(table);
+    auto str = gc_string::make(h, s);
+    str->hash_ = hash;
+    str->interned_ = true;
+    table->insert_unique(hash, str);
+    return string{str};
+}
+
+string gc_string_table::intern(gc_heap_ptr<gc_string_table>& table, const string& s) {
+    const auto& raw = s.unsafe_raw_get();
+    if (raw->interned()) {
+        return s;
+    }
+    const auto hash = raw->hash();
+    const auto view = raw->view();
+    if (const auto& e = table->entries()[table->lookup(view, hash)]; e.hash) {
+        return string{e.str.track(table.heap())};
+    }
+    // Nobody else can be relying on the string not being interned, so it can be used directly
+    make_room(table);
+    raw->interned_ = true;
+    table->insert_unique(hash, raw);
+    return s;
+}
+
+} // namespace mjs
@@ -0,0 +1,67 @@
+#ifndef MJS_GC_STRING_TABLE_H
+#define MJS_GC_STRING_TABLE_H
+
+#include "gc_heap.h"
+#include "string.h"
+
+namespace mjs {
+
+// Table of interned strings (atoms). The table only holds weak references, so strings that are no
+// longer used anywhere else are reclaimed by the garbage collector (leaving a tombstone behind).
+class alignas(uint64_t) gc_string_table {
+public:
+    static gc_heap_ptr<gc_string_table> make(gc_heap& h, uint32_t capacity) {
+        assert(capacity >= 8 && (capacity & (capacity - 1)) == 0);
+        return h.allocate_and_construct<gc_string_table>(sizeof(gc_string_table) + capacity * sizeof(entry_representation), h, capacity);
+    }
+
+    uint32_t capacity() const { return capacity_; }
+
+    // Returns the interned string equal to 's', creating it if necessary (in which case 'table' might be replaced by a larger table)
+    static string intern(gc_heap_ptr<gc_string_table>& table, const std::wstring_view& s) {
+        return intern(table, s, string_hash(s));
+    }
+
+    // As above, but reuses the (cached) hash of 's' and 's' itself if it needs to be added
+    static string intern(gc_heap_ptr<gc_string_table>& table, const string& s);
+
+private:
+    friend gc_type_info_registration<gc_string_table>;
+
+    // Free entries have a zero hash, entries with a hash but without a string are tombstones.
+    struct entry_representation {
+        uint32_t                               hash;
+        gc_heap_ptr_untracked<gc_string, true> str;
+    };
+
+    gc_heap& heap_;
+    uint32_t capacity_; // always a power of 2
+    uint32_t used_;     // number of non-free entries (including tombstones)
+
+    entry_representation* entries() const {
+        return reinterpret_cast<entry_representation*>(const_cast<std::byte*>(reinterpret_cast<const std::byte*>(this)) + sizeof(*this));
+    }
+
+    explicit gc_string_table(gc_heap& h, uint32_t capacity) : heap_(h), capacity_(capacity), used_(0) {
+        std::memset(static_cast<void*>(entries()), 0, capacity_ * sizeof(entry_representation));
+    }
+
+    gc_string_table(gc_string_table&& other);
+
+    void fixup();
+
+    // Returns the index of the entry matching 's' or the index of the first free entry in its probe sequence
+    uint32_t lookup(const std::wstring_view& s, uint32_t hash) const;
+
+    uint32_t count_live() const;
+
+    void insert_unique(uint32_t hash, const gc_heap_ptr_untracked<gc_string, true>& str);
+
+    static string intern(gc_heap_ptr<gc_string_table>& table, const std::wstring_view& s, uint32_t hash);
+
+    static void make_room(gc_heap_ptr<gc_string_table>& table);
+};
+
+} // namespace mjs
+
+#endif
@@ -5,9 +5,35 @@ namespace mjs {
 static_assert(!gc_type_info_registration<gc_table>::needs_destroy);
 static_assert(gc_type_info_registration<gc_table>::needs_fixup);
 
-gc_table::gc_table(gc_table&& other) : heap_(other.heap_), capacity_(other.capacity_), length_(other.length_) {
+gc_table::gc_table(gc_table&& other) : heap_(other.heap_), capacity_(other.capacity_), length_(other.length_), erased_(other.erased_), index_capacity_(other.index_capacity_) {
     static_assert(sizeof(gc_table::entry_representation) == 2*gc_heap::slot_size);
+    static_assert(sizeof(gc_table::index_slot) == gc_heap::slot_size);
+    // The index refers to entries by position, so it stays valid when the table is moved
     std::memcpy(entries(), other.entries(), length() * sizeof(entry_representation));
+    std::memcpy(index(), other.index(), index_capacity_ * sizeof(index_slot));
+}
+
+gc_heap_ptr<gc_table> gc_table::copy_with_increased_capacity() const {
+    const uint32_t live = live_length();
+    auto nt = make(heap_, live * 2 >= capacity_ ? capacity_ * 2 : capacity_);
+    if (!erased_ && !nt->has_hash_index()) {
+        // Since it's the same heap the representation can just be copied
+        std::memcpy(nt->entries(), entries(), length() * sizeof(entry_representation));
+        nt->length_ = length();
+        return nt;
+    }
+    for (uint32_t i = 0; i < length_; ++i) {
+        const auto& e = entries()[i];
+        if (!e.key) {
+            continue;
+        }
+        if (nt->has_hash_index()) {
+            nt->index_insert(e.key.dereference(heap_).hash(), nt->length_);
+        }
+        nt->entries()[nt->length_++] = e;
+    }
+    assert(nt->length_ == live);
+    return nt;
 }
 
 void gc_table::fixup() {
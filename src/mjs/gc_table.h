@@ -15,22 +15,31 @@ private:
         property_attribute               attributes;
         value_representation             value;
     };
+    // Slot in the hash index. 'pos' is the index of the entry plus one (0 means the slot is free).
+    struct index_slot {
+        uint32_t pos;
+        uint32_t hash;
+    };
 public:
+    // Tables with at least this capacity get a hash index, smaller ones are searched linearly
+    static constexpr uint32_t hash_index_threshold = 64;
+
     static gc_heap_ptr<gc_table> make(gc_heap& h, uint32_t capacity) {
         assert(capacity > 0);
-        return h.allocate_and_construct<gc_table>(sizeof(gc_table) + capacity * sizeof(entry_representation), h, capacity);
+        const uint32_t index_capacity = index_capacity_for(capacity);
+        return h.allocate_and_construct<gc_table>(sizeof(gc_table) + capacity * sizeof(entry_representation) + index_capacity * sizeof(index_slot), h, capacity, index_capacity);
     }
 
     uint32_t capacity() const { return capacity_; }
+    // Number of entries used (including erased ones), when it reaches the capacity the table must be copied before inserting
     uint32_t length() const { return length_; }
+    // Number of entries that haven't been erased
+    uint32_t live_length() const { return length_ - erased_; }
+    bool has_hash_index() const { return index_capacity_ != 0; }
 
-    [[nodiscard]] gc_heap_ptr<gc_table> copy_with_increased_capacity() const {
-        auto nt = make(heap_, capacity() * 2);
-        nt->length_ = length();
-        // Since it's the same heap the representation can just be copied
-        std::memcpy(nt->entries(), entries(), length() * sizeof(entry_representation));
-        return nt;
-    }
+    // Returns a copy of the table with room for more entries. Erased entries are dropped, and the capacity
+    // is only increased if that doesn't free up enough space.
+    [[nodiscard]] gc_heap_ptr<gc_table> copy_with_increased_capacity() const;
 
     class entry {
     public:
@@ -42,6 +51,7 @@ public:
         entry& operator++() {
             assert(tab_ && index_ < tab_->length());
             ++index_;
+            skip_erased();
             return *this;
         }
 
@@ -58,6 +68,10 @@ public:
             return e().attributes;
         }
 
+        uint32_t index() const {
+            return index_;
+        }
+
         void value(const value& val) {
             assert(tab_);
             e().value = value_representation{val};
@@ -72,10 +86,13 @@ public:
             return (property_attributes() & a) == a;
         }
 
+        // Entries are only marked as erased (any hash index slot is left pointing at it), the space is reclaimed when the table is copied
         void erase() {
-            assert(tab_ && index_ < tab_->length());
-            std::memmove(&tab_->entries()[index_], &tab_->entries()[index_+1], sizeof(entry_representation) * (tab_->length() - 1 - index_));
-            --tab_->length_;
+            auto& er = e();
+            er.key = gc_heap_ptr_untracked<gc_string>{};
+            er.attributes = property_attribute::none;
+            er.value = value_representation{value::undefined};
+            ++tab_->erased_;
         }
 
     private:
@@ -89,6 +106,12 @@ public:
         explicit entry(gc_table& tab, uint32_t index) : tab_(&tab), index_(index) {
             assert(tab_ && index_ <= tab_->length());
         }
+
+        void skip_erased() {
+            while (index_ < tab_->length() && !tab_->entries()[index_].key) {
+                ++index_;
+            }
+        }
     };
 
     void insert(const string& key, const value& v, property_attribute attr) {
@@ -96,6 +119,9 @@ public:
         assert(&raw_key.heap() == &heap_);
         assert(length() < capacity());
         assert(find(key.view()) == end());
+        if (has_hash_index()) {
+            index_insert(raw_key->hash(), length_);
+        }
         entries()[length_++] = entry_representation{
             raw_key,
             attr,
@@ -104,40 +130,135 @@ public:
     }
 
     entry find(const std::wstring_view& key) {
-        auto it = begin(); 
-        while (it != end()) {
-            if (it.key_view() == key) {
-                break;
+        if (has_hash_index()) {
+            const uint32_t hash = string_hash(key);
+            for (const index_slot* slot = index_first(hash); slot->pos; slot = index_next(slot)) {
+                if (slot->hash != hash) {
+                    continue;
+                }
+                const auto& e = entries()[slot->pos - 1];
+                if (e.key && string_equal(e.key.dereference(heap_).view(), key)) {
+                    return entry{*this, slot->pos - 1};
+                }
             }
-            ++it;
+            return end();
         }
-        return it;
+        for (uint32_t i = 0; i < length_; ++i) {
+            const auto& e = entries()[i];
+            if (e.key && string_equal(e.key.dereference(heap_).view(), key)) {
+                return entry{*this, i};
+            }
+        }
+        return end();
     }
 
     entry find(const string& key) {
-        return find(key.view());
+        // Compare by position first, interned keys can't match any other interned key and
+        // keys with different (already calculated) hashes can't match either
+        const auto& raw_key = key.unsafe_raw_get();
+        const gc_heap_ptr_untracked<gc_string> key_pos{raw_key};
+        const bool interned = raw_key->interned();
+        const auto key_view = raw_key->view();
+        auto matches = [&](const entry_representation& e) {
+            if (e.key == key_pos) {
+                return true;
+            }
+            if (!e.key) {
+                return false;
+            }
+            const auto& k = e.key.dereference(heap_);
+            return !(interned && k.interned()) && !(raw_key->has_hash() && k.has_hash() && k.hash() != raw_key->hash()) && string_equal(k.view(), key_view);
+        };
+        if (has_hash_index()) {
+            const uint32_t hash = raw_key->hash();
+            for (const index_slot* slot = index_first(hash); slot->pos; slot = index_next(slot)) {
+                if (slot->hash == hash && matches(entries()[slot->pos - 1])) {
+                    return entry{*this, slot->pos - 1};
+                }
+            }
+            return end();
+        }
+        for (uint32_t i = 0; i < length_; ++i) {
+            if (matches(entries()[i])) {
+                return entry{*this, i};
+            }
+        }
+        return end();
     }
 
     entry begin() {
-        return entry{*this, 0};
+        entry e{*this, 0};
+        e.skip_erased();
+        return e;
     }
 
     entry end() {
         return entry{*this, length()};
     }
 
+    // Returns the (non-erased) entry at 'index'
+    entry at(uint32_t index) {
+        assert(index < length() && entries()[index].key);
+        return entry{*this, index};
+    }
+
+    // Returns true if there is a (non-erased) entry at 'index' with the key 'key'
+    bool has_key_at(uint32_t index, const std::wstring_view& key) const {
+        if (index >= length_) {
+            return false;
+        }
+        const auto& e = entries()[index];
+        return e.key && string_equal(e.key.dereference(heap_).view(), key);
+    }
+
 private:
     friend gc_type_info_registration<gc_table>;
 
     gc_heap& heap_;     // TODO: Deduce somehow?
     uint32_t capacity_; // TODO: Get from allocation header
     uint32_t length_;
+    uint32_t erased_;
+    uint32_t index_capacity_; // 0 if there's no hash index, otherwise a power of two at least twice the capacity
 
+    // The hash index (if any) follows the entries
     entry_representation* entries() const {
         return reinterpret_cast<entry_representation*>(const_cast<std::byte*>(reinterpret_cast<const std::byte*>(this)) + sizeof(*this));
     }
 
-    explicit gc_table(gc_heap& h, uint32_t capacity) : heap_(h), capacity_(capacity), length_(0) {
+    index_slot* index() const {
+        return reinterpret_cast<index_slot*>(entries() + capacity_);
+    }
+
+    static uint32_t index_capacity_for(uint32_t capacity) {
+        if (capacity < hash_index_threshold) {
+            return 0;
+        }
+        uint32_t c = hash_index_threshold;
+        while (c < capacity * 2) {
+            c *= 2;
+        }
+        return c;
+    }
+
+    // The index is never more than half full, so probing always ends at a free slot
+    const index_slot* index_first(uint32_t hash) const {
+        return &index()[hash & (index_capacity_ - 1)];
+    }
+
+    const index_slot* index_next(const index_slot* slot) const {
+        return ++slot == index() + index_capacity_ ? index() : slot;
+    }
+
+    void index_insert(uint32_t hash, uint32_t entry_index) {
+        auto slot = const_cast<index_slot*>(index_first(hash));
+        while (slot->pos) {
+            slot = const_cast<index_slot*>(index_next(slot));
+        }
+        *slot = index_slot{entry_index + 1, hash};
+    }
+
+    explicit gc_table(gc_heap& h, uint32_t capacity, uint32_t index_capacity) : heap_(h), capacity_(capacity), length_(0), erased_(0), index_capacity_(index_capacity) {
+        std::memset(index(), 0, index_capacity_ * sizeof(index_slot));
     }
 
     gc_table(gc_table&& from);
@@ -0,0 +1,95 @@
+#ifndef MJS_GC_VECTOR_H
+#define MJS_GC_VECTOR_H
+
+#include "gc_heap.h"
+#include <type_traits>
+
+namespace mjs {
+
+// Fixed capacity array of 'T's stored in the GC heap. T must be trivially copyable, if it has
+// a fixup(gc_heap&) member function it is called for all elements when the vector is moved.
+template<typename T>
+class alignas(uint64_t) gc_vector {
+public:
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    static gc_heap_ptr<gc_vector> make(gc_heap& h, uint32_t capacity) {
+        assert(capacity > 0);
+        return h.allocate_and_construct<gc_vector>(sizeof(gc_vector) + capacity * sizeof(T), h, capacity);
+    }
+
+    uint32_t capacity() const { return capacity_; }
+    uint32_t length() const { return length_; }
+
+    T* data() const {
+        return reinterpret_cast<T*>(const_cast<std::byte*>(reinterpret_cast<const std::byte*>(this)) + sizeof(*this));
+    }
+
+    T* begin() const { return data(); }
+    T* end() const { return data() + length_; }
+
+    T& operator[](uint32_t index) const {
+        assert(index < length_);
+        return data()[index];
+    }
+
+    void push_back(const T& v) {
+        assert(length_ < capacity_);
+        data()[length_++] = v;
+    }
+
+    void pop_back() {
+        assert(length_ > 0);
+        --length_;
+    }
+
+    // Changes the length to 'length' (at most the capacity), new elements are set to 'v'
+    void resize(uint32_t length, const T& v) {
+        assert(length <= capacity_);
+        for (uint32_t i = length_; i < length; ++i) {
+            data()[i] = v;
+        }
+        length_ = length;
+    }
+
+    // Returns a copy of the vector with room for 'capacity' elements
+    [[nodiscard]] gc_heap_ptr<gc_vector> copy_with_capacity(uint32_t capacity) const {
+        assert(capacity >= length_);
+        auto nv = make(heap_, capacity);
+        std::memcpy(static_cast<void*>(nv->data()), data(), length_ * sizeof(T));
+        nv->length_ = length_;
+        return nv;
+    }
+
+private:
+    friend gc_type_info_registration<gc_vector>;
+
+    template<typename U, typename=void>
+    struct has_fixup_t : std::false_type{};
+
+    template<typename U>
+    struct has_fixup_t<U, std::void_t<decltype(std::declval<U>().fixup(std::declval<gc_heap&>()))>> : std::true_type{};
+
+    gc_heap& heap_;
+    uint32_t capacity_;
+    uint32_t length_;
+
+    explicit gc_vector(gc_heap& h, uint32_t capacity) : heap_(h), capacity_(capacity), length_(0) {
+    }
+
+    gc_vector(gc_vector&& other) : heap_(other.heap_), capacity_(other.capacity_), length_(other.length_) {
+        std::memcpy(static_cast<void*>(data()), other.data(), length_ * sizeof(T));
+    }
+
+    void fixup() {
+        if constexpr (has_fixup_t<T>::value) {
+            for (auto& e: *this) {
+                e.fixup(heap_);
+            }
+        }
+    }
+};
+
+} // namespace mjs
+
+#endif
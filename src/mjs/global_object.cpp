@@ -1,11 +1,14 @@
 #include "global_object.h"
+#include "gc_string_table.h"
 #include "lexer.h" // get_hex_value2/4
+#include "mapped_file.h"
 #include <sstream>
 #include <chrono>
 #include <algorithm>
 #include <cmath>
 #include <ctime>
 #include <cstring>
+#include <cwchar>
 #include <iostream>
 #include <unordered_map>
 #include <memory>
@@ -20,16 +23,6 @@
 
 namespace mjs {
 
-std::wstring index_string(uint32_t index) {
-    wchar_t buffer[10], *p = &buffer[10];
-    *--p = '\0';
-    do {
-        *--p = '0' + index % 10;
-        index /= 10;
-    } while (index);
-    return std::wstring{p};
-}
-
 std::wstring_view ltrim(std::wstring_view s) {
     size_t start_pos = 0;
     while (start_pos < s.length() && isblank(s[start_pos]))
@@ -84,9 +77,8 @@ double parse_int(std::wstring_view s, int radix) {
 }
 
 double parse_float(std::wstring_view s) {
-    std::wistringstream wiss{std::wstring{ltrim(s)}};
     double val;
-    return wiss >> val ? val : NAN;
+    return parse_decimal_prefix(ltrim(s), val) ? val : NAN;
 }
 
 std::wstring escape(std::wstring_view s) {
@@ -135,66 +127,422 @@ std::wstring unescape(std::wstring_view s) {
     return res;
 }
 
+// Elements with indices below a limit (that grows as the array is used) are stored in a dense vector, elements with
+// larger indices (e.g. after "a[1000000] = 1") are stored as normal properties.
+// Like in V8 the dense vector has an element kind: as long as only numbers have been stored (without leaving holes)
+// they're kept unboxed as int32_t's or doubles, so builtins can work directly on the raw buffer. Storing any other value
+// switches to value_representations with holes for missing elements. Kinds only ever transition towards generic.
 class array_object : public object {
 public:
     friend gc_type_info_registration<array_object>;
 
+    enum class element_kind : uint8_t {
+        packed_int,     // No holes or sparse elements, all elements are numbers with int32 values (stored in ints_)
+        packed_double,  // No holes or sparse elements, all elements are numbers (stored in doubles_)
+        generic,        // Any values, holes and sparse elements (dense part stored in elements_)
+    };
+
     static constexpr const std::wstring_view length_str{L"length", 6};
 
     static gc_heap_ptr<array_object> make(gc_heap& h, const string& class_name, const object_ptr& prototype, uint32_t length) {
         return h.make<array_object>(h, class_name, prototype, length);
     }
 
+    element_kind kind() const { return kind_; }
+
     void put(const string& name, const value& val, property_attribute attr) override {
         if (!can_put(name.view())) {
             return;
         }
 
         if (name.view() == length_str) {
-            const uint32_t old_length = length();
-            const uint32_t new_length = to_uint32(val);
-            if (new_length < old_length) {
-                for (uint32_t i = new_length; i < old_length; ++i) {
-                    [[maybe_unused]] const bool res = object::delete_property(index_string(i));
-                    assert(res);
-                }
-            }
-            object::put(string{heap(), length_str}, value{static_cast<double>(new_length)});
+            set_length(to_uint32(val));
+        } else if (const uint32_t index = string_to_index(name.view()); index != UINT32_MAX) {
+            put_element(index, val);
         } else {
             object::put(name, val, attr);
-            uint32_t index = to_uint32(value{name});
-            if (name.view() == to_string(heap(), index).view() && index != UINT32_MAX && index >= length()) {
-                object::put(string{heap(), length_str}, value{static_cast<double>(index+1)});
+        }
+    }
+
+    value get_index(uint32_t index) const override {
+        switch (kind_) {
+        case element_kind::packed_int:
+            if (index < length_) {
+                return value{static_cast<double>(ints_.dereference(heap())[index])};
             }
+            break;
+        case element_kind::packed_double:
+            if (index < length_) {
+                return value{doubles_.dereference(heap())[index]};
+            }
+            break;
+        case element_kind::generic:
+            if (index < dense_length()) {
+                if (const auto& e = elements_.dereference(heap())[index]; !e.is_hole()) {
+                    return e.get_value(heap());
+                }
+            }
+            break;
+        }
+        return object::get_index(index);
+    }
+
+    void put_index(uint32_t index, const value& val) override {
+        // Existing dense elements are always writable, otherwise a read-only property could be inherited
+        if (!has_dense_element(index) && !can_put(index_string(index))) {
+            return;
         }
+        put_element(index, val);
     }
 
+    // Stores an element without checking [[CanPut]] (only for arrays that haven't been handed out yet)
     void unchecked_put(uint32_t index, const value& val) {
-        const auto name = index_string(index);
-        assert(index < to_uint32(get(length_str)) && can_put(name));
-        object::put(string{heap(), name}, val);
+        put_element(index, val);
+    }
+
+    // Fast paths for the Array.prototype functions, they return false (without doing anything) if the elements aren't packed
+
+    bool packed_join(const std::wstring_view& sep, std::wstring& res) const {
+        if (kind_ == element_kind::generic) {
+            return false;
+        }
+        wchar_t buffer[number_buffer_size];
+        for (uint32_t i = 0; i < length_; ++i) {
+            if (i) {
+                res += sep;
+            }
+            res.append(buffer, format_number(buffer, packed_element(i)));
+        }
+        return true;
+    }
+
+    bool packed_reverse() {
+        switch (kind_) {
+        case element_kind::packed_int:    if (ints_) std::reverse(ints_.dereference(heap()).begin(), ints_.dereference(heap()).end()); return true;
+        case element_kind::packed_double: if (doubles_) std::reverse(doubles_.dereference(heap()).begin(), doubles_.dereference(heap()).end()); return true;
+        case element_kind::generic:       break;
+        }
+        return false;
+    }
+
+    // Sorts the elements in the default (string) order. Converting numbers to strings can't run any script code,
+    // so the keys are only formatted once and the buffer is sorted in place.
+    bool packed_sort() {
+        switch (kind_) {
+        case element_kind::packed_int:    if (ints_) sort_by_string(ints_.dereference(heap())); return true;
+        case element_kind::packed_double: if (doubles_) sort_by_string(doubles_.dereference(heap())); return true;
+        case element_kind::generic:       break;
+        }
+        return false;
     }
 
 private:
-    uint32_t length() {
-        return to_uint32(object::get(length_str));
+    using element_vector = gc_vector<value_representation>;
+    using int_vector = gc_vector<int32_t>;
+    using double_vector = gc_vector<double>;
+
+    // The dense part may always grow to at least this length
+    static constexpr uint32_t min_dense_length = 8;
+    // Don't preallocate more than this many elements for e.g. "new Array(n)"
+    static constexpr uint32_t max_initial_dense_length = 1<<16;
+
+    gc_heap_ptr_untracked<int_vector> ints_;
+    gc_heap_ptr_untracked<double_vector> doubles_;
+    gc_heap_ptr_untracked<element_vector> elements_;
+    uint32_t length_;
+    element_kind kind_ = element_kind::packed_int;
+    bool has_sparse_elements_ = false;
+
+    explicit array_object(gc_heap& h, const string& class_name, const object_ptr& prototype, uint32_t length) : object{h, class_name, prototype}, length_(length) {
+        set_exotic();
+        if (length) {
+            // All elements start out as holes
+            kind_ = element_kind::generic;
+            if (length <= max_initial_dense_length) {
+                grow_dense(length);
+            }
+        }
     }
 
-    explicit array_object(gc_heap& h, const string& class_name, const object_ptr& prototype, uint32_t length) : object{h, class_name, prototype} {
-        object::put(string{heap(), length_str}, value{static_cast<double>(length)}, property_attribute::dont_enum | property_attribute::dont_delete);
+    array_object(array_object&&) = default;
+
+    void fixup() {
+        object::fixup();
+        ints_.fixup(heap());
+        doubles_.fixup(heap());
+        elements_.fixup(heap());
+    }
+
+    static bool is_int32(double d) {
+        return d >= INT32_MIN && d <= INT32_MAX && static_cast<double>(static_cast<int32_t>(d)) == d && !(d == 0 && std::signbit(d));
+    }
+
+    template<typename T>
+    uint32_t vector_length(const gc_heap_ptr_untracked<gc_vector<T>>& v) const {
+        return v ? v.dereference(heap()).length() : 0;
+    }
+
+    // Makes sure 'v' has room for at least 'capacity' elements
+    template<typename T>
+    void reserve(gc_heap_ptr_untracked<gc_vector<T>>& v, uint32_t capacity) {
+        const uint32_t old_capacity = v ? v.dereference(heap()).capacity() : 0;
+        if (capacity <= old_capacity) {
+            return;
+        }
+        uint32_t new_capacity = std::max(old_capacity * 2, min_dense_length);
+        while (new_capacity < capacity) {
+            new_capacity *= 2;
+        }
+        v = v ? v.dereference(heap()).copy_with_capacity(new_capacity) : gc_vector<T>::make(heap(), new_capacity);
+    }
+
+    uint32_t dense_length() const {
+        switch (kind_) {
+        case element_kind::packed_int:    return vector_length(ints_);
+        case element_kind::packed_double: return vector_length(doubles_);
+        case element_kind::generic:       return vector_length(elements_);
+        }
+        return 0;
+    }
+
+    bool has_dense_element(uint32_t index) const {
+        return index < dense_length() && (kind_ != element_kind::generic || !elements_.dereference(heap())[index].is_hole());
+    }
+
+    double packed_element(uint32_t index) const {
+        assert(index < length_);
+        return kind_ == element_kind::packed_int ? ints_.dereference(heap())[index] : doubles_.dereference(heap())[index];
+    }
+
+    value dense_element(uint32_t index) const {
+        assert(has_dense_element(index));
+        return kind_ == element_kind::generic ? elements_.dereference(heap())[index].get_value(heap()) : value{packed_element(index)};
+    }
+
+    void put_element(uint32_t index, const value& val) {
+        if (kind_ != element_kind::generic) {
+            // Stay packed as long as the store doesn't leave a hole (storing at the current length appends)
+            if (val.type() == value_type::number && index <= length_) {
+                put_packed(index, val.number_value());
+                return;
+            }
+            make_generic();
+        }
+        if (const uint32_t dense = dense_length(); index >= dense && index < std::max(dense * 2, min_dense_length)) {
+            grow_dense(index + 1);
+        }
+        if (index < dense_length()) {
+            elements_.dereference(heap())[index] = value_representation{val};
+        } else {
+            object::put(string{heap(), index_string(index)}, val);
+            has_sparse_elements_ = true;
+        }
+        if (index >= length_) {
+            length_ = index + 1;
+        }
+    }
+
+    void put_packed(uint32_t index, double d) {
+        if (kind_ == element_kind::packed_int && !is_int32(d)) {
+            to_packed_double();
+        }
+        if (kind_ == element_kind::packed_int) {
+            put_packed(ints_, index, static_cast<int32_t>(d));
+        } else {
+            put_packed(doubles_, index, d);
+        }
+    }
+
+    template<typename T>
+    void put_packed(gc_heap_ptr_untracked<gc_vector<T>>& v, uint32_t index, T val) {
+        assert(index <= length_ && vector_length(v) == length_);
+        if (index == length_) {
+            reserve(v, length_ + 1);
+            v.dereference(heap()).push_back(val);
+            ++length_;
+        } else {
+            v.dereference(heap())[index] = val;
+        }
+    }
+
+    void to_packed_double() {
+        assert(kind_ == element_kind::packed_int);
+        if (ints_) {
+            const auto& ints = ints_.dereference(heap());
+            auto doubles = double_vector::make(heap(), ints.capacity());
+            for (const auto i: ints) {
+                doubles->push_back(i);
+            }
+            doubles_ = doubles;
+            ints_ = {};
+        }
+        kind_ = element_kind::packed_double;
+    }
+
+    void make_generic() {
+        if (kind_ == element_kind::generic) {
+            return;
+        }
+        if (length_) {
+            auto elements = element_vector::make(heap(), std::max(length_, min_dense_length));
+            for (uint32_t i = 0; i < length_; ++i) {
+                elements->push_back(value_representation{value{packed_element(i)}});
+            }
+            elements_ = elements;
+        }
+        ints_ = {};
+        doubles_ = {};
+        kind_ = element_kind::generic;
+    }
+
+    void grow_dense(uint32_t new_length) {
+        assert(kind_ == element_kind::generic);
+        const uint32_t old_length = dense_length();
+        assert(new_length > old_length);
+        reserve(elements_, new_length);
+        elements_.dereference(heap()).resize(new_length, value_representation::hole());
+        if (has_sparse_elements_) {
+            // Move elements that are now in the dense range
+            for (const auto& [index, name]: sparse_elements(old_length, new_length)) {
+                const auto val = object::get(name);
+                [[maybe_unused]] const bool res = object::delete_property(name.view());
+                assert(res);
+                elements_.dereference(heap())[index] = value_representation{val};
+            }
+        }
+    }
+
+    void set_length(uint32_t new_length) {
+        if (kind_ != element_kind::generic) {
+            if (new_length <= length_) {
+                if (kind_ == element_kind::packed_int && ints_) {
+                    ints_.dereference(heap()).resize(new_length, 0);
+                } else if (kind_ == element_kind::packed_double && doubles_) {
+                    doubles_.dereference(heap()).resize(new_length, 0);
+                }
+                length_ = new_length;
+                return;
+            }
+            // Growing the array adds holes
+            make_generic();
+        }
+        if (new_length < length_) {
+            if (dense_length() > new_length) {
+                elements_.dereference(heap()).resize(new_length, value_representation::hole());
+            }
+            if (has_sparse_elements_) {
+                for (const auto& e: sparse_elements(new_length, UINT32_MAX)) {
+                    [[maybe_unused]] const bool res = object::delete_property(e.second.view());
+                    assert(res);
+                }
+            }
+        }
+        length_ = new_length;
+    }
+
+    // Returns the elements in [begin, end) stored as normal properties
+    std::vector<std::pair<uint32_t, string>> sparse_elements(uint32_t begin, uint32_t end) const {
+        std::vector<std::pair<uint32_t, string>> res;
+        for_each_own_property([&](const string& key, const value&, property_attribute) {
+            if (const uint32_t index = string_to_index(key.view()); index >= begin && index < end) {
+                res.emplace_back(index, key);
+            }
+        });
+        return res;
+    }
+
+    template<typename T>
+    static void sort_by_string(gc_vector<T>& v) {
+        struct sort_key {
+            size_t pos;
+            int len;
+            T val;
+        };
+        std::wstring text;
+        std::vector<sort_key> keys;
+        keys.reserve(v.length());
+        wchar_t buffer[number_buffer_size];
+        for (const auto& e: v) {
+            const int len = format_number(buffer, e);
+            keys.push_back(sort_key{text.length(), len, e});
+            text.append(buffer, len);
+        }
+        std::stable_sort(keys.begin(), keys.end(), [&text](const sort_key& x, const sort_key& y) {
+            return string_compare(std::wstring_view{text}.substr(x.pos, x.len), std::wstring_view{text}.substr(y.pos, y.len)) < 0;
+        });
+        for (uint32_t i = 0; i < v.length(); ++i) {
+            v[i] = keys[i].val;
+        }
+    }
+
+    uint32_t dense_index(const std::wstring_view& name) const {
+        const uint32_t index = string_to_index(name);
+        return has_dense_element(index) ? index : UINT32_MAX;
+    }
+
+    bool exotic_find(const std::wstring_view& name, property_attribute& attributes) const override {
+        if (name == length_str) {
+            attributes = property_attribute::dont_enum | property_attribute::dont_delete;
+            return true;
+        } else if (dense_index(name) != UINT32_MAX) {
+            attributes = property_attribute::none;
+            return true;
+        }
+        return false;
+    }
+
+    value exotic_get(const std::wstring_view& name) const override {
+        if (name == length_str) {
+            return value{static_cast<double>(length_)};
+        }
+        const uint32_t index = dense_index(name);
+        assert(index != UINT32_MAX);
+        return dense_element(index);
+    }
+
+    void exotic_delete(const std::wstring_view& name) override {
+        const uint32_t index = dense_index(name);
+        assert(index != UINT32_MAX);
+        make_generic();
+        elements_.dereference(heap())[index] = value_representation::hole();
+    }
+
+    void exotic_property_names(std::vector<string>& names) const override {
+        for (uint32_t i = 0, l = dense_length(); i < l; ++i) {
+            if (has_dense_element(i)) {
+                names.push_back(string{heap(), index_string(i)});
+            }
+        }
     }
 };
 
 string join(const object_ptr& o, const std::wstring_view& sep) {
     auto& h = o.heap();
+    if (auto a = dynamic_cast<const array_object*>(o.get())) {
+        if (std::wstring s; a->packed_join(sep, s)) {
+            return string{h, s};
+        }
+    }
     const uint32_t l = to_uint32(o->get(array_object::length_str));
-    std::wstring s;
+    // Convert all elements first, so the result can be built without reallocating
+    const string empty{h, L""};
+    std::vector<string> parts;
+    parts.reserve(l);
+    size_t total = l ? sep.length() * (l - 1) : 0;
     for (uint32_t i = 0; i < l; ++i) {
-        if (i) s += sep;
-        const auto& oi = o->get(index_string(i));
+        const auto& oi = o->get_index(i);
         if (oi.type() != value_type::undefined && oi.type() != value_type::null) {
-            s += to_string(h, oi).view();
+            parts.push_back(to_string(h, oi));
+        } else {
+            parts.push_back(empty);
         }
+        total += parts.back().view().length();
+    }
+    std::wstring s;
+    s.reserve(total);
+    for (uint32_t i = 0; i < l; ++i) {
+        if (i) s += sep;
+        s += parts[i].view();
     }
     return string{h, s};
 }
@@ -220,7 +568,7 @@ auto show_duration(Duration d) {
     return duration_printer{std::chrono::duration_cast<std::chrono::duration<double>>(d)};
 }
 
-value get_arg(const std::vector<value>& args, int index) {
+value get_arg(const value_span& args, int index) {
     return index < static_cast<int>(args.size()) ? args[index] : value::undefined;
 }
 
@@ -336,7 +684,7 @@ struct date_helper {
         return std::isfinite(t) && std::abs(t) <= 8.64e15 ? t : NAN;
     }
 
-    static double time_from_args(const std::vector<value>& args) {
+    static double time_from_args(const value_span& args) {
         assert(args.size() >= 3);
         double year = to_number(args[0]);
         if (double iyear = to_integer(year); !std::isnan(year) && iyear >= 0 && iyear <= 99) {
@@ -382,6 +730,234 @@ private:
     }
 };
 
+// The bytes of an ArrayBuffer live outside the GC heap in a single allocation, so they're never moved or copied
+// when garbage is collected. Views keep a raw pointer into the bytes and a reference to the buffer to keep it alive.
+class array_buffer_object : public object {
+public:
+    friend gc_type_info_registration<array_buffer_object>;
+
+    static constexpr const std::wstring_view byte_length_str{L"byteLength", 10};
+
+    std::byte* data() const { return data_.get(); }
+    uint32_t byte_length() const { return byte_length_; }
+
+private:
+    std::shared_ptr<std::byte> data_;
+    uint32_t byte_length_;
+
+    explicit array_buffer_object(gc_heap& h, const string& class_name, const object_ptr& prototype, const std::shared_ptr<std::byte>& data, uint32_t byte_length)
+        : object{h, class_name, prototype}, data_(data), byte_length_(byte_length) {
+        assert(data_ || !byte_length_);
+        set_exotic();
+    }
+
+    array_buffer_object(array_buffer_object&&) = default;
+
+    bool exotic_find(const std::wstring_view& name, property_attribute& attributes) const override {
+        if (name == byte_length_str) {
+            attributes = global_object::prototype_attributes;
+            return true;
+        }
+        return false;
+    }
+
+    value exotic_get(const std::wstring_view& name) const override {
+        assert(name == byte_length_str); (void)name;
+        return value{static_cast<double>(byte_length_)};
+    }
+};
+
+// Base class of objects viewing (part of) an ArrayBuffer
+class array_buffer_view_object : public object {
+public:
+    static constexpr const std::wstring_view buffer_str{L"buffer", 6};
+    static constexpr const std::wstring_view byte_offset_str{L"byteOffset", 10};
+
+    object_ptr buffer() const { return buffer_.track(heap()); }
+    uint32_t byte_offset() const { return byte_offset_; }
+    uint32_t byte_length() const { return byte_length_; }
+
+protected:
+    std::byte* data_;
+
+    // 'buffer' must be an array_buffer_object
+    explicit array_buffer_view_object(gc_heap& h, const string& class_name, const object_ptr& prototype, const object_ptr& buffer, uint32_t byte_offset, uint32_t byte_length)
+        : object{h, class_name, prototype}, data_(static_cast<array_buffer_object&>(*buffer).data() + byte_offset), buffer_(buffer), byte_offset_(byte_offset), byte_length_(byte_length) {
+        assert(static_cast<uint64_t>(byte_offset) + byte_length <= static_cast<array_buffer_object&>(*buffer).byte_length());
+        set_exotic();
+    }
+
+    array_buffer_view_object(array_buffer_view_object&&) = default;
+
+    void fixup() {
+        object::fixup();
+        buffer_.fixup(heap());
+    }
+
+    bool exotic_find(const std::wstring_view& name, property_attribute& attributes) const override {
+        if (name == buffer_str || name == byte_offset_str || name == array_buffer_object::byte_length_str) {
+            attributes = global_object::prototype_attributes;
+            return true;
+        }
+        return false;
+    }
+
+    value exotic_get(const std::wstring_view& name) const override {
+        if (name == buffer_str) {
+            return value{buffer()};
+        } else if (name == byte_offset_str) {
+            return value{static_cast<double>(byte_offset_)};
+        }
+        assert(name == array_buffer_object::byte_length_str);
+        return value{static_cast<double>(byte_length_)};
+    }
+
+private:
+    gc_heap_ptr_untracked<object> buffer_;
+    uint32_t byte_offset_;
+    uint32_t byte_length_;
+};
+
+// Typed array with elements of type T. Only indices below the length are elements (there are no holes) and they're
+// read and written directly in the buffer. Stores convert the value to T with ToUint32 (or ToNumber for floating point types).
+template<typename T>
+class typed_array_object : public array_buffer_view_object {
+public:
+    friend gc_type_info_registration<typed_array_object>;
+
+    static_assert(std::is_arithmetic_v<T>);
+
+    uint32_t length() const { return byte_length() / sizeof(T); }
+
+    static T from_value(const value& v) {
+        if constexpr (std::is_floating_point_v<T>) {
+            return static_cast<T>(to_number(v));
+        } else {
+            return static_cast<T>(to_uint32(v));
+        }
+    }
+
+    T element(uint32_t index) const {
+        assert(index < length());
+        T val;
+        std::memcpy(&val, data_ + index * sizeof(T), sizeof(T));
+        return val;
+    }
+
+    void element(uint32_t index, T val) {
+        assert(index < length());
+        std::memcpy(data_ + index * sizeof(T), &val, sizeof(T));
+    }
+
+    value get_index(uint32_t index) const override {
+        return index < length() ? value{static_cast<double>(element(index))} : value::undefined;
+    }
+
+    void put_index(uint32_t index, const value& val) override {
+        const T v = from_value(val);
+        if (index < length()) {
+            element(index, v);
+        }
+    }
+
+    void put(const string& name, const value& val, property_attribute attr) override {
+        if (const uint32_t index = string_to_index(name.view()); index != UINT32_MAX) {
+            put_index(index, val);
+        } else {
+            object::put(name, val, attr);
+        }
+    }
+
+private:
+    explicit typed_array_object(gc_heap& h, const string& class_name, const object_ptr& prototype, const object_ptr& buffer, uint32_t byte_offset, uint32_t length)
+        : array_buffer_view_object{h, class_name, prototype, buffer, byte_offset, length * static_cast<uint32_t>(sizeof(T))} {
+    }
+
+    typed_array_object(typed_array_object&&) = default;
+
+    uint32_t element_index(const std::wstring_view& name) const {
+        const uint32_t index = string_to_index(name);
+        return index < length() ? index : UINT32_MAX;
+    }
+
+    bool exotic_find(const std::wstring_view& name, property_attribute& attributes) const override {
+        if (element_index(name) != UINT32_MAX) {
+            attributes = property_attribute::dont_delete;
+            return true;
+        } else if (name == array_object::length_str) {
+            attributes = global_object::prototype_attributes;
+            return true;
+        }
+        return array_buffer_view_object::exotic_find(name, attributes);
+    }
+
+    value exotic_get(const std::wstring_view& name) const override {
+        if (const uint32_t index = element_index(name); index != UINT32_MAX) {
+            return get_index(index);
+        } else if (name == array_object::length_str) {
+            return value{static_cast<double>(length())};
+        }
+        return array_buffer_view_object::exotic_get(name);
+    }
+
+    void exotic_property_names(std::vector<string>& names) const override {
+        for (uint32_t i = 0, l = length(); i < l; ++i) {
+            names.push_back(string{heap(), index_string(i)});
+        }
+    }
+};
+
+// Reads and writes values of different types at arbitrary (unaligned) byte offsets of an ArrayBuffer
+class data_view_object : public array_buffer_view_object {
+public:
+    friend gc_type_info_registration<data_view_object>;
+
+    template<typename T>
+    T get(uint32_t byte_offset, bool little_endian) const {
+        std::byte bytes[sizeof(T)];
+        std::memcpy(bytes, data_ + checked_offset(byte_offset, sizeof(T)), sizeof(T));
+        if (little_endian != host_is_little_endian()) {
+            std::reverse(std::begin(bytes), std::end(bytes));
+        }
+        T val;
+        std::memcpy(&val, bytes, sizeof(T));
+        return val;
+    }
+
+    template<typename T>
+    void set(uint32_t byte_offset, T val, bool little_endian) {
+        std::byte bytes[sizeof(T)];
+        std::memcpy(bytes, &val, sizeof(T));
+        if (little_endian != host_is_little_endian()) {
+            std::reverse(std::begin(bytes), std::end(bytes));
+        }
+        std::memcpy(data_ + checked_offset(byte_offset, sizeof(T)), bytes, sizeof(T));
+    }
+
+private:
+    explicit data_view_object(gc_heap& h, const string& class_name, const object_ptr& prototype, const object_ptr& buffer, uint32_t byte_offset, uint32_t byte_length)
+        : array_buffer_view_object{h, class_name, prototype, buffer, byte_offset, byte_length} {
+    }
+
+    data_view_object(data_view_object&&) = default;
+
+    static bool host_is_little_endian() {
+        const uint16_t one = 1;
+        uint8_t first;
+        std::memcpy(&first, &one, 1);
+        return first == 1;
+    }
+
+    uint32_t checked_offset(uint32_t byte_offset, uint32_t size) const {
+        if (static_cast<uint64_t>(byte_offset) + size > byte_length()) {
+            std::wostringstream woss;
+            woss << "Offset " << byte_offset << " is outside the bounds of the DataView";
+            THROW_RUNTIME_ERROR(woss.str());
+        }
+        return byte_offset;
+    }
+};
+
 class global_object_impl : public global_object {
 public:
     friend gc_type_info_registration<global_object_impl>;
@@ -413,6 +989,10 @@ public:
         }
     }
 
+    string intern(const std::wstring_view& s) override {
+        return gc_string_table::intern(interned_strings_, s);
+    }
+
 private:
     object_ptr object_prototype_;
     object_ptr function_prototype_;
@@ -421,10 +1001,13 @@ private:
     object_ptr boolean_prototype_;
     object_ptr number_prototype_;
     object_ptr date_prototype_;
+    object_ptr array_buffer_prototype_;
+    object_ptr data_view_prototype_;
     gc_heap_ptr<global_object_impl> self_;
+    gc_heap_ptr<gc_string_table> interned_strings_ = gc_string_table::make(heap(), 256);
 
     // Well know, commonly used strings
-#define DEFINE_STRING(x) string x ## _str_{heap(), #x}
+#define DEFINE_STRING(x) string x ## _str_{intern(L"" #x)}
     DEFINE_STRING(Object);
     DEFINE_STRING(Function);
     DEFINE_STRING(Array);
@@ -432,6 +1015,9 @@ private:
     DEFINE_STRING(Boolean);
     DEFINE_STRING(Number);
     DEFINE_STRING(Date);
+    DEFINE_STRING(ArrayBuffer);
+    DEFINE_STRING(DataView);
+    DEFINE_STRING(BYTES_PER_ELEMENT);
     DEFINE_STRING(prototype);
     DEFINE_STRING(constructor);
     DEFINE_STRING(length);
@@ -466,11 +1052,11 @@ private:
         o->put(prototype_str_, value{function_prototype_}, prototype_attributes);
 
         // 15.3.4
-        function_prototype_->call_function(gc_function::make(heap(), [](const value&, const std::vector<value>&) {
+        function_prototype_->call_function(gc_function::make(heap(), [](const value&, const value_span&) {
             return value::undefined;
         }));
         function_prototype_->put(constructor_str_, value{o}, default_attributes);
-        put_native_function(function_prototype_, toString_str_, [function_prototype = function_prototype_](const value& this_, const std::vector<value>&) {
+        put_native_function(function_prototype_, toString_str_, [function_prototype = function_prototype_](const value& this_, const value_span&) {
             validate_type(this_, function_prototype, "Function");
             assert(this_.object_value()->internal_value().type() == value_type::string);
             return this_.object_value()->internal_value();
@@ -483,7 +1069,7 @@ private:
     //
 
     object_ptr make_object_object() {
-        auto o = make_function([global = self_](const value&, const std::vector<value>& args) {
+        auto o = make_function([global = self_](const value&, const value_span& args) {
             if (args.empty() || args.front().type() == value_type::undefined || args.front().type() == value_type::null) {
                 auto o = object::make(global->heap(), global->Object_str_, global->object_prototype_);
                 return value{o};
@@ -494,10 +1080,10 @@ private:
 
         // 15.2.4
         object_prototype_->put(constructor_str_, value{o}, default_attributes);
-        put_native_function(object_prototype_, toString_str_, [&h=heap()](const value& this_, const std::vector<value>&){
+        put_native_function(object_prototype_, toString_str_, [&h=heap()](const value& this_, const value_span&){
             return value{string{h, "[object "} + this_.object_value()->class_name() + string{h, "]"}};
         }, 0);
-        put_native_function(object_prototype_, valueOf_str_, [](const value& this_, const std::vector<value>&){
+        put_native_function(object_prototype_, valueOf_str_, [](const value& this_, const value_span&){
             return this_;
         }, 0);
         return o;
@@ -517,10 +1103,10 @@ private:
         boolean_prototype_ = object::make(heap(), Boolean_str_, object_prototype_);
         boolean_prototype_->internal_value(value{false});
 
-        auto c = make_function([global = self_](const value&, const std::vector<value>& args) {
+        auto c = make_function([global = self_](const value&, const value_span& args) {
             return value{global->new_boolean(!args.empty() && to_boolean(args.front()))};
         },  native_function_body(Boolean_str_), 1);
-        c->call_function(gc_function::make(heap(), [](const value&, const std::vector<value>& args) {
+        c->call_function(gc_function::make(heap(), [](const value&, const value_span& args) {
             return value{!args.empty() && to_boolean(args.front())};
         }));
         c->put(prototype_str_, value{boolean_prototype_}, prototype_attributes);
@@ -531,12 +1117,12 @@ private:
 
         boolean_prototype_->put(constructor_str_, value{c}, default_attributes);
 
-        put_native_function(boolean_prototype_, toString_str_, [check_type, &h=heap()](const value& this_, const std::vector<value>&){
+        put_native_function(boolean_prototype_, toString_str_, [check_type, &h=heap()](const value& this_, const value_span&){
             check_type(this_);
             return value{string{h, this_.object_value()->internal_value().boolean_value() ? L"true" : L"false"}};
         }, 0);
 
-        put_native_function(boolean_prototype_, valueOf_str_, [check_type](const value& this_, const std::vector<value>&){
+        put_native_function(boolean_prototype_, valueOf_str_, [check_type](const value& this_, const value_span&){
             check_type(this_);
             return this_.object_value()->internal_value();
         }, 0);
@@ -558,16 +1144,16 @@ private:
         number_prototype_ = object::make(heap(), Number_str_, object_prototype_);
         number_prototype_->internal_value(value{0.});
 
-        auto c = make_function([global = self_](const value&, const std::vector<value>& args) {
+        auto c = make_function([global = self_](const value&, const value_span& args) {
             return value{global->new_number(args.empty() ? 0.0 : to_number(args.front()))};
         }, native_function_body(Number_str_), 1);
-        c->call_function(gc_function::make(heap(), [](const value&, const std::vector<value>& args) {
+        c->call_function(gc_function::make(heap(), [](const value&, const value_span& args) {
             return value{args.empty() ? 0.0 : to_number(args.front())};
         }));
         c->put(prototype_str_, value{number_prototype_}, prototype_attributes);
         c->put(string{heap(), "MAX_VALUE"}, value{1.7976931348623157e308}, default_attributes);
         c->put(string{heap(), "MIN_VALUE"}, value{5e-324}, default_attributes);
-        c->put(string{heap(), "NaN"}, value{NAN}, default_attributes);
+        c->put(intern(L"NaN"), value{NAN}, default_attributes);
         c->put(string{heap(), "NEGATIVE_INFINITY"}, value{-INFINITY}, default_attributes);
         c->put(string{heap(), "POSITIVE_INFINITY"}, value{INFINITY}, default_attributes);
 
@@ -576,7 +1162,7 @@ private:
         };
 
         number_prototype_->put(constructor_str_, value{c}, default_attributes);
-        put_native_function(number_prototype_, toString_str_, [check_type](const value& this_, const std::vector<value>& args){
+        put_native_function(number_prototype_, toString_str_, [check_type](const value& this_, const value_span& args){
             check_type(this_);
             const int radix = args.empty() ? 10 : to_int32(args.front());
             if (radix < 2 || radix > 36) {
@@ -590,7 +1176,7 @@ private:
             auto o = this_.object_value();
             return value{to_string(o.heap(), o->internal_value())};
         }, 1);
-        put_native_function(number_prototype_, valueOf_str_,[check_type](const value& this_, const std::vector<value>&){
+        put_native_function(number_prototype_, valueOf_str_,[check_type](const value& this_, const value_span&){
             check_type(this_);
             return this_.object_value()->internal_value();
         }, 0);
@@ -614,15 +1200,15 @@ private:
         string_prototype_ = object::make(heap(), String_str_, object_prototype_);
         string_prototype_->internal_value(value{string{heap(), ""}});
 
-        auto c = make_function([global = self_](const value&, const std::vector<value>& args) {
+        auto c = make_function([global = self_](const value&, const value_span& args) {
             auto& h = global->heap();
             return value{global->new_string(args.empty() ? string{h, ""} : to_string(h, args.front()))};
         }, native_function_body(String_str_), 1);
-        c->call_function(gc_function::make(heap(), [&h = heap()](const value&, const std::vector<value>& args) {
+        c->call_function(gc_function::make(heap(), [&h = heap()](const value&, const value_span& args) {
             return value{args.empty() ? string{h, ""} : to_string(h, args.front())};
         }));
         c->put(prototype_str_, value{string_prototype_}, prototype_attributes);
-        put_native_function(c, string{heap(), "fromCharCode"}, [&h = heap()](const value&, const std::vector<value>& args){
+        put_native_function(c, string{heap(), "fromCharCode"}, [&h = heap()](const value&, const value_span& args){
             std::wstring s;
             for (const auto& a: args) {
                 s.push_back(to_uint16(a));
@@ -635,11 +1221,11 @@ private:
         };
 
         string_prototype_->put(constructor_str_, value{c}, default_attributes);
-        put_native_function(string_prototype_, toString_str_, [check_type](const value& this_, const std::vector<value>&){
+        put_native_function(string_prototype_, toString_str_, [check_type](const value& this_, const value_span&){
             check_type(this_);
             return this_.object_value()->internal_value();
         }, 0);
-        put_native_function(string_prototype_, valueOf_str_, [check_type](const value& this_, const std::vector<value>&){
+        put_native_function(string_prototype_, valueOf_str_, [check_type](const value& this_, const value_span&){
             check_type(this_);
             return this_.object_value()->internal_value();
         }, 0);
@@ -647,12 +1233,17 @@ private:
 
         auto make_string_function = [&](const char* name, int num_args, auto f) {
             auto& h = heap();
-            put_native_function(string_prototype_, string{heap(), name}, [&h, f](const value& this_, const std::vector<value>& args){
-                return value{f(to_string(h, this_).view(), args)};
+            put_native_function(string_prototype_, string{heap(), name}, [&h, f](const value& this_, const value_span& args){
+                // Functions that return parts of the string get the string itself, so the result can share its storage
+                if constexpr (std::is_invocable_v<decltype(f), const string&, const value_span&>) {
+                    return value{f(to_string(h, this_), args)};
+                } else {
+                    return value{f(to_string(h, this_).view(), args)};
+                }
             }, num_args);
         };
 
-        make_string_function("charAt", 1, [&h = heap()](const std::wstring_view& s, const std::vector<value>& args){
+        make_string_function("charAt", 1, [&h = heap()](const std::wstring_view& s, const value_span& args){
             const int position = to_int32(get_arg(args, 0));
             if (position < 0 || position >= static_cast<int>(s.length())) {
                 return string{h, ""};
@@ -660,7 +1251,7 @@ private:
             return string{h, s.substr(position, 1)};
         });
 
-        make_string_function("charCodeAt", 1, [](const std::wstring_view& s, const std::vector<value>& args){
+        make_string_function("charCodeAt", 1, [](const std::wstring_view& s, const value_span& args){
             const int position = to_int32(get_arg(args, 0));
             if (position < 0 || position >= static_cast<int>(s.length())) {
                 return static_cast<double>(NAN);
@@ -668,64 +1259,66 @@ private:
             return static_cast<double>(s[position]);
         });
 
-        make_string_function("indexOf", 2, [&h=heap()](const std::wstring_view& s, const std::vector<value>& args){
+        make_string_function("indexOf", 2, [&h=heap()](const std::wstring_view& s, const value_span& args){
             const auto& search_string = to_string(h, get_arg(args, 0));
             const int position = to_int32(get_arg(args, 1));
-            auto index = s.find(search_string.view(), position);
+            auto index = string_find(s, search_string.view(), position);
             return index == std::wstring_view::npos ? -1. : static_cast<double>(index);
         });
 
-        make_string_function("lastIndexOf", 2, [&h=heap()](const std::wstring_view& s, const std::vector<value>& args){
+        make_string_function("lastIndexOf", 2, [&h=heap()](const std::wstring_view& s, const value_span& args){
             const auto& search_string = to_string(h, get_arg(args, 0));
             double position = to_number(get_arg(args, 1));
             const int ipos = std::isnan(position) ? INT_MAX : to_int32(position);
-            auto index = s.rfind(search_string.view(), ipos);
+            auto index = string_rfind(s, search_string.view(), ipos);
             return index == std::wstring_view::npos ? -1. : static_cast<double>(index);
         });
 
-        make_string_function("split", 1, [global = self_](const std::wstring_view& s, const std::vector<value>& args){
+        make_string_function("split", 1, [global = self_](const string& str, const value_span& args){
             auto& h = global->heap();
+            const auto s = str.view();
             auto a = global->array_constructor(value::null, {}).object_value();
             if (args.empty()) {
-                a->put(string{h, index_string(0)}, value{string{h, s}});
+                a->put_index(0, value{str});
             } else {
                 const auto sep = to_string(h, args.front());
                 if (sep.view().empty()) {
                     for (uint32_t i = 0; i < s.length(); ++i) {
-                        a->put(string{h, index_string(i)}, value{string{ h, s.substr(i,1) }});
+                        a->put_index(i, value{str.substr(i, 1)});
                     }
                 } else {
                     size_t pos = 0;
                     uint32_t i = 0;
                     for (; pos < s.length(); ++i) {
-                        const auto next_pos = s.find(sep.view(), pos);
+                        const auto next_pos = string_find(s, sep.view(), pos);
                         if (next_pos == std::wstring_view::npos) {
                             break;
                         }
-                        a->put(string{h, index_string(i)}, value{string{ h, s.substr(pos, next_pos-pos) }});
+                        a->put_index(i, value{str.substr(static_cast<uint32_t>(pos), static_cast<uint32_t>(next_pos-pos))});
                         pos = next_pos + 1;
                     }
                     if (pos < s.length()) {
-                        a->put(string{h, index_string(i)}, value{string{ h, s.substr(pos) }});
+                        a->put_index(i, value{str.substr(static_cast<uint32_t>(pos))});
                     }
                 }
             }
             return a;
         });
 
-        make_string_function("substring", 1, [&h = heap()](const std::wstring_view& s, const std::vector<value>& args){
+        make_string_function("substring", 1, [](const string& str, const value_span& args){
+            const auto s = str.view();
             int start = std::min(std::max(to_int32(get_arg(args, 0)), 0), static_cast<int>(s.length()));
             if (args.size() < 2) {
-                return string{h, s.substr(start)};
+                return str.substr(start);
             }
             int end = std::min(std::max(to_int32(get_arg(args, 1)), 0), static_cast<int>(s.length()));
             if (start > end) {
                 std::swap(start, end);
             }
-            return string{h, s.substr(start, end-start)};
+            return str.substr(start, end-start);
         });
 
-        make_string_function("toLowerCase", 0, [&h = heap()](const std::wstring_view& s, const std::vector<value>&){
+        make_string_function("toLowerCase", 0, [&h = heap()](const std::wstring_view& s, const value_span&){
             std::wstring res;
             for (auto c: s) {
                 res.push_back(towlower(c));
@@ -733,7 +1326,7 @@ private:
             return string{h, res};
         });
 
-        make_string_function("toUpperCase", 0, [&h = heap()](const std::wstring_view& s, const std::vector<value>&){
+        make_string_function("toUpperCase", 0, [&h = heap()](const std::wstring_view& s, const value_span&){
             std::wstring res;
             for (auto c: s) {
                 res.push_back(towupper(c));
@@ -748,11 +1341,11 @@ private:
     // Array
     //
 
-    value array_constructor(const value&, const std::vector<value>& args) {
+    value array_constructor(const value&, const value_span& args) {
         if (args.size() == 1 && args[0].type() == value_type::number) {
             return value{array_object::make(heap(), Array_str_, array_prototype_, to_uint32(args[0].number_value()))};
         }
-        auto arr = array_object::make(heap(), Array_str_, array_prototype_, static_cast<uint32_t>(args.size()));
+        auto arr = array_object::make(heap(), Array_str_, array_prototype_, 0);
         for (uint32_t i = 0; i < args.size(); ++i) {
             arr->unchecked_put(i, args[i]);
         }
@@ -762,17 +1355,17 @@ private:
     object_ptr make_array_object() {
         array_prototype_ = array_object::make(heap(), Array_str_, object_prototype_, 0);
 
-        auto o = make_function([global = self_](const value& this_, const std::vector<value>& args) {
+        auto o = make_function([global = self_](const value& this_, const value_span& args) {
             return global->array_constructor(this_, args);
         }, native_function_body(Array_str_), 1);
         o->put(prototype_str_, value{array_prototype_}, prototype_attributes);
 
         array_prototype_->put(constructor_str_, value{o}, default_attributes);
-        put_native_function(array_prototype_, toString_str_, [](const value& this_, const std::vector<value>&) {
+        put_native_function(array_prototype_, toString_str_, [](const value& this_, const value_span&) {
             assert(this_.type() == value_type::object);
             return value{join(this_.object_value(), L",")};
         }, 0);
-        put_native_function(array_prototype_, "join", [&h=heap()](const value& this_, const std::vector<value>& args) {
+        put_native_function(array_prototype_, "join", [&h=heap()](const value& this_, const value_span& args) {
             assert(this_.type() == value_type::object);
             string sep{h, L","};
             if (!args.empty()) {
@@ -780,21 +1373,24 @@ private:
             }
             return value{join(this_.object_value(), sep.view())};
         }, 1);
-        put_native_function(array_prototype_, "reverse", [&h = heap()](const value& this_, const std::vector<value>&) {
+        put_native_function(array_prototype_, "reverse", [](const value& this_, const value_span&) {
             assert(this_.type() == value_type::object);
             const auto& o = this_.object_value();
+            if (auto a = dynamic_cast<array_object*>(o.get()); a && a->packed_reverse()) {
+                return this_;
+            }
             const uint32_t length = to_uint32(o->get(array_object::length_str));
             for (uint32_t k = 0; k != length / 2; ++k) {
-                const auto i1 = index_string(k);
-                const auto i2 = index_string(length - k - 1);
-                auto v1 = o->get(i1);
-                auto v2 = o->get(i2);
-                o->put(string{h, i1}, v2);
-                o->put(string{h, i2}, v1);
+                const uint32_t i1 = k;
+                const uint32_t i2 = length - k - 1;
+                auto v1 = o->get_index(i1);
+                auto v2 = o->get_index(i2);
+                o->put_index(i1, v2);
+                o->put_index(i2, v1);
             }
             return this_;
         }, 0);
-        put_native_function(array_prototype_, "sort", [&h=heap()](const value& this_, const std::vector<value>& args) {
+        put_native_function(array_prototype_, "sort", [&h=heap()](const value& this_, const value_span& args) {
             assert(this_.type() == value_type::object);
             const auto& o = this_.object_value();
             const uint32_t length = to_uint32(o->get(array_object::length_str));
@@ -807,6 +1403,8 @@ private:
                 if (!comparefn) {
                     NOT_IMPLEMENTED("Invalid compare function given to sort");
                 }
+            } else if (auto a = dynamic_cast<array_object*>(o.get()); a && a->packed_sort()) {
+                return this_;
             }
 
             auto sort_compare = [comparefn, &h](const value& x, const value& y) {
@@ -818,28 +1416,28 @@ private:
                     return -1;
                 }
                 if (comparefn) {
-                    const auto r = to_number(comparefn->call(value::null, {x,y}));
+                    const value args[2] = {x, y};
+                    const auto r = to_number(comparefn->call(value::null, value_span{args, 2}));
                     if (r < 0) return -1;
                     if (r > 0) return 1;
                     return 0;
                 } else {
                     const auto xs = to_string(h, x);
                     const auto ys = to_string(h, y);
-                    if (xs.view() < ys.view()) return -1;
-                    if (xs.view() > ys.view()) return 1;
-                    return 0;
+                    const int c = string_compare(xs.view(), ys.view());
+                    return c < 0 ? -1 : c > 0 ? 1 : 0;
                 }
             };
 
             std::vector<value> values(length);
             for (uint32_t i = 0; i < length; ++i) {
-                values[i] = o->get(index_string(i));
+                values[i] = o->get_index(i);
             }
             std::stable_sort(values.begin(), values.end(), [&](const value& x, const value& y) {
                 return sort_compare(x, y) < 0;
             });
             for (uint32_t i = 0; i < length; ++i) {
-                o->put(string{h, index_string(i)}, values[i]);
+                o->put_index(i, values[i]);
             }
             return this_;
         }, 1);
@@ -855,7 +1453,7 @@ private:
         using timer_clock = std::chrono::steady_clock;
 
         auto timers = std::make_shared<std::unordered_map<std::wstring, timer_clock::time_point>>();
-        put_native_function(console, "log", [](const value&, const std::vector<value>& args) {
+        put_native_function(console, "log", [](const value&, const value_span& args) {
             for (const auto& a: args) {
                 if (a.type() == value_type::string) {
                     std::wcout << a.string_value();
@@ -867,7 +1465,7 @@ private:
             std::wcout << '\n';
             return value::undefined;
         }, 1);
-        put_native_function(console, "time", [timers, &h=heap()](const value&, const std::vector<value>& args) {
+        put_native_function(console, "time", [timers, &h=heap()](const value&, const value_span& args) {
             if (args.empty()) {
                 THROW_RUNTIME_ERROR("Missing argument to console.time()");
             }
@@ -875,7 +1473,7 @@ private:
             (*timers)[std::wstring{label.view()}] = timer_clock::now();
             return value::undefined;
         }, 1);
-        put_native_function(console, "timeEnd", [timers, &h=heap()](const value&, const std::vector<value>& args) {
+        put_native_function(console, "timeEnd", [timers, &h=heap()](const value&, const value_span& args) {
             const auto end_time = timer_clock::now();
             if (args.empty()) {
                 THROW_RUNTIME_ERROR("Missing argument to console.timeEnd()");
@@ -895,6 +1493,32 @@ private:
         return console;
     }
 
+    //
+    // mjs (host functions)
+    //
+    auto make_mjs_object() {
+        auto mjs = object::make(heap(), Object_str_, object_prototype_);
+
+        // Returns an ArrayBuffer backed by a (copy-on-write) mapping of the file, which is unmapped when the buffer is collected
+        put_native_function(mjs, "mapFile", [global = self_](const value&, const value_span& args) {
+            const auto path = to_string(global->heap(), get_arg(args, 0));
+            std::string narrow_path;
+            for (const auto c: path.view()) {
+                if (static_cast<uint32_t>(c) >= 0x80) {
+                    THROW_RUNTIME_ERROR("Only ASCII paths are supported by mjs.mapFile");
+                }
+                narrow_path.push_back(static_cast<char>(c));
+            }
+            const auto f = map_file(narrow_path);
+            if (f.size > UINT32_MAX) {
+                throw_range_error("ArrayBuffer length", static_cast<double>(f.size));
+            }
+            return value{global->new_array_buffer(f.data, static_cast<uint32_t>(f.size))};
+        }, 1);
+
+        return mjs;
+    }
+
     //
     // Math
     //
@@ -912,12 +1536,12 @@ private:
 
 
         auto make_math_function1 = [&](const char* name, auto f) {
-            put_native_function(math, name, [f](const value&, const std::vector<value>& args){
+            put_native_function(math, name, [f](const value&, const value_span& args){
                 return value{f(to_number(get_arg(args, 0)))};
             }, 1);
         };
         auto make_math_function2 = [&](const char* name, auto f) {
-            put_native_function(math, name, [f](const value&, const std::vector<value>& args){
+            put_native_function(math, name, [f](const value&, const value_span& args){
                 return value{f(to_number(get_arg(args, 0)), to_number(get_arg(args, 1)))};
             }, 2);
         };
@@ -952,7 +1576,7 @@ private:
             return std::floor(x+0.5);
         });
 
-        put_native_function(math, "random", [](const value&, const std::vector<value>&){
+        put_native_function(math, "random", [](const value&, const value_span&){
             return value{static_cast<double>(rand()) / (1.+RAND_MAX)};
         }, 0);
 
@@ -973,7 +1597,7 @@ private:
         date_prototype_ = object::make(heap(), Date_str_, object_prototype_);
         date_prototype_->internal_value(value{NAN});
 
-        auto c = make_function([global = self_](const value&, const std::vector<value>& args) {
+        auto c = make_function([global = self_](const value&, const value_span& args) {
             if (args.empty()) {
                 return value{global->new_date(date_helper::current_time_utc())};
             } else if (args.size() == 1) {
@@ -988,16 +1612,16 @@ private:
             }
             return value{date_helper::time_clip(date_helper::utc(date_helper::time_from_args(args)))};
         }, native_function_body(Date_str_), 7);
-        c->call_function(gc_function::make(heap(), [global = self_](const value&, const std::vector<value>&) {
+        c->call_function(gc_function::make(heap(), [global = self_](const value&, const value_span&) {
             // Equivalent to (new Date()).toString()
             return value{to_string(global->heap(), value{global->new_date(date_helper::current_time_utc())})};
         }));
         c->put(prototype_str_, value{date_prototype_}, prototype_attributes);
-        put_native_function(c, "parse", [&h=heap()](const value&, const std::vector<value>& args) {
+        put_native_function(c, "parse", [&h=heap()](const value&, const value_span& args) {
             if (1) NOT_IMPLEMENTED(to_string(h, get_arg(args, 0)));
             return value::undefined;
         }, 1);
-        put_native_function(c, "UTC", [](const value&, const std::vector<value>& args) {
+        put_native_function(c, "UTC", [](const value&, const value_span& args) {
             if (args.size() < 3) {
                 NOT_IMPLEMENTED("Date.UTC() with less than 3 arguments");
             }
@@ -1012,7 +1636,7 @@ private:
         };
 
         auto make_date_getter = [&](const char* name, auto f) {
-            put_native_function(date_prototype_, name ,[f, check_type](const value& this_, const std::vector<value>&) {
+            put_native_function(date_prototype_, name ,[f, check_type](const value& this_, const value_span&) {
                 check_type(this_);
                 const double t = this_.object_value()->internal_value().number_value();
                 if (std::isnan(t)) {
@@ -1079,7 +1703,7 @@ private:
         });
 
         auto make_date_mutator = [&](const char* name, auto f) {
-            put_native_function(date_prototype_, name, [f, check_type](const value& this_, const std::vector<value>& args) {
+            put_native_function(date_prototype_, name, [f, check_type](const value& this_, const value_span& args) {
                 check_type(this_);
                 auto& obj = *this_.object_value();
                 f(obj, args);
@@ -1088,7 +1712,7 @@ private:
         };
 
         // setTime(time)
-        make_date_mutator("setTime", [](object& d, const std::vector<value>& args) {
+        make_date_mutator("setTime", [](object& d, const value_span& args) {
             d.internal_value(value{to_number(get_arg(args, 0))});
         });
 
@@ -1096,7 +1720,7 @@ private:
         // setUTCMilliseconds(ms)
         // ...
 
-        put_native_function(date_prototype_, "toString", [check_type](const value& this_, const std::vector<value>&) {
+        put_native_function(date_prototype_, "toString", [check_type](const value& this_, const value_span&) {
             check_type(this_);
             auto o = this_.object_value();
             return value{date_helper::to_string(o.heap(), o->internal_value().number_value())};
@@ -1108,6 +1732,217 @@ private:
         return c;
     }
 
+    //
+    // ArrayBuffer, DataView and typed arrays
+    //
+
+    // Throws unless 'v' is an object of type T (a class derived from object)
+    template<typename T>
+    static T& check_host_object(const value& v, const char* expected_type) {
+        if (v.type() == value_type::object) {
+            if (auto p = dynamic_cast<T*>(v.object_value().get())) {
+                return *p;
+            }
+        }
+        std::wostringstream woss;
+        mjs::debug_print(woss, v, 2, 1);
+        woss << " is not a " << expected_type;
+        THROW_RUNTIME_ERROR(woss.str());
+    }
+
+    static bool is_array_buffer(const value& v) {
+        return v.type() == value_type::object && dynamic_cast<const array_buffer_object*>(v.object_value().get());
+    }
+
+    // Converts a (possibly negative, i.e. relative to the end) start or end argument to an index in [0; length]
+    static uint32_t relative_index(const value& v, uint32_t length, uint32_t default_index) {
+        if (v.type() == value_type::undefined) {
+            return default_index;
+        }
+        const double rel = to_integer(v);
+        return static_cast<uint32_t>(rel < 0 ? std::max(length + rel, 0.) : std::min(rel, static_cast<double>(length)));
+    }
+
+    [[noreturn]] static void throw_range_error(const char* what, double val) {
+        std::wostringstream woss;
+        woss << "Invalid " << what << ": " << val;
+        THROW_RUNTIME_ERROR(woss.str());
+    }
+
+    object_ptr new_array_buffer(const std::shared_ptr<std::byte>& data, uint32_t byte_length) {
+        return heap().make<array_buffer_object>(heap(), ArrayBuffer_str_, array_buffer_prototype_, data, byte_length);
+    }
+
+    object_ptr new_array_buffer(double byte_length) {
+        if (!(byte_length >= 0 && byte_length <= UINT32_MAX)) {
+            throw_range_error("ArrayBuffer length", byte_length);
+        }
+        const auto n = static_cast<uint32_t>(byte_length);
+        return new_array_buffer(std::shared_ptr<std::byte>{n ? new std::byte[n]() : nullptr, std::default_delete<std::byte[]>()}, n);
+    }
+
+    object_ptr make_array_buffer_object() {
+        array_buffer_prototype_ = object::make(heap(), ArrayBuffer_str_, object_prototype_);
+
+        auto c = make_function([global = self_](const value&, const value_span& args) {
+            return value{global->new_array_buffer(to_integer(get_arg(args, 0)))};
+        }, native_function_body(ArrayBuffer_str_), 1);
+        c->put(prototype_str_, value{array_buffer_prototype_}, prototype_attributes);
+        array_buffer_prototype_->put(constructor_str_, value{c}, default_attributes);
+
+        put_native_function(array_buffer_prototype_, "slice", [global = self_](const value& this_, const value_span& args) {
+            const uint32_t length = check_host_object<array_buffer_object>(this_, "ArrayBuffer").byte_length();
+            const uint32_t begin = relative_index(get_arg(args, 0), length, 0);
+            const uint32_t end = relative_index(get_arg(args, 1), length, length);
+            auto res = global->new_array_buffer(end > begin ? end - begin : 0);
+            // Converting the arguments could have run script code, so only get the data pointers now
+            std::memcpy(static_cast<array_buffer_object&>(*res).data(), check_host_object<array_buffer_object>(this_, "ArrayBuffer").data() + begin, end > begin ? end - begin : 0);
+            return value{res};
+        }, 2);
+
+        return c;
+    }
+
+    template<typename T>
+    object_ptr make_typed_array_object(const wchar_t* name) {
+        const auto class_name = intern(name);
+        const auto prototype = object::make(heap(), class_name, object_prototype_);
+        const auto type_name = std::make_shared<std::string>(name, name + std::wcslen(name));
+
+        auto new_typed_array = [global = self_, class_name, prototype](const object_ptr& buffer, uint32_t byte_offset, uint32_t length) {
+            auto& h = global->heap();
+            return h.make<typed_array_object<T>>(h, class_name, prototype, buffer, byte_offset, length);
+        };
+
+        auto c = make_function([global = self_, new_typed_array](const value&, const value_span& args) {
+            const auto& arg = get_arg(args, 0);
+            if (is_array_buffer(arg)) {
+                // View of an existing buffer
+                const double byte_offset = to_integer(get_arg(args, 1));
+                const double length_arg = get_arg(args, 2).type() == value_type::undefined ? NAN : to_integer(get_arg(args, 2));
+                const uint32_t byte_length = check_host_object<array_buffer_object>(arg, "ArrayBuffer").byte_length();
+                if (byte_offset < 0 || byte_offset > byte_length || std::fmod(byte_offset, sizeof(T)) != 0) {
+                    throw_range_error("typed array offset", byte_offset);
+                }
+                double length = length_arg;
+                if (std::isnan(length)) {
+                    if (std::fmod(byte_length - byte_offset, sizeof(T)) != 0) {
+                        throw_range_error("buffer length for typed array", byte_length);
+                    }
+                    length = (byte_length - byte_offset) / sizeof(T);
+                } else if (length < 0 || byte_offset + length * sizeof(T) > byte_length) {
+                    throw_range_error("typed array length", length);
+                }
+                return value{new_typed_array(arg.object_value(), static_cast<uint32_t>(byte_offset), static_cast<uint32_t>(length))};
+            } else if (arg.type() == value_type::object) {
+                // Copy of an array like object
+                const auto& src = arg.object_value();
+                const uint32_t length = to_uint32(src->get(array_object::length_str));
+                auto a = new_typed_array(global->new_array_buffer(static_cast<double>(length) * sizeof(T)), 0, length);
+                for (uint32_t i = 0; i < length; ++i) {
+                    a->put_index(i, src->get_index(i));
+                }
+                return value{a};
+            }
+            const double length = to_integer(arg);
+            return value{new_typed_array(global->new_array_buffer(length * sizeof(T)), 0, static_cast<uint32_t>(length))};
+        }, native_function_body(class_name), 3);
+        c->put(prototype_str_, value{prototype}, prototype_attributes);
+        c->put(BYTES_PER_ELEMENT_str_, value{static_cast<double>(sizeof(T))}, prototype_attributes);
+        prototype->put(constructor_str_, value{c}, default_attributes);
+        prototype->put(BYTES_PER_ELEMENT_str_, value{static_cast<double>(sizeof(T))}, prototype_attributes);
+
+        put_native_function(prototype, "subarray", [type_name, new_typed_array](const value& this_, const value_span& args) {
+            const uint32_t length = check_host_object<typed_array_object<T>>(this_, type_name->c_str()).length();
+            const uint32_t begin = relative_index(get_arg(args, 0), length, 0);
+            const uint32_t end = relative_index(get_arg(args, 1), length, length);
+            const auto& a = check_host_object<typed_array_object<T>>(this_, type_name->c_str());
+            return value{new_typed_array(a.buffer(), a.byte_offset() + begin * static_cast<uint32_t>(sizeof(T)), end > begin ? end - begin : 0)};
+        }, 2);
+        put_native_function(prototype, "set", [type_name](const value& this_, const value_span& args) {
+            const uint32_t length = check_host_object<typed_array_object<T>>(this_, type_name->c_str()).length();
+            const auto& arg = get_arg(args, 0);
+            if (arg.type() != value_type::object) {
+                THROW_RUNTIME_ERROR("Invalid source array");
+            }
+            const double offset = to_integer(get_arg(args, 1));
+            const auto& src = arg.object_value();
+            const uint32_t src_length = to_uint32(src->get(array_object::length_str));
+            if (offset < 0 || offset + src_length > length) {
+                throw_range_error("offset", offset);
+            }
+            // Read all values first in case the source shares the buffer
+            std::vector<value> values(src_length);
+            for (uint32_t i = 0; i < src_length; ++i) {
+                values[i] = src->get_index(i);
+            }
+            const auto& o = this_.object_value();
+            for (uint32_t i = 0; i < src_length; ++i) {
+                o->put_index(static_cast<uint32_t>(offset) + i, values[i]);
+            }
+            return value::undefined;
+        }, 2);
+        put_native_function(prototype, "join", [&h=heap()](const value& this_, const value_span& args) {
+            return value{join(this_.object_value(), args.empty() ? std::wstring_view{L","} : to_string(h, args.front()).view())};
+        }, 1);
+        put_native_function(prototype, toString_str_, [](const value& this_, const value_span&) {
+            return value{join(this_.object_value(), L",")};
+        }, 0);
+
+        return c;
+    }
+
+    object_ptr make_data_view_object() {
+        data_view_prototype_ = object::make(heap(), DataView_str_, object_prototype_);
+
+        auto c = make_function([global = self_](const value&, const value_span& args) {
+            const auto& arg = get_arg(args, 0);
+            if (!is_array_buffer(arg)) {
+                THROW_RUNTIME_ERROR("DataView requires an ArrayBuffer");
+            }
+            const double byte_offset = to_integer(get_arg(args, 1));
+            const double length_arg = get_arg(args, 2).type() == value_type::undefined ? NAN : to_integer(get_arg(args, 2));
+            const uint32_t buffer_length = check_host_object<array_buffer_object>(arg, "ArrayBuffer").byte_length();
+            if (byte_offset < 0 || byte_offset > buffer_length) {
+                throw_range_error("DataView offset", byte_offset);
+            }
+            const double byte_length = std::isnan(length_arg) ? buffer_length - byte_offset : length_arg;
+            if (byte_length < 0 || byte_offset + byte_length > buffer_length) {
+                throw_range_error("DataView length", byte_length);
+            }
+            auto& h = global->heap();
+            return value{h.make<data_view_object>(h, global->DataView_str_, global->data_view_prototype_, arg.object_value(), static_cast<uint32_t>(byte_offset), static_cast<uint32_t>(byte_length))};
+        }, native_function_body(DataView_str_), 3);
+        c->put(prototype_str_, value{data_view_prototype_}, prototype_attributes);
+        data_view_prototype_->put(constructor_str_, value{c}, default_attributes);
+
+        auto make_accessors = [&](const wchar_t* type, auto tag) {
+            using T = decltype(tag);
+            put_native_function(data_view_prototype_, intern(std::wstring{L"get"} + type), [](const value& this_, const value_span& args) {
+                const uint32_t byte_offset = to_uint32(get_arg(args, 0));
+                const bool little_endian = to_boolean(get_arg(args, 1));
+                return value{static_cast<double>(check_host_object<data_view_object>(this_, "DataView").get<T>(byte_offset, little_endian))};
+            }, 1);
+            put_native_function(data_view_prototype_, intern(std::wstring{L"set"} + type), [](const value& this_, const value_span& args) {
+                const uint32_t byte_offset = to_uint32(get_arg(args, 0));
+                const T val = typed_array_object<T>::from_value(get_arg(args, 1));
+                const bool little_endian = to_boolean(get_arg(args, 2));
+                check_host_object<data_view_object>(this_, "DataView").set<T>(byte_offset, val, little_endian);
+                return value::undefined;
+            }, 2);
+        };
+        make_accessors(L"Int8", int8_t{});
+        make_accessors(L"Uint8", uint8_t{});
+        make_accessors(L"Int16", int16_t{});
+        make_accessors(L"Uint16", uint16_t{});
+        make_accessors(L"Int32", int32_t{});
+        make_accessors(L"Uint32", uint32_t{});
+        make_accessors(L"Float32", float{});
+        make_accessors(L"Float64", double{});
+
+        return c;
+    }
+
     //
     // Global
     //
@@ -1122,36 +1957,46 @@ private:
         put(String_str_, value{make_string_object()}, default_attributes);
         put(Boolean_str_, value{make_boolean_object()}, default_attributes);
         put(Number_str_, value{make_number_object()}, default_attributes);
-        put(string{heap(), "Math"}, value{make_math_object()}, default_attributes);
+        put(intern(L"Math"), value{make_math_object()}, default_attributes);
         put(Date_str_, value{make_date_object()}, default_attributes);
-
-        put(string{heap(), "NaN"}, value{NAN}, default_attributes);
-        put(string{heap(), "Infinity"}, value{INFINITY}, default_attributes);
+        put(ArrayBuffer_str_, value{make_array_buffer_object()}, default_attributes);
+        put(DataView_str_, value{make_data_view_object()}, default_attributes);
+        put(intern(L"Int8Array"), value{make_typed_array_object<int8_t>(L"Int8Array")}, default_attributes);
+        put(intern(L"Uint8Array"), value{make_typed_array_object<uint8_t>(L"Uint8Array")}, default_attributes);
+        put(intern(L"Int16Array"), value{make_typed_array_object<int16_t>(L"Int16Array")}, default_attributes);
+        put(intern(L"Uint16Array"), value{make_typed_array_object<uint16_t>(L"Uint16Array")}, default_attributes);
+        put(intern(L"Int32Array"), value{make_typed_array_object<int32_t>(L"Int32Array")}, default_attributes);
+        put(intern(L"Uint32Array"), value{make_typed_array_object<uint32_t>(L"Uint32Array")}, default_attributes);
+        put(intern(L"Float32Array"), value{make_typed_array_object<float>(L"Float32Array")}, default_attributes);
+        put(intern(L"Float64Array"), value{make_typed_array_object<double>(L"Float64Array")}, default_attributes);
+
+        put(intern(L"NaN"), value{NAN}, default_attributes);
+        put(intern(L"Infinity"), value{INFINITY}, default_attributes);
         // Note: eval is added by the interpreter
-        put_native_function(*this, "parseInt", [&h=heap()](const value&, const std::vector<value>& args) {
+        put_native_function(*this, "parseInt", [&h=heap()](const value&, const value_span& args) {
             const auto input = to_string(h, get_arg(args, 0));
             int radix = to_int32(get_arg(args, 1));
             return value{parse_int(input.view(), radix)};
         }, 2);
-        put_native_function(*this, "parseFloat", [&h=heap()](const value&, const std::vector<value>& args) {
+        put_native_function(*this, "parseFloat", [&h=heap()](const value&, const value_span& args) {
             const auto input = to_string(h, get_arg(args, 0));
             return value{parse_float(input.view())};
         }, 1);
-        put_native_function(*this, "escape", [&h=heap()](const value&, const std::vector<value>& args) {
+        put_native_function(*this, "escape", [&h=heap()](const value&, const value_span& args) {
             const auto input = to_string(h, get_arg(args, 0));
             return value{string{h, escape(input.view())}};
         }, 1);
-        put_native_function(*this, "unescape", [&h=heap()](const value&, const std::vector<value>& args) {
+        put_native_function(*this, "unescape", [&h=heap()](const value&, const value_span& args) {
             const auto input = to_string(h, get_arg(args, 0));
             return value{string{h, unescape(input.view())}};
         }, 1);
-        put_native_function(*this, "isNaN", [](const value&, const std::vector<value>& args) {
+        put_native_function(*this, "isNaN", [](const value&, const value_span& args) {
             return value(std::isnan(to_number(args.empty() ? value::undefined : args.front())));
         }, 1);
-        put_native_function(*this, "isFinite", [](const value&, const std::vector<value>& args) {
+        put_native_function(*this, "isFinite", [](const value&, const value_span& args) {
             return value(std::isfinite(to_number(args.empty() ? value::undefined : args.front())));
         }, 1);
-        put_native_function(*this, "alert", [&h=heap()](const value&, const std::vector<value>& args) {
+        put_native_function(*this, "alert", [&h=heap()](const value&, const value_span& args) {
             std::wcout << "ALERT";
             for (auto& a: args) {
                 std::wcout << "\t" << to_string(h, a);
@@ -1160,7 +2005,8 @@ private:
             return value::undefined;
         }, 1);
 
-        put(string{heap(), "console"}, value{make_console_object()}, default_attributes);
+        put(intern(L"console"), value{make_console_object()}, default_attributes);
+        put(intern(L"mjs"), value{make_mjs_object()}, default_attributes);
     }
 
     explicit global_object_impl(gc_heap& h) : global_object(h, string{h, "Global"}, object_ptr{}) {
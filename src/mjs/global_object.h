@@ -15,6 +15,9 @@ public:
     virtual object_ptr make_raw_function() = 0;
     virtual object_ptr to_object(const value& v) = 0;
 
+    // Returns the interned (unique within the heap) string equal to 's'
+    virtual string intern(const std::wstring_view& s) = 0;
+
     static string native_function_body(const string& name);
 
     static constexpr auto prototype_attributes = property_attribute::dont_enum | property_attribute::dont_delete | property_attribute::read_only;
@@ -29,7 +32,7 @@ public:
 
     template<typename F>
     void put_native_function(object& obj, const char* name, const F& f, int named_args) {
-        put_native_function(obj, string{obj.heap(), name}, f, named_args);
+        put_native_function(obj, intern(std::wstring(name, name + std::strlen(name))), f, named_args);
     }
 
     template<typename F, typename String>
@@ -53,8 +56,6 @@ protected:
     }
 };
 
-extern std::wstring index_string(uint32_t index);
-
 } // namespace mjs
 
 #endif
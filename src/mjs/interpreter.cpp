@@ -1,9 +1,13 @@
 #include "interpreter.h"
 #include "parser.h"
 #include "global_object.h"
+#include "bytecode.h"
+#include "jit.h"
 
 #include <sstream>
+#include <exception>
 #include <algorithm>
+#include <unordered_map>
 #include <cmath>
 
 #ifndef NDEBUG
@@ -26,80 +30,129 @@ std::wostream& operator<<(std::wostream& os, const completion& c) {
     return os << c.type << " value type: " << c.result.type();
 }
 
-class hoisting_visitor {
+// Returns the array index that ToString(v) would produce or UINT32_MAX if v isn't a number that's an array index
+static uint32_t number_to_index(const value& v) {
+    if (v.type() != value_type::number) {
+        return UINT32_MAX;
+    }
+    const double n = v.number_value();
+    // Only integers in [0; 2^32-1) are array indices (-0 converts to "0" like +0)
+    if (n >= 0 && n < static_cast<double>(UINT32_MAX) && static_cast<double>(static_cast<uint32_t>(n)) == n) {
+        return static_cast<uint32_t>(n);
+    }
+    return UINT32_MAX;
+}
+
+// The arguments object of a function call (10.1.8). The arguments are stored in a vector rather than as one
+// (index string keyed) property each and appear as exotic properties that can be deleted.
+// Only created for functions that might access it (see declarations::uses_arguments).
+class arguments_object : public object {
 public:
-    static std::vector<std::wstring> scan(const block_statement& bs) {
-        hoisting_visitor hv{};
-        hv(bs);
-        return hv.ids_;
+    friend gc_type_info_registration<arguments_object>;
+
+    static gc_heap_ptr<arguments_object> make(gc_heap& h, const string& class_name, const object_ptr& prototype, const value_span& args) {
+        return h.make<arguments_object>(h, class_name, prototype, args);
     }
 
-    void operator()(const block_statement& s) {
-        for (const auto& bs: s.l()) {
-            accept(*bs, *this);
+    value get_index(uint32_t index) const override {
+        if (has_element(index)) {
+            return elements_.dereference(heap())[index].get_value(heap());
         }
+        return object::get_index(index);
     }
 
-    void operator()(const variable_statement& s) {
-        for (const auto& d: s.l()) {
-            ids_.push_back(d.id());
+    void put_index(uint32_t index, const value& val) override {
+        if (has_element(index)) {
+            elements_.dereference(heap())[index] = value_representation{val};
+        } else {
+            object::put_index(index, val);
         }
     }
 
-    void operator()(const empty_statement&) {}
-
-    void operator()(const expression_statement&){}
-
-    void operator()(const if_statement& s) {
-        accept(s.if_s(), *this);
-        if (auto e = s.else_s()) {
-            accept(*e, *this);
+    void put(const string& name, const value& val, property_attribute attr) override {
+        if (const uint32_t index = string_to_index(name.view()); has_element(index)) {
+            put_index(index, val);
+        } else {
+            object::put(name, val, attr);
         }
     }
 
-    void operator()(const while_statement& s){
-        accept(s.s(), *this);
+private:
+    using element_vector = gc_vector<value_representation>;
+    gc_heap_ptr_untracked<element_vector> elements_;
+
+    explicit arguments_object(gc_heap& h, const string& class_name, const object_ptr& prototype, const value_span& args) : object{h, class_name, prototype} {
+        set_exotic();
+        if (!args.empty()) {
+            auto elements = element_vector::make(h, static_cast<uint32_t>(args.size()));
+            for (const auto& a: args) {
+                elements->push_back(value_representation{a});
+            }
+            elements_ = elements;
+        }
     }
 
-    void operator()(const for_statement& s){
-        if (s.init()) accept(*s.init(), *this);
-        accept(s.s(), *this);
-    }
+    arguments_object(arguments_object&&) = default;
 
-    void operator()(const for_in_statement& s){
-        accept(s.init(), *this);
-        accept(s.s(), *this);
+    void fixup() {
+        object::fixup();
+        elements_.fixup(heap());
     }
 
-    void operator()(const continue_statement&){}
-    void operator()(const break_statement&){}
-    void operator()(const return_statement&){}
-    void operator()(const with_statement&){}
+    bool has_element(uint32_t index) const {
+        return elements_ && index < elements_.dereference(heap()).length() && !elements_.dereference(heap())[index].is_hole();
+    }
 
-    void operator()(const function_definition& s) {
-        assert(!s.id().empty());
-        ids_.push_back(s.id());
+    bool exotic_find(const std::wstring_view& name, property_attribute& attributes) const override {
+        if (has_element(string_to_index(name))) {
+            attributes = property_attribute::dont_enum;
+            return true;
+        }
+        return false;
     }
 
-    void operator()(const statement& s) {
-        NOT_IMPLEMENTED(s);
+    value exotic_get(const std::wstring_view& name) const override {
+        return get_index(string_to_index(name));
     }
 
-private:
-    explicit hoisting_visitor() {}
-    std::vector<std::wstring> ids_;
+    void exotic_delete(const std::wstring_view& name) override {
+        const uint32_t index = string_to_index(name);
+        assert(has_element(index));
+        elements_.dereference(heap())[index] = value_representation::hole();
+    }
 };
 
-class eval_exception : public std::runtime_error {
+// Error raised by running code. Only the position of the error is known when it's thrown, the positions of the calls it
+// propagates out of are added while unwinding (so keeping track of them costs nothing unless an error occurs).
+class eval_exception : public std::exception {
 public:
-    explicit eval_exception(const std::vector<source_extend>& stack_trace, const std::wstring_view& msg) : std::runtime_error(get_repr(stack_trace, msg)) {
+    explicit eval_exception(const std::wstring_view& msg) : msg_(msg) {
+    }
+
+    explicit eval_exception(const source_extend& extend, const std::wstring_view& msg) : msg_(msg), stack_trace_{extend} {
+    }
+
+    void add_call_site(const source_extend& extend) {
+        stack_trace_.push_back(extend);
+        repr_.clear();
+    }
+
+    const char* what() const noexcept override {
+        if (repr_.empty()) {
+            repr_ = get_repr();
+        }
+        return repr_.c_str();
     }
 
 private:
-    static std::string get_repr(const std::vector<source_extend>& stack_trace, const std::wstring_view& msg) {
+    std::wstring msg_;
+    std::vector<source_extend> stack_trace_;
+    mutable std::string repr_;
+
+    std::string get_repr() const {
         std::ostringstream oss;
-        oss << std::string(msg.begin(), msg.end());
-        for (const auto& e: stack_trace) {
+        oss << std::string(msg_.begin(), msg_.end());
+        for (const auto& e: stack_trace_) {
             assert(e.file);
             oss << '\n' << e;
         }
@@ -112,25 +165,24 @@ public:
     explicit impl(gc_heap& h, const block_statement& program, const on_statement_executed_type& on_statement_executed) : heap_(h), global_(global_object::make(h)), on_statement_executed_(on_statement_executed) {
         assert(!global_->has_property(L"eval"));
 
-        global_->put_native_function(global_, "eval", [this](const value&, const std::vector<value>& args) {
+        global_->put_native_function(global_, "eval", [this](const value&, const value_span& args) {
             if (args.empty()) {
                 return value::undefined;
             } else if (args.front().type() != value_type::string) {
                 return args.front();
             }
             auto bs = parse(std::make_shared<source_file>(L"eval", args.front().string_value().view()));
-            completion ret;
-            for (const auto& s: bs->l()) {
-                ret = eval(*s);
-                if (ret) {
-                    return value::undefined;
+            // Variables declared by the eval code are created in the calling scope
+            for (const auto& id: scan_declarations(*bs).ids) {
+                if (!active_scope_->activation().has_property(id)) {
+                    active_scope_->put(global_->intern(id), value::undefined);
                 }
             }
-            assert(!ret);
-            return ret.result;
+            const auto ret = run(*compile(*bs, code_options(true)), active_scope_, nullptr);
+            return ret ? value::undefined : ret.result;
         }, 1);
 
-        global_->put_function(global_->get(L"Function").object_value(), gc_function::make(h, [this](const value&, const std::vector<value>& args) {
+        global_->put_function(global_->get(L"Function").object_value(), gc_function::make(h, [this](const value&, const value_span& args) {
             std::wstring body{}, p{};
             if (args.empty()) {
             } else if (args.size() == 1) {
@@ -149,11 +201,12 @@ public:
                 NOT_IMPLEMENTED("Invalid function definition: " << bs->extend().source_view());
             }
 
-            return value{create_function(static_cast<const function_definition&>(*bs->l().front()), make_scope(global_, nullptr))};
+            const auto& fd = static_cast<const function_definition&>(*bs->l().front());
+            return value{create_function(fd, compile_function(fd, code_options(false)), make_scope(global_, nullptr), nullptr)};
         }), global_object::native_function_body(string{heap_, L"Function"}), 1);
 
-        for (const auto& id: hoisting_visitor::scan(program)) {
-            global_->put(string{heap_, id}, value::undefined);
+        for (const auto& id: scan_declarations(program).ids) {
+            global_->put(global_->intern(id), value::undefined);
         }
 
         active_scope_ = make_scope(global_, nullptr);
@@ -164,136 +217,12 @@ public:
     }
 
     value eval(const expression& e) {
-        return accept(e, *this);
+        return run(*compile(e), active_scope_, nullptr).result;
     }
 
     completion eval(const statement& s) {
-        auto res = accept(s, *this);
-        if (on_statement_executed_) {
-            on_statement_executed_(s, res);
-        }
-        return res;
-    }
-
-    value operator()(const identifier_expression& e) {
-        // 10.1.4
-        return value{active_scope_->lookup(e.id())};
-    }
-
-    value operator()(const literal_expression& e) {
-        switch (e.t().type()) {
-        case token_type::undefined_:      return value::undefined;
-        case token_type::null_:           return value::null;
-        case token_type::true_:           return value{true};
-        case token_type::false_:          return value{false};
-        case token_type::numeric_literal: return value{e.t().dvalue()};
-        case token_type::string_literal:  return value{string{heap_, e.t().text()}};
-        default: NOT_IMPLEMENTED(e);
-        }
-    }
-
-    value operator()(const call_expression& e) {
-        auto member = eval(e.member());
-        auto mval = get_value(member);
-        auto args = eval_argument_list(e.arguments());
-        if (mval.type() != value_type::object) {
-            std::wostringstream woss;
-            woss << e.member() << " is not a function";
-            throw eval_exception(stack_trace(e.extend()), woss.str());
-        }
-        auto c = mval.object_value()->call_function();
-        if (!c) {
-            std::wostringstream woss;
-            woss << e.member() << " is not callable";
-            throw eval_exception(stack_trace(e.extend()), woss.str());
-        }
-        auto this_ = value::null;
-        if (member.type() == value_type::reference) {
-            if (auto o = member.reference_value().base(); o->class_name().view() != L"Activation") {
-                this_ = value{o};
-            }
-        }
-
-        active_scope_->call_site = e.extend();
-        auto res = c->call(this_, args);
-        active_scope_->call_site = source_extend{nullptr,0,0};
-        return res;
+        return run(*compile(s, code_options(true)), active_scope_, nullptr);
     }
-
-    value operator()(const prefix_expression& e) {
-        if (e.op() == token_type::new_) {
-            return handle_new_expression(e.e());
-        }
-
-        auto u = eval(e.e());
-        if (e.op() == token_type::delete_) {
-            if (u.type() != value_type::reference) {
-                NOT_IMPLEMENTED(u.type());
-            }
-            const auto& base = u.reference_value().base();
-            const auto& prop = u.reference_value().property_name();
-            if (!base) {
-                return value{true};
-            }
-            return value{base->delete_property(prop.view())};
-        } else if (e.op() == token_type::void_) {
-            (void)get_value(u);
-            return value::undefined;
-        } else if (e.op() == token_type::typeof_) {
-            if (u.type() == value_type::reference && !u.reference_value().base()) {
-                return value{string{heap_, "undefined"}};
-            }
-            u = get_value(u);
-            switch (u.type()) {
-            case value_type::undefined: return value{string{heap_, "undefined"}};
-            case value_type::null: return value{string{heap_, "object"}};
-            case value_type::boolean: return value{string{heap_, "boolean"}};
-            case value_type::number: return value{string{heap_, "number"}};
-            case value_type::string: return value{string{heap_, "string"}};
-            case value_type::object: return value{string{heap_, u.object_value()->call_function() ? "function" : "object"}};
-            default:
-                NOT_IMPLEMENTED(u.type());
-            }
-        } else if (e.op() == token_type::plusplus || e.op() == token_type::minusminus) {
-            if (u.type() != value_type::reference) {
-                NOT_IMPLEMENTED(to_string(heap_, u));
-            }
-            auto num = to_number(get_value(u)) + (e.op() == token_type::plusplus ? 1 : -1);
-            if (!put_value(u, value{num})) {
-                NOT_IMPLEMENTED(to_string(heap_, u));
-            }
-            return value{num};
-        } else if (e.op() == token_type::plus) {
-            return value{to_number(get_value(u))};
-        } else if (e.op() == token_type::minus) {
-            return value{-to_number(get_value(u))};
-        } else if (e.op() == token_type::tilde) {
-            return value{static_cast<double>(~to_int32(get_value(u)))};
-        } else if (e.op() == token_type::not_) {
-            return value{!to_boolean(get_value(u))};
-        }
-        NOT_IMPLEMENTED(e);
-    }
-
-    value operator()(const postfix_expression& e) {
-        auto member = eval(e.e());
-        if (member.type() != value_type::reference) {
-            NOT_IMPLEMENTED(e);
-        }
-
-        auto orig = to_number(get_value(member));
-        auto num = orig;
-        switch (e.op()) {
-        case token_type::plusplus:   num += 1; break;
-        case token_type::minusminus: num -= 1; break;
-        default: NOT_IMPLEMENTED(e.op());
-        }
-        if (!put_value(member, value{num})) {
-            NOT_IMPLEMENTED(e);
-        }
-        return value{orig};
-    }
-
     // 0=false, 1=true, -1=undefined
     static int tri_compare(double l, double r) {
         if (std::isnan(l) || std::isnan(r)) {
@@ -414,369 +343,964 @@ public:
         }
     }
 
-    value operator()(const binary_expression& e) {
-        if (e.op() == token_type::comma) {
-            (void)get_value(eval(e.lhs()));;
-            return get_value(eval(e.rhs()));
+private:
+    class scope;
+    using scope_ptr = gc_heap_ptr<scope>;
+    class scope {
+    public:
+        friend gc_type_info_registration<scope>;
+
+#ifndef NDBEUG
+        bool has_property(const std::wstring& id) const {
+            return activation_.dereference(heap_).has_property(id);
         }
-        if (operator_precedence(e.op()) == assignment_precedence) {
-            auto l = eval(e.lhs());
-            auto r = get_value(eval(e.rhs()));
-            if (e.op() != token_type::equal) {
-                auto lval = get_value(l);
-                r = do_binary_op(without_assignment(e.op()), lval, r);
-            }
-            if (!put_value(l, r)) {
-                NOT_IMPLEMENTED(e);
+#endif
+
+        reference lookup(const string& id) const {
+            if (!prev_ || activation_.dereference(heap_).has_property(id)) {
+                return reference{activation_.track(heap_), id};
             }
-            return r;
+            return prev_.dereference(heap_).lookup(id);
         }
 
-        auto l = get_value(eval(e.lhs()));
-        if ((e.op() == token_type::andand && !to_boolean(l)) || (e.op() == token_type::oror && to_boolean(l))) {
-            return l;
+        void put(const string& key, const value& val) {
+            activation_.dereference(heap_).put(key, val);
         }
-        auto r = get_value(eval(e.rhs()));
-        if (e.op() == token_type::andand || e.op() == token_type::oror) {
-            return r;
+
+        object& activation() const {
+            return activation_.dereference(heap_);
         }
-        if (e.op() == token_type::dot || e.op() == token_type::lbracket) {
-            return value{reference{global_->to_object(l), to_string(heap_, r)}};
+
+        object_ptr activation_ptr() const {
+            return activation_.track(heap_);
         }
-        return do_binary_op(e.op(), l, r);
-    }
 
-    value operator()(const conditional_expression& e) {
-        if (to_boolean(get_value(eval(e.cond())))) {
-            return get_value(eval(e.lhs()));
-        } else {
-            return get_value(eval(e.rhs()));
+        const scope* get_prev() const {
+            return prev_ ? &prev_.dereference(heap_) : nullptr;
         }
-    }
 
-    value operator()(const expression& e) {
-        NOT_IMPLEMENTED(e);
-    }
+    private:
+        explicit scope(const object_ptr& act, const scope_ptr& prev) : heap_(act.heap()), activation_(act), prev_(prev) {}
+        scope(scope&&) = default;
+
+        void fixup() {
+            activation_.fixup(heap_);
+            prev_.fixup(heap_);
+        }
+
+        gc_heap& heap_;
+        gc_heap_ptr_untracked<object> activation_;
+        gc_heap_ptr_untracked<scope>  prev_;
+    };
+
+    // Local variables of a function call that nested functions might access (see bytecode::local_location)
+    class environment;
+    using environment_ptr = gc_heap_ptr<environment>;
+    class alignas(uint64_t) environment {
+    public:
+        friend gc_type_info_registration<environment>;
+
+        static environment_ptr make(gc_heap& h, uint32_t size, const environment_ptr& prev) {
+            return h.allocate_and_construct<environment>(sizeof(environment) + size * sizeof(value_representation), h, size, prev);
+        }
+
+        value_representation& slot(uint32_t index) const {
+            assert(index < size_);
+            return slots()[index];
+        }
+
+        // Environment of the function containing the function this environment belongs to (nullptr if it doesn't have one)
+        environment* prev() const {
+            return prev_ ? &prev_.dereference(heap_) : nullptr;
+        }
+
+    private:
+        gc_heap& heap_;
+        gc_heap_ptr_untracked<environment> prev_;
+        uint32_t size_;
+
+        value_representation* slots() const {
+            return reinterpret_cast<value_representation*>(const_cast<std::byte*>(reinterpret_cast<const std::byte*>(this)) + sizeof(*this));
+        }
+
+        explicit environment(gc_heap& h, uint32_t size, const environment_ptr& prev) : heap_(h), prev_(prev), size_(size) {
+            std::fill(slots(), slots() + size_, value_representation::undefined());
+        }
+
+        environment(environment&& other) : heap_(other.heap_), prev_(other.prev_), size_(other.size_) {
+            std::memcpy(static_cast<void*>(slots()), other.slots(), size_ * sizeof(value_representation));
+        }
+
+        void fixup() {
+            prev_.fixup(heap_);
+            for (uint32_t i = 0; i < size_; ++i) {
+                slots()[i].fixup(heap_);
+            }
+        }
+    };
 
-    //
-    // Statements
-    //
+    // Maximum number of registers of all running code
+    static constexpr uint32_t      stack_size = 1 << 16;
 
-    completion operator()(const block_statement& s) {
-        completion c{};
-        for (const auto& bs: s.l()) {
-            c = eval(*bs);
-            if (c) break;
+    gc_heap&                       heap_;
+    scope_ptr                      active_scope_;
+    // Registers of running code are allocated from here, so calls don't need to allocate memory
+    std::unique_ptr<value_representation[]> stack_{new value_representation[stack_size]};
+    uint32_t                       stack_top_ = 0;
+    // Arguments of calls from running code are passed from here (see auto_arguments)
+    static constexpr uint32_t      argument_stack_size = 1 << 14;
+    std::unique_ptr<value[]>       argument_stack_{new value[argument_stack_size]};
+    uint32_t                       argument_stack_top_ = 0;
+    gc_heap_ptr<global_object>     global_;
+    on_statement_executed_type     on_statement_executed_;
+
+    // Well known strings used when calling functions
+    const string                   Object_str_     = global_->intern(L"Object");
+    const string                   Activation_str_ = global_->intern(L"Activation");
+    const string                   this_str_       = global_->intern(L"this");
+    const string                   arguments_str_  = global_->intern(L"arguments");
+    const string                   callee_str_     = global_->intern(L"callee");
+    const string                   length_str_     = global_->intern(L"length");
+    const string                   prototype_str_  = global_->intern(L"prototype");
+
+    // Results of typeof
+    const string                   undefined_str_  = global_->intern(L"undefined");
+    const string                   object_str_     = global_->intern(L"object");
+    const string                   boolean_str_    = global_->intern(L"boolean");
+    const string                   number_str_     = global_->intern(L"number");
+    const string                   string_str_     = global_->intern(L"string");
+    const string                   function_str_   = global_->intern(L"function");
+
+    // Shared by all activation objects, so identifiers can be looked up using inline caches
+    const gc_heap_ptr<gc_shape>    activation_root_shape_ = gc_shape::make_root(heap_);
+
+    // Strings shared by all function objects created from the same function code
+    struct function_template {
+        std::weak_ptr<const bytecode> code;     // The address of the code might be reused once it's gone
+        string                        id;
+        std::vector<string>           params;
+        string                        text;     // Source text (see global_object::put_function)
+    };
+    std::unordered_map<const bytecode*, function_template> function_templates_;
+    size_t                         function_templates_prune_size_ = 64;
+
+    // Interned values of the string constants of code, so loading one is just a copy. The values are roots for as long
+    // as the code is alive.
+    class string_constants {
+    public:
+        explicit string_constants(impl& parent, const bytecode& bc) : code(bc.weak_from_this()), heap_(parent.heap_), values_(new value_representation[bc.string_count()]) {
+            const auto count = bc.string_count();
+            std::fill(values_.get(), values_.get() + count, value_representation::undefined());
+            heap_.add_root_range(values_.get(), values_.get() + count);
+            for (uint32_t i = 0; i < count; ++i) {
+                values_[i] = value_representation{value{parent.global_->intern(bc.string_constant(i))}};
+            }
+        }
+
+        ~string_constants() {
+            heap_.remove_root_range(values_.get());
         }
-        return c;
+
+        string_constants(const string_constants&) = delete;
+        string_constants& operator=(const string_constants&) = delete;
+
+        const value_representation* values() const { return values_.get(); }
+
+        std::weak_ptr<const bytecode> code; // The address of the code might be reused once it's gone
+
+    private:
+        gc_heap& heap_;
+        std::unique_ptr<value_representation[]> values_;
+    };
+    std::unordered_map<const bytecode*, string_constants> string_constants_;
+    size_t                         string_constants_prune_size_ = 64;
+
+    // Forgets the entries of 'm' for code that's gone (e.g. created by eval) once it has grown to 'prune_size' entries
+    template<typename Map>
+    static void prune_code_map(Map& m, size_t& prune_size) {
+        if (m.size() < prune_size) {
+            return;
+        }
+        for (auto it = m.begin(); it != m.end();) {
+            it = it->second.code.expired() ? m.erase(it) : std::next(it);
+        }
+        prune_size = std::max(prune_size, 2 * m.size());
     }
 
-    completion operator()(const variable_statement& s) {
-        for (const auto& d: s.l()) {
-            assert(active_scope_->has_property(d.id()));
-            if (d.init()) {
-                // Evaulate in two steps to avoid using stale activation object pointer in case the evaulation forces a garbage collection
-                auto init_val = eval(*d.init());
-                active_scope_->put(string{heap_, d.id()}, init_val);
+    const value_representation* get_string_constants(const bytecode& bc) {
+        if (auto it = string_constants_.find(&bc); it != string_constants_.end()) {
+            if (!it->second.code.expired()) {
+                return it->second.values();
             }
+            string_constants_.erase(it);
         }
-        return completion{};
+        prune_code_map(string_constants_, string_constants_prune_size_);
+        return string_constants_.try_emplace(&bc, *this, bc).first->second.values();
     }
 
-    completion operator()(const empty_statement&) {
-        return completion{};
+    static scope_ptr make_scope(const object_ptr& act, const scope_ptr& prev) {
+        return act.heap().make<scope>(act, prev);
     }
 
-    completion operator()(const expression_statement& s) {
-        return completion{completion_type::normal, get_value(eval(s.e()))};
+    [[noreturn]] static void stack_overflow() {
+        throw eval_exception(L"Stack overflow");
     }
 
-    completion operator()(const if_statement& s) {
-        if (to_boolean(get_value(eval(s.cond())))) {
-            return eval(s.if_s());
-        } else if (auto e = s.else_s()) {
-            return eval(*e);
+    // Passes the values of 'argc' registers starting at 'regs' as the arguments of a call (while it's alive)
+    class auto_arguments {
+    public:
+        explicit auto_arguments(impl& parent, const value_representation* regs, uint32_t argc) : parent_(parent), first_(parent.argument_stack_top_) {
+            if (argc > argument_stack_size - first_) {
+                parent_.stack_overflow();
+            }
+            value* const a = &parent_.argument_stack_[first_];
+            for (uint32_t i = 0; i < argc; ++i) {
+                a[i] = regs[i].get_value(parent_.heap_);
+            }
+            parent_.argument_stack_top_ += argc;
+        }
+
+        ~auto_arguments() {
+            // Don't keep the values alive
+            std::fill(&parent_.argument_stack_[first_], &parent_.argument_stack_[parent_.argument_stack_top_], value::undefined);
+            parent_.argument_stack_top_ = first_;
         }
-        return completion{};
+
+        auto_arguments(const auto_arguments&) = delete;
+        auto_arguments& operator=(const auto_arguments&) = delete;
+
+        value_span args() const {
+            return value_span{&parent_.argument_stack_[first_], parent_.argument_stack_top_ - first_};
+        }
+
+    private:
+        impl& parent_;
+        uint32_t first_;
+    };
+
+    compile_options code_options(bool completion_values) const {
+        compile_options options;
+        options.completion_values = completion_values;
+        options.statement_hooks = static_cast<bool>(on_statement_executed_);
+        return options;
     }
 
-    completion operator()(const while_statement& s) {
-        while (to_boolean(get_value(eval(s.cond())))) {
-            auto c = eval(s.s());
-            if (c.type == completion_type::break_) {
-                return completion{};
-            } else if (c.type == completion_type::return_) {
-                return c;
+    // Registers and other state of running code. Makes 'active_scope' the active scope until the code stops running.
+    class frame {
+    public:
+        explicit frame(impl& parent, const bytecode& bc, const scope_ptr& active_scope, const environment_ptr& env) : parent_(parent), code_(bc), saved_scope_(parent.active_scope_), env_(env), registers_(parent.stack_.get() + parent.stack_top_), for_in_(bc.for_in_count()) {
+            const auto count = bc.register_count();
+            if (count > stack_size - parent_.stack_top_) {
+                parent_.stack_overflow();
+            }
+            std::fill(registers_, registers_ + count, value_representation::undefined());
+            parent_.stack_top_ += count;
+            parent_.active_scope_ = active_scope;
+            if (count) {
+                parent_.heap_.add_root_range(registers_, registers_ + count);
             }
-            assert(c.type == completion_type::normal || c.type == completion_type::continue_);
         }
-        return completion{};
-    }
 
-    // TODO: Reduce code duplication in handling of for/for in statements
+        ~frame() {
+            if (code_.register_count()) {
+                parent_.heap_.remove_root_range(registers_);
+            }
+            parent_.stack_top_ -= code_.register_count();
+            parent_.active_scope_ = saved_scope_;
+        }
+
+        frame(const frame&) = delete;
+        frame& operator=(const frame&) = delete;
 
-    completion operator()(const for_statement& s) {
-        if (auto is = s.init()) {
-            auto c = eval(*is);
-            assert(!c); // Expect normal completion
-            (void)get_value(c.result);
+        const bytecode& code() const { return code_; }
+
+        // Value of the string constant 'index' of the code
+        const value_representation& string_constant(uint32_t index) {
+            if (!strings_) {
+                strings_ = parent_.get_string_constants(code_);
+            }
+            return strings_[index];
         }
-        completion c{};
-        while (!s.cond() || to_boolean(get_value(eval(*s.cond())))) {
-            c = eval(s.s());
-            if (c.type == completion_type::break_) {
-                break;
-            } else if (c.type == completion_type::return_) {
-                return c;
+
+        value_representation* registers() { return registers_; }
+
+        const environment_ptr& env() const { return env_; }
+
+        void env(const environment_ptr& e) { env_ = e; }
+
+        // Environment 'depth' levels up
+        environment& env(uint32_t depth) const {
+            environment* e = env_.get();
+            while (depth--) {
+                e = e->prev();
             }
-            assert(c.type == completion_type::normal || c.type == completion_type::continue_);
+            return *e;
+        }
 
-            if (s.iter()) {
-                (void)get_value(eval(*s.iter()));
+        struct for_in_state {
+            std::vector<string> names;
+            size_t next = 0;
+        };
+        for_in_state& for_in(uint32_t index) { return for_in_[index]; }
+
+        // Scopes active before each currently entered with statement
+        std::vector<scope_ptr> with_scopes;
+
+    private:
+        impl& parent_;
+        const bytecode& code_;
+        scope_ptr saved_scope_;
+        environment_ptr env_;
+        value_representation* registers_;
+        const value_representation* strings_ = nullptr; // See string_constants
+        std::vector<for_in_state> for_in_;
+    };
+
+    // Returns the scope holding the identifier 'ie' (10.1.4), the global scope if no scope has it.
+    // 'level' is set to the scope level (used to select the inline cache).
+    const scope& find_scope(const identifier_expression& ie, int& level) const {
+        const scope* s = active_scope_.get();
+        level = 0;
+        for (; s->get_prev(); s = s->get_prev(), ++level) {
+            if (s->activation().cached_has_property(ie.id(), ie.scope_cache(level))) {
+                break;
             }
         }
-        return c;
+        return *s;
     }
 
-    completion operator()(const for_in_statement& s) {
-        completion c{};
-        if (s.init().type() == statement_type::expression) {
-            auto o = global_->to_object(get_value(eval(s.e())));
-            const auto& lhs_expression = static_cast<const expression_statement&>(s.init()).e();
-            for (const auto& n: o->property_names()) {
-                if (!put_value(eval(lhs_expression), value{n})) {
-                    std::wostringstream woss;
-                    woss << lhs_expression << " is not an valid left hand side expression in for in loop";
-                    throw eval_exception(stack_trace(lhs_expression.extend()), woss.str());
-                }
-                c = eval(s.s());
-                if (c.type == completion_type::break_) {
-                    break;
-                } else if (c.type == completion_type::return_) {
-                    return c;
-                }
-                assert(c.type == completion_type::normal || c.type == completion_type::continue_);
-            }
-        } else {
-            assert(s.init().type() == statement_type::variable);
-            const auto& var_statement = static_cast<const variable_statement&>(s.init());
-            assert(var_statement.l().size() == 1);
-            const auto& init = var_statement.l()[0];
-
-            auto assign = [&](const value& val) {
-                if (!put_value(value{active_scope_->lookup(init.id())}, val)) {
-                    // Shouldn't happen (?)
-                    NOT_IMPLEMENTED(s);
-                }
-            };
-
-            assign(init.init() ? get_value(eval(*init.init())) : value::undefined);
-            
-            // Happens after the initial assignment
-            auto o = global_->to_object(get_value(eval(s.e())));
-
-            for (const auto& n: o->property_names()) {
-                assign(value{n});
-                c = eval(s.s());
-                if (c.type == completion_type::break_) {
-                    break;
-                } else if (c.type == completion_type::return_) {
-                    return c;
-                }
-                assert(c.type == completion_type::normal || c.type == completion_type::continue_);
-            }
+    static const std::wstring& member_name(const binary_expression& be) {
+        return static_cast<const literal_expression&>(be.rhs()).t().text();
+    }
+
+    value get_element(const value& base, const value& key) {
+        const auto o = global_->to_object(base);
+        if (const uint32_t index = number_to_index(key); index != UINT32_MAX) {
+            return o->get_index(index);
         }
-        return c;
+        return o->get(to_string(heap_, key));
     }
 
-    completion operator()(const continue_statement&) {
-        return completion{completion_type::continue_};
+    void put_element(const value& base, const value& key, const value& val) {
+        const auto o = global_->to_object(base);
+        if (const uint32_t index = number_to_index(key); index != UINT32_MAX) {
+            o->put_index(index, val);
+        } else {
+            o->put(to_string(heap_, key), val);
+        }
     }
 
-    completion operator()(const break_statement&) {
-        return completion{completion_type::break_};
+    value typeof_value(const value& v) {
+        switch (v.type()) {
+        case value_type::undefined: return value{undefined_str_};
+        case value_type::null: return value{object_str_};
+        case value_type::boolean: return value{boolean_str_};
+        case value_type::number: return value{number_str_};
+        case value_type::string: return value{string_str_};
+        case value_type::object: return value{v.object_value()->call_function() ? function_str_ : object_str_};
+        default:
+            NOT_IMPLEMENTED(v.type());
+        }
     }
 
-    completion operator()(const return_statement& s) {
-        value res{};
-        if (s.e()) {
-            res = get_value(eval(*s.e()));
+    value call(const value& f, const value& this_, const value_representation* arg_regs, uint32_t argc, const call_expression& e) {
+        if (f.type() != value_type::object) {
+            std::wostringstream woss;
+            woss << e.member() << " is not a function";
+            throw eval_exception(e.extend(), woss.str());
+        }
+        auto c = f.object_value()->call_function();
+        if (!c) {
+            std::wostringstream woss;
+            woss << e.member() << " is not callable";
+            throw eval_exception(e.extend(), woss.str());
+        }
+        auto_arguments args{*this, arg_regs, argc};
+        try {
+            return c->call(this_, args.args());
+        } catch (eval_exception& ex) {
+            ex.add_call_site(e.extend());
+            throw;
         }
-        return completion{completion_type::return_, res};
     }
 
-    completion operator()(const with_statement& s) {
-        auto_scope with_scope{*this, global_->to_object(get_value(eval(s.e()))), active_scope_};
-        return eval(s.s());
+    value construct(const value& f, const value_representation* arg_regs, uint32_t argc, const expression& e) {
+        if (f.type() != value_type::object) {
+            std::wostringstream woss;
+            woss << e << " is not an object";
+            throw eval_exception(e.extend(), woss.str());
+        }
+        auto c = f.object_value()->construct_function();
+        if (!c) {
+            std::wostringstream woss;
+            woss << e << " is not constructable";
+            throw eval_exception(e.extend(), woss.str());
+        }
+        auto_arguments args{*this, arg_regs, argc};
+        try {
+            return c->call(value::undefined, args.args());
+        } catch (eval_exception& ex) {
+            ex.add_call_site(e.extend());
+            throw;
+        }
     }
 
-    completion operator()(const function_definition& s) {
-        active_scope_->put(string{heap_, s.id()}, value{create_function(s, active_scope_)});
-        return completion{};
+    // Runs compiled code with 'active_scope' as the active scope and 'env' as the environment (see bytecode::local_location)
+    // and returns the completion it ended with
+    completion run(const bytecode& bc, const scope_ptr& active_scope, const environment_ptr& env) {
+        frame f{*this, bc, active_scope, env};
+        return run(f);
     }
 
-    completion operator()(const statement& s) {
-        NOT_IMPLEMENTED(s);
+    completion run(frame& f) {
+        const instruction* const pc = jit_enabled() ? run_compiled(f) : execute(f, f.code().code(), false);
+        return completion{static_cast<completion_type>(pc->x), f.registers()[pc->a].get_value(heap_)};
     }
 
-private:
-    class scope;
-    using scope_ptr = gc_heap_ptr<scope>;
-    class scope {
-    public:
-        friend gc_type_info_registration<scope>;
+    struct jit_context {
+        impl& self;
+        frame& f;
+        std::exception_ptr exception;
+    };
 
-#ifndef NDBEUG
-        bool has_property(const std::wstring& id) const {
-            return activation_.dereference(heap_).has_property(id);
+    // Runs the machine code for the code of 'f' (compiling it the first time), returns the return_ instruction reached
+    const instruction* run_compiled(frame& f) {
+        const bytecode& bc = f.code();
+        if (!bc.compiled()) {
+            bc.compiled(jit_compile(bc, &jit_step));
+        }
+        jit_context context{*this, f, nullptr};
+        const uint32_t index = bc.compiled()->run(&context, f.registers());
+        if (index == UINT32_MAX) {
+            std::rethrow_exception(context.exception);
         }
+        return bc.code() + index;
+    }
+
+    // Called by compiled code to run the instruction it doesn't handle itself
+    static uint32_t jit_step(void* context, uint32_t index) {
+        auto& c = *static_cast<jit_context*>(context);
+        const instruction* const code = c.f.code().code();
+        try {
+            return static_cast<uint32_t>(c.self.execute(c.f, code + index, true) - code);
+        } catch (...) {
+            c.exception = std::current_exception();
+            return UINT32_MAX;
+        }
+    }
+
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic" // Labels as values
+#define MJS_COMPUTED_GOTO
+#endif
+    // Runs the code of 'f' starting at 'pc' until a return_ instruction is reached and returns it. If 'single_step' is
+    // true, only the instruction at 'pc' is run and the next instruction to run is returned.
+    const instruction* execute(frame& f, const instruction* pc, bool single_step) {
+        const bytecode& bc = f.code();
+        value_representation* const r = f.registers();
+        const instruction* const code = bc.code();
+
+#ifdef MJS_COMPUTED_GOTO
+        static const void* const dispatch_table[] = {
+#define MJS_OPCODE_LABEL(name) &&op_##name,
+            MJS_OPCODES(MJS_OPCODE_LABEL)
+#undef MJS_OPCODE_LABEL
+        };
+        static const void* const step_table[] = {
+#define MJS_OPCODE_LABEL(name) &&step_done,
+            MJS_OPCODES(MJS_OPCODE_LABEL)
+#undef MJS_OPCODE_LABEL
+        };
+        const void* const* const dispatch = single_step ? step_table : dispatch_table;
+#define MJS_CASE(name) op_##name
+        // Note: Destructors aren't run when jumping out of a scope with a computed goto, so handlers must only dispatch
+        // when no objects are alive (outside their block).
+#define MJS_DISPATCH() goto *dispatch[static_cast<int>(pc->op)]
+        goto *dispatch_table[static_cast<int>(pc->op)];
+    step_done:
+        return pc;
+        {
+#else
+#define MJS_CASE(name) case opcode::name
+#define MJS_DISPATCH() if (single_step) return pc; else continue
+        for (;;) switch (pc->op) {
 #endif
 
-        reference lookup(const string& id) const {
-            if (!prev_ || activation_.dereference(heap_).has_property(id.view())) {
-                return reference{activation_.track(heap_), id};
+#define MJS_BINARY_OP(name, token, number_expr) \
+        MJS_CASE(name): { \
+            const auto& i = *pc++; \
+            if (r[i.b].is_number() && r[i.c].is_number()) { \
+                const double ln = r[i.b].number_value(), rn = r[i.c].number_value(); \
+                r[i.a] = number_expr; \
+            } else { \
+                r[i.a] = slow_binary_op(token, r[i.b], r[i.c]); \
+            } \
+        } \
+        MJS_DISPATCH();
+
+#define MJS_BINARY_NUMBER_OP(name, token, number_expr) \
+        MJS_BINARY_OP(name, token, number_expr) \
+        MJS_CASE(name##_number): { \
+            const auto& i = *pc++; \
+            const double rn = bc.number(i.c); \
+            if (r[i.b].is_number()) { \
+                const double ln = r[i.b].number_value(); \
+                r[i.a] = number_expr; \
+            } else { \
+                r[i.a] = slow_binary_op(token, r[i.b], value_representation{rn}); \
+            } \
+        } \
+        MJS_DISPATCH();
+
+#define MJS_COMPARE_JUMP(name, token, op) \
+        MJS_CASE(name): { \
+            const auto& i = *pc; \
+            const auto rr = i.x & 2 ? value_representation{bc.number(i.b)} : r[i.b]; \
+            bool res; \
+            if (r[i.a].is_number() && rr.is_number()) { \
+                res = r[i.a].number_value() op rr.number_value(); \
+            } else { \
+                res = is_true(slow_binary_op(token, r[i.a], rr)); \
+            } \
+            pc = res == ((i.x & 1) != 0) ? code + pc[1].bc() : pc + 2; \
+        } \
+        MJS_DISPATCH();
+
+        MJS_CASE(nop):
+        MJS_CASE(data):
+            assert(pc->op == opcode::nop);
+            ++pc;
+            MJS_DISPATCH();
+
+        MJS_CASE(load_undefined): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation::undefined();
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(load_null): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation{value::null};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(load_boolean): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation::boolean(i.x != 0);
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(load_number): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation{bc.number(i.bc())};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(load_string): {
+            const auto& i = *pc++;
+            r[i.a] = f.string_constant(i.bc());
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(move): {
+            const auto& i = *pc++;
+            r[i.a] = r[i.b];
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(get_name): {
+            const auto& i = *pc++;
+            const auto& ie = bc.node<identifier_expression>(i.bc());
+            int level;
+            const auto& o = find_scope(ie, level).activation();
+            r[i.a] = value_representation{o.cached_get(ie.id(), ie.scope_cache(level))};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(put_name): {
+            const auto& i = *pc++;
+            const auto& ie = bc.node<identifier_expression>(i.bc());
+            int level;
+            auto& o = find_scope(ie, level).activation();
+            const auto v = r[i.a].get_value(heap_);
+            if (!o.cached_put(ie.id(), ie.scope_cache(level), v)) {
+                o.put(global_->intern(ie.id()), v);
             }
-            return prev_.dereference(heap_).lookup(id);
         }
+        MJS_DISPATCH();
+
+        MJS_CASE(get_name_this): {
+            const auto& i = *pc++;
+            const auto& ie = bc.node<identifier_expression>(i.bc());
+            int level;
+            const auto& s = find_scope(ie, level);
+            r[i.a] = value_representation{s.activation().cached_get(ie.id(), ie.scope_cache(level))};
+            // Functions found in activation objects are called with a null this value
+            r[i.a + 1] = s.activation().class_name().view() == L"Activation" ? value_representation{value::null} : value_representation{value{s.activation_ptr()}};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(delete_name): {
+            const auto& i = *pc++;
+            const auto& ie = bc.node<identifier_expression>(i.bc());
+            int level;
+            auto& o = find_scope(ie, level).activation();
+            r[i.a] = value_representation::boolean(o.delete_property(ie.id()));
+        }
+        MJS_DISPATCH();
 
-        reference lookup(const std::wstring& id) const {
-            return lookup(string{heap_, id});
+        MJS_CASE(get_slot): {
+            const auto& i = *pc++;
+            r[i.a] = f.env(i.b).slot(i.c);
         }
+        MJS_DISPATCH();
 
-        void put(const string& key, const value& val) {
-            activation_.dereference(heap_).put(key, val);
+        MJS_CASE(put_slot): {
+            const auto& i = *pc++;
+            f.env(i.b).slot(i.c) = r[i.a];
         }
+        MJS_DISPATCH();
 
-        const scope* get_prev() const {
-            return prev_ ? &prev_.dereference(heap_) : nullptr;
+        MJS_CASE(get_member): {
+            const auto& i = *pc++;
+            const auto& be = bc.node<binary_expression>(i.c);
+            const auto o = global_->to_object(r[i.b].get_value(heap_));
+            r[i.a] = value_representation{o->cached_get(member_name(be), be.member_cache())};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(put_member): {
+            const auto& i = *pc++;
+            const auto& be = bc.node<binary_expression>(i.c);
+            const auto o = global_->to_object(r[i.b].get_value(heap_));
+            const auto v = r[i.a].get_value(heap_);
+            if (!o->cached_put(member_name(be), be.member_cache(), v)) {
+                o->put(global_->intern(member_name(be)), v);
+            }
         }
+        MJS_DISPATCH();
+
+        MJS_CASE(get_member_this): {
+            const auto& i = *pc++;
+            const auto& be = bc.node<binary_expression>(i.c);
+            const auto o = global_->to_object(r[i.b].get_value(heap_));
+            r[i.a] = value_representation{o->cached_get(member_name(be), be.member_cache())};
+            r[i.a + 1] = value_representation{value{o}};
+        }
+        MJS_DISPATCH();
 
-        source_extend call_site;
-    private:
-        explicit scope(const object_ptr& act, const scope_ptr& prev) : heap_(act.heap()), activation_(act), prev_(prev) {}
-        scope(scope&&) = default;
+        MJS_CASE(delete_member): {
+            const auto& i = *pc++;
+            const auto& be = bc.node<binary_expression>(i.c);
+            const auto o = global_->to_object(r[i.b].get_value(heap_));
+            r[i.a] = value_representation::boolean(o->delete_property(member_name(be)));
+        }
+        MJS_DISPATCH();
 
-        void fixup() {
-            activation_.fixup(heap_);
-            prev_.fixup(heap_);
+        MJS_CASE(get_element): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation{get_element(r[i.b].get_value(heap_), r[i.c].get_value(heap_))};
         }
+        MJS_DISPATCH();
 
-        gc_heap& heap_;
-        gc_heap_ptr_untracked<object> activation_;
-        gc_heap_ptr_untracked<scope>  prev_;
-    };
-    class auto_scope {
-    public:
-        explicit auto_scope(impl& parent, const object_ptr& act, const scope_ptr& prev) : parent(parent), old_scopes(parent.active_scope_) {
-            parent.active_scope_ = act.heap().make<scope>(act, prev);
+        MJS_CASE(put_element): {
+            const auto& i = *pc++;
+            put_element(r[i.b].get_value(heap_), r[i.c].get_value(heap_), r[i.a].get_value(heap_));
         }
-        ~auto_scope() {
-            parent.active_scope_ = old_scopes;
+        MJS_DISPATCH();
+
+        MJS_CASE(get_element_this): {
+            const auto& i = *pc++;
+            const auto o = global_->to_object(r[i.b].get_value(heap_));
+            r[i.a] = value_representation{get_element(value{o}, r[i.c].get_value(heap_))};
+            r[i.a + 1] = value_representation{value{o}};
         }
+        MJS_DISPATCH();
 
-        impl& parent;
-        scope_ptr old_scopes;
-    };
-    gc_heap&                       heap_;
-    scope_ptr                      active_scope_;
-    gc_heap_ptr<global_object>     global_;
-    on_statement_executed_type     on_statement_executed_;
+        MJS_CASE(delete_element): {
+            const auto& i = *pc++;
+            const auto o = global_->to_object(r[i.b].get_value(heap_));
+            r[i.a] = value_representation::boolean(o->delete_property(to_string(heap_, r[i.c].get_value(heap_)).view()));
+        }
+        MJS_DISPATCH();
 
-    static scope_ptr make_scope(const object_ptr& act, const scope_ptr& prev) {
-        return act.heap().make<scope>(act, prev);
-    }
+        MJS_CASE(to_property_key): {
+            const auto& i = *pc++;
+            if (!r[i.a].is_number() || number_to_index(value{r[i.a].number_value()}) == UINT32_MAX) {
+                r[i.a] = value_representation{value{to_string(heap_, r[i.a].get_value(heap_))}};
+            }
+        }
+        MJS_DISPATCH();
+
+        MJS_BINARY_NUMBER_OP(add, token_type::plus, value_representation{ln + rn})
+        MJS_BINARY_NUMBER_OP(sub, token_type::minus, value_representation{ln - rn})
+        MJS_BINARY_NUMBER_OP(mul, token_type::multiply, value_representation{ln * rn})
+        MJS_BINARY_OP(div, token_type::divide, value_representation{ln / rn})
+        MJS_BINARY_OP(mod, token_type::mod, value_representation{std::fmod(ln, rn)})
+        MJS_BINARY_OP(shl, token_type::lshift, value_representation{static_cast<double>(to_int32(ln) << (to_uint32(rn) & 0x1f))})
+        MJS_BINARY_OP(sar, token_type::rshift, value_representation{static_cast<double>(to_int32(ln) >> (to_uint32(rn) & 0x1f))})
+        MJS_BINARY_OP(shr, token_type::rshiftshift, value_representation{static_cast<double>(to_uint32(ln) >> (to_uint32(rn) & 0x1f))})
+        MJS_BINARY_NUMBER_OP(bit_and, token_type::and_, value_representation{static_cast<double>(to_int32(ln) & to_int32(rn))})
+        MJS_BINARY_OP(bit_xor, token_type::xor_, value_representation{static_cast<double>(to_int32(ln) ^ to_int32(rn))})
+        MJS_BINARY_OP(bit_or, token_type::or_, value_representation{static_cast<double>(to_int32(ln) | to_int32(rn))})
+        // NaN compares false with everything and -0 equals +0 like in tri_compare/compare_equal
+        MJS_BINARY_OP(lt, token_type::lt, value_representation::boolean(ln < rn))
+        MJS_BINARY_OP(le, token_type::ltequal, value_representation::boolean(ln <= rn))
+        MJS_BINARY_OP(gt, token_type::gt, value_representation::boolean(ln > rn))
+        MJS_BINARY_OP(ge, token_type::gtequal, value_representation::boolean(ln >= rn))
+        MJS_BINARY_OP(eq, token_type::equalequal, value_representation::boolean(ln == rn))
+        MJS_BINARY_OP(ne, token_type::notequal, value_representation::boolean(!(ln == rn)))
+
+        MJS_COMPARE_JUMP(jump_if_lt, token_type::lt, <)
+        MJS_COMPARE_JUMP(jump_if_le, token_type::ltequal, <=)
+        MJS_COMPARE_JUMP(jump_if_gt, token_type::gt, >)
+        MJS_COMPARE_JUMP(jump_if_ge, token_type::gtequal, >=)
+
+        MJS_CASE(plus): {
+            const auto& i = *pc++;
+            r[i.a] = r[i.b].is_number() ? r[i.b] : value_representation{to_number(r[i.b].get_value(heap_))};
+        }
+        MJS_DISPATCH();
 
-    std::vector<source_extend> stack_trace(const source_extend& current_extend) const {
-        std::vector<source_extend> t;
-        t.push_back(current_extend);
-        for (const scope* p = active_scope_.get(); p != nullptr; p = p->get_prev()) {
-            if (!p->call_site.file) continue;
-            t.push_back(p->call_site);
+        MJS_CASE(neg): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation{-(r[i.b].is_number() ? r[i.b].number_value() : to_number(r[i.b].get_value(heap_)))};
         }
-        return t;
-    }
+        MJS_DISPATCH();
 
-    std::vector<value> eval_argument_list(const expression_list& es) {
-        std::vector<value> args;
-        for (const auto& e: es) {
-            args.push_back(get_value(eval(*e)));
+        MJS_CASE(bit_not): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation{static_cast<double>(~to_int32(r[i.b].get_value(heap_)))};
         }
-        return args;
-    }
+        MJS_DISPATCH();
 
-    value handle_new_expression(const expression& e) {
-        value o;
-        std::vector<value> args;
-        if (e.type() == expression_type::call) {
-            const auto& ce = static_cast<const call_expression&>(e);
-            o = eval(ce.member());
-            args = eval_argument_list(ce.arguments());
-        } else {
-            o = eval(e);
+        MJS_CASE(not_): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation::boolean(!is_true(r[i.b]));
         }
-        o = get_value(o);
-        if (o.type() != value_type::object) {
-            std::wostringstream woss;
-            woss << e << " is not an object";
-            throw eval_exception(stack_trace(e.extend()), woss.str());
+        MJS_DISPATCH();
+
+        MJS_CASE(typeof_): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation{typeof_value(r[i.b].get_value(heap_))};
         }
-        auto c = o.object_value()->construct_function();
-        if (!c) {
+        MJS_DISPATCH();
+
+        MJS_CASE(inc): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation{(r[i.b].is_number() ? r[i.b].number_value() : to_number(r[i.b].get_value(heap_))) + 1};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(dec): {
+            const auto& i = *pc++;
+            r[i.a] = value_representation{(r[i.b].is_number() ? r[i.b].number_value() : to_number(r[i.b].get_value(heap_))) - 1};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(jump):
+            pc = code + pc->bc();
+            MJS_DISPATCH();
+
+        MJS_CASE(jump_if_true):
+            pc = is_true(r[pc->a]) ? code + pc->bc() : pc + 1;
+            MJS_DISPATCH();
+
+        MJS_CASE(jump_if_false):
+            pc = is_true(r[pc->a]) ? pc + 1 : code + pc->bc();
+            MJS_DISPATCH();
+
+        MJS_CASE(call): {
+            const auto& i = *pc;
+            const auto& e = bc.node<call_expression>(pc[1].bc());
+            pc += 2;
+            const auto res = call(r[i.b].get_value(heap_), r[i.b + 1].get_value(heap_), &r[i.b + 2], i.c, e);
+            r[i.a] = value_representation{res};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(construct): {
+            const auto& i = *pc;
+            const auto& e = bc.node<expression>(pc[1].bc());
+            pc += 2;
+            const auto res = construct(r[i.b].get_value(heap_), &r[i.b + 2], i.c, e);
+            r[i.a] = value_representation{res};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(define_function): {
+            const auto& i = *pc++;
+            const auto& fe = bc.function(i.bc());
+            const auto fo = create_function(*fe.definition, fe.code, active_scope_, f.env());
+            active_scope_->put(get_function_template(*fe.definition, fe.code).id, value{fo});
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(make_function): {
+            const auto& i = *pc++;
+            const auto& fe = bc.function(i.bc());
+            r[i.a] = value_representation{value{create_function(*fe.definition, fe.code, active_scope_, f.env())}};
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(enter_with): {
+            const auto& i = *pc++;
+            const auto o = global_->to_object(r[i.a].get_value(heap_));
+            f.with_scopes.push_back(active_scope_);
+            active_scope_ = make_scope(o, active_scope_);
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(leave_with): {
+            ++pc;
+            active_scope_ = f.with_scopes.back();
+            f.with_scopes.pop_back();
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(for_in_start): {
+            const auto& i = *pc++;
+            auto& state = f.for_in(i.b);
+            state.names = global_->to_object(r[i.a].get_value(heap_))->property_names();
+            state.next = 0;
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(for_in_next): {
+            const auto& i = *pc;
+            auto& state = f.for_in(i.b);
+            if (state.next < state.names.size()) {
+                r[i.a] = value_representation{value{state.names[state.next++]}};
+                pc += 2;
+            } else {
+                state.names.clear();
+                pc = code + pc[1].bc();
+            }
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(invalid_reference): {
+            const auto& e = bc.node<expression>(pc->bc());
             std::wostringstream woss;
-            woss << e << " is not constructable";
-            throw eval_exception(stack_trace(e.extend()), woss.str());
+            woss << e << " is not a valid left hand side expression";
+            throw eval_exception(e.extend(), woss.str());
         }
 
-        active_scope_->call_site = e.extend();
-        auto res = c->call(value::undefined, args);
-        active_scope_->call_site = source_extend{nullptr,0,0};
-        return res;
+        MJS_CASE(statement_executed): {
+            const auto& i = *pc++;
+            on_statement_executed_(bc.node<statement>(i.bc()), completion{static_cast<completion_type>(i.x), r[i.a].get_value(heap_)});
+        }
+        MJS_DISPATCH();
+
+        MJS_CASE(return_):
+            return pc;
+        }
+
+#undef MJS_COMPARE_JUMP
+#undef MJS_BINARY_NUMBER_OP
+#undef MJS_BINARY_OP
+#undef MJS_DISPATCH
+#undef MJS_CASE
     }
+#ifdef __GNUC__
+#undef MJS_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
 
-    object_ptr create_function(const string& id, const std::shared_ptr<block_statement>& block, const std::vector<std::wstring>& param_names, const std::wstring& body_text, const scope_ptr& prev_scope) {
-        // 15.3.2.1
-        auto callee = global_->make_raw_function();
-        auto func = [this, block, param_names, prev_scope, callee, ids = hoisting_visitor::scan(*block)](const value& this_, const std::vector<value>& args) {
-            // Arguments array
-            auto as = object::make(heap_, string{heap_, "Object"}, global_->object_prototype());
-            as->put(string{heap_, "callee"}, value{callee}, property_attribute::dont_enum);
-            as->put(string{heap_, "length"}, value{static_cast<double>(args.size())}, property_attribute::dont_enum);
-            for (uint32_t i = 0; i < args.size(); ++i) {
-                as->put(string{heap_, index_string(i)}, args[i], property_attribute::dont_enum);
-            }
+    value_representation slow_binary_op(token_type op, const value_representation& lr, const value_representation& rr) {
+        auto l = lr.get_value(heap_);
+        auto r = rr.get_value(heap_);
+        return value_representation{do_binary_op(op, l, r)};
+    }
 
-            // Scope
-            auto activation = object::make(heap_, string{heap_, "Activation"}, nullptr); // TODO
-            auto_scope auto_scope_{*this, activation, prev_scope};
-            activation->put(string{heap_, "this"}, this_, property_attribute::dont_delete | property_attribute::dont_enum | property_attribute::read_only);
-            activation->put(string{heap_, "arguments"}, value{as}, property_attribute::dont_delete);
-            for (size_t i = 0; i < param_names.size(); ++i) {
-                activation->put(string{heap_, param_names[i]}, i < args.size() ? args[i] : value::undefined);
-            }
-            // Variables
-            for (const auto& id: ids) {
-                assert(!activation->has_property(id)); // TODO: Handle this..
-                activation->put(string{heap_, id}, value::undefined);
+    bool is_true(const value_representation& v) {
+        return v.is_boolean() ? v.boolean_value() : mjs::to_boolean(v.get_value(heap_));
+    }
+
+    object_ptr make_arguments(const object_ptr& callee, const value_span& args) {
+        auto as = arguments_object::make(heap_, Object_str_, global_->object_prototype(), args);
+        as->put(callee_str_, value{callee}, property_attribute::dont_enum);
+        as->put(length_str_, value{static_cast<double>(args.size())}, property_attribute::dont_enum);
+        return as;
+    }
+
+    const function_template& get_function_template(const function_definition& fd, const std::shared_ptr<const bytecode>& code) {
+        if (auto it = function_templates_.find(code.get()); it != function_templates_.end()) {
+            if (!it->second.code.expired()) {
+                return it->second;
             }
-            return eval(*block).result;
-        };
-        global_->put_function(callee, gc_function::make(heap_, func), string{heap_, L"function " + std::wstring{id.view()} + body_text}, static_cast<int>(param_names.size()));
+            function_templates_.erase(it);
+        }
+        prune_code_map(function_templates_, function_templates_prune_size_);
+        std::vector<string> params;
+        for (const auto& p: fd.params()) {
+            params.push_back(global_->intern(p));
+        }
+        return function_templates_.emplace(code.get(), function_template{code, global_->intern(fd.id()), std::move(params), string{heap_, L"function " + fd.id() + std::wstring{fd.body_extend().source_view()}}}).first->second;
+    }
+
+    // Creates a function object for the function definition 'fd' compiled to 'code' (see bytecode::function)
+    object_ptr create_function(const function_definition& fd, const std::shared_ptr<const bytecode>& code, const scope_ptr& prev_scope, const environment_ptr& env) {
+        // 15.3.2.1
+        const auto& t = get_function_template(fd, code);
+        auto callee = global_->make_raw_function();
+        native_function_type call;
+        if (code->declarations().dynamic_scope) {
+            assert(!env);
+            // Variables must be accessible by name, so keep them in an activation object (10.1.6)
+            call = gc_function::make(heap_, [this, block = fd.block_ptr(), params = &t.params, prev_scope, callee, code](const value& this_, const value_span& args) {
+                auto activation = object::make_with_root_shape(heap_, Activation_str_, activation_root_shape_);
+                activation->put(this_str_, this_, property_attribute::dont_delete | property_attribute::dont_enum | property_attribute::read_only);
+                const auto& decls = code->declarations();
+                if (decls.uses_arguments) {
+                    activation->put(arguments_str_, value{make_arguments(callee, args)}, property_attribute::dont_delete);
+                }
+                for (size_t i = 0; i < params->size(); ++i) {
+                    activation->put((*params)[i], i < args.size() ? args[i] : value::undefined);
+                }
+                // Variables
+                for (const auto& id: decls.ids) {
+                    if (!activation->has_property(id)) {
+                        activation->put(global_->intern(id), value::undefined);
+                    }
+                }
+                const auto c = run(*code, make_scope(activation, prev_scope), nullptr);
+                return c.type == completion_type::return_ ? c.result : value::undefined;
+            });
+        } else {
+            call = gc_function::make(heap_, [this, block = fd.block_ptr(), prev_scope, env, callee, code](const value& this_, const value_span& args) {
+                frame f{*this, *code, prev_scope, env};
+                // Only functions with variables nested functions might access need an environment of their own
+                if (const auto size = code->environment_size()) {
+                    f.env(environment::make(heap_, size, env));
+                }
+                value_representation* const r = f.registers();
+                const auto& params = code->param_locations();
+                for (size_t i = 0, n = std::min(params.size(), args.size()); i < n; ++i) {
+                    (params[i].in_environment ? f.env()->slot(params[i].index) : r[params[i].index]) = value_representation{args[i]};
+                }
+                r[code->this_register()] = value_representation{this_};
+                if (const auto a = code->arguments_register(); a != UINT32_MAX) {
+                    r[a] = value_representation{value{make_arguments(callee, args)}};
+                }
+                const auto c = run(f);
+                return c.type == completion_type::return_ ? c.result : value::undefined;
+            });
+        }
+        global_->put_function(callee, call, t.text, static_cast<int>(t.params.size()));
 
-        callee->construct_function(gc_function::make(heap_, [global = global_, callee, id](const value& this_, const std::vector<value>& args) {
+        callee->construct_function(gc_function::make(heap_, [this, callee, id = t.id](const value& this_, const value_span& args) {
             assert(this_.type() == value_type::undefined); (void)this_; // [[maybe_unused]] not working with MSVC here?
             assert(!id.view().empty());
-            auto p = callee->get(L"prototype");
-            auto o = value{object::make(global->heap(), id, p.type() == value_type::object ? p.object_value() : global->object_prototype())};
+            auto p = callee->get(prototype_str_);
+            auto o = value{object::make(heap_, id, p.type() == value_type::object ? p.object_value() : global_->object_prototype())};
             auto r = callee->call_function()->call(o, args);
             return r.type() == value_type::object ? r : value{o};
         }));
 
         return callee;
     }
-
-    object_ptr create_function(const function_definition& s, const scope_ptr& prev_scope) {
-        return create_function(string{heap_, s.id()}, s.block_ptr(), s.params(), std::wstring{s.body_extend().source_view()}, prev_scope);
-    }
 };
 
 interpreter::interpreter(gc_heap& h, const block_statement& program, const on_statement_executed_type& on_statement_executed) : impl_(new impl{h, program, on_statement_executed}) {
@@ -0,0 +1,62 @@
+#ifndef MJS_JIT_H
+#define MJS_JIT_H
+
+#include <memory>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace mjs {
+
+class bytecode;
+class value_representation;
+
+// Machine code compiled from bytecode by the baseline JIT (see jit_x64.cpp). Every instruction is translated on its own
+// using a fixed template. Numbers, booleans, moves and jumps are handled by the machine code, everything else (and
+// operands of other types) by calling back into the interpreter to run that one instruction.
+//
+// All values live in the registers of the frame (which are roots for the garbage collector). Loops may keep copies of
+// numbers in machine registers, but never anything the garbage collector needs to know about, so no stack maps are
+// needed and the calls back into the interpreter are the only places where garbage can be collected.
+class jit_code {
+public:
+    // Called to run the instruction with index 'index' (given the 'context' passed to run()), returns the index of the
+    // next instruction to run or UINT32_MAX if an exception was thrown. Exceptions mustn't propagate through compiled code.
+    using step_function = uint32_t (*)(void* context, uint32_t index);
+
+    ~jit_code();
+
+    jit_code(const jit_code&) = delete;
+    jit_code& operator=(const jit_code&) = delete;
+
+    // Runs the code with 'regs' as its registers until a return_ instruction is reached and returns its index (or UINT32_MAX
+    // if the step function reported an exception)
+    uint32_t run(void* context, value_representation* regs) const;
+
+private:
+    friend std::shared_ptr<const jit_code> jit_compile(const bytecode& bc, step_function step);
+
+    using entry_type = uint32_t (*)(void* context, value_representation* regs, const void* const* labels);
+
+    void* memory_ = nullptr;
+    size_t size_ = 0;
+    entry_type entry_ = nullptr;
+    std::unique_ptr<const void*[]> labels_; // Address of the machine code of each instruction
+
+    jit_code() = default;
+};
+
+// Compiles 'bc' (returns nullptr if the JIT isn't supported)
+std::shared_ptr<const jit_code> jit_compile(const bytecode& bc, jit_code::step_function step);
+
+// Returns true if the JIT can be used on this platform (x86-64 with the System V calling convention)
+bool jit_supported();
+
+// Returns true if code is compiled by the JIT before it's run (not the default)
+bool jit_enabled();
+
+// Enables (if supported) or disables the JIT for all interpreters, returns whether it's now enabled
+bool enable_jit(bool enable);
+
+} // namespace mjs
+
+#endif
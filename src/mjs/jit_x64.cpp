@@ -0,0 +1,983 @@
+#include "jit.h"
+#include "bytecode.h"
+#include "value.h"
+#include "value_representation.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <new>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define MJS_JIT_X64
+#include <sys/mman.h>
+#endif
+
+namespace mjs {
+
+namespace {
+
+bool jit_enabled_ = false;
+
+#ifdef MJS_JIT_X64
+
+enum reg : uint8_t { rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r8, r9, r10, r11, r12, r13, r14, r15 };
+enum xmm : uint8_t { xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7, xmm8, xmm9, xmm10, xmm11, xmm12, xmm13, xmm14, xmm15, no_xmm };
+
+enum condition : uint8_t { cc_b = 0x2, cc_ae = 0x3, cc_e = 0x4, cc_ne = 0x5, cc_be = 0x6, cc_a = 0x7, cc_p = 0xa, cc_np = 0xb, cc_le = 0xe };
+
+// Register usage of the generated code
+constexpr reg regs_reg = rbx;   // Registers of the frame
+constexpr reg context_reg = r12;// Context passed to the step function
+constexpr reg labels_reg = r13; // Address of the machine code of each instruction
+constexpr reg limit_reg = r14;  // Representations shifted left by one are numbers if below this
+
+uint64_t bits(double d) {
+    return value_representation{d}.raw();
+}
+
+// Just enough of an x86-64 assembler to emit the instruction templates. Memory operands are always registers of the
+// frame (addressed relative to regs_reg).
+class assembler {
+public:
+    using label = uint32_t;
+
+    const std::vector<uint8_t>& code() const { return code_; }
+    uint32_t offset(label l) const { assert(labels_[l] != unbound); return labels_[l]; }
+
+    label new_label() {
+        labels_.push_back(unbound);
+        return static_cast<label>(labels_.size() - 1);
+    }
+
+    void bind(label l) {
+        assert(labels_[l] == unbound);
+        labels_[l] = size();
+    }
+
+    // Resolves the references to labels, must be called after all labels have been bound
+    void finish() {
+        for (const auto& f: fixups_) {
+            const int32_t rel = static_cast<int32_t>(offset(f.target) - (f.pos + 4));
+            std::memcpy(&code_[f.pos], &rel, sizeof(rel));
+        }
+        fixups_.clear();
+    }
+
+    // mov r64, [frame register]
+    void load(reg r, uint32_t index) { mem(0, true, {0x8b}, r, index); }
+    // mov [frame register], r64
+    void store(uint32_t index, reg r) { mem(0, true, {0x89}, r, index); }
+    // movsd xmm, [frame register]
+    void load(xmm x, uint32_t index) { mem(0xf2, false, {0x0f, 0x10}, x, index); }
+    // movsd [frame register], xmm
+    void store(uint32_t index, xmm x) { mem(0xf2, false, {0x0f, 0x11}, x, index); }
+
+    void mov(reg dst, uint64_t imm) {
+        if (imm <= UINT32_MAX) {
+            rex(false, 0, dst);
+            byte(0xb8 + (dst & 7));
+            dword(static_cast<uint32_t>(imm));
+        } else {
+            rex(true, 0, dst);
+            byte(0xb8 + (dst & 7));
+            std::memcpy(grow(8), &imm, 8);
+        }
+    }
+    void mov(reg dst, reg src) { rr(0, true, {0x89}, src, dst); }
+    void mov32(reg dst, reg src) { rr(0, false, {0x89}, src, dst); }
+    void movapd(xmm dst, xmm src) { rr(0x66, false, {0x0f, 0x28}, dst, src); }
+    void movq(xmm dst, reg src) { rr(0x66, true, {0x0f, 0x6e}, dst, src); }
+    void movq(reg dst, xmm src) { rr(0x66, true, {0x0f, 0x7e}, src, dst); }
+
+    void addsd(xmm dst, xmm src) { rr(0xf2, false, {0x0f, 0x58}, dst, src); }
+    void subsd(xmm dst, xmm src) { rr(0xf2, false, {0x0f, 0x5c}, dst, src); }
+    void mulsd(xmm dst, xmm src) { rr(0xf2, false, {0x0f, 0x59}, dst, src); }
+    void divsd(xmm dst, xmm src) { rr(0xf2, false, {0x0f, 0x5e}, dst, src); }
+    void ucomisd(xmm a, xmm b) { rr(0x66, false, {0x0f, 0x2e}, a, b); }
+    void cvttsd2si(reg dst, xmm src) { rr(0xf2, true, {0x0f, 0x2c}, dst, src); }
+    void cvttsd2si32(reg dst, xmm src) { rr(0xf2, false, {0x0f, 0x2c}, dst, src); }
+    void cvtsi2sd32(xmm dst, reg src) { rr(0xf2, false, {0x0f, 0x2a}, dst, src); }
+    void cvtsi2sd64(xmm dst, reg src) { rr(0xf2, true, {0x0f, 0x2a}, dst, src); }
+
+    void and32(reg dst, reg src) { rr(0, false, {0x21}, src, dst); }
+    void or32(reg dst, reg src) { rr(0, false, {0x09}, src, dst); }
+    void xor32(reg dst, reg src) { rr(0, false, {0x31}, src, dst); }
+    void and8(reg dst, reg src) { rr(0, false, {0x20}, src, dst); }
+    void or8(reg dst, reg src) { rr(0, false, {0x08}, src, dst); }
+    void and64(reg dst, reg src) { rr(0, true, {0x21}, src, dst); }
+    void add64(reg dst, reg src) { rr(0, true, {0x01}, src, dst); }
+    void or64(reg dst, reg src) { rr(0, true, {0x09}, src, dst); }
+    void xor64(reg dst, reg src) { rr(0, true, {0x31}, src, dst); }
+    void cmp64(reg a, reg b) { rr(0, true, {0x39}, b, a); }
+    void and32(reg dst, uint32_t imm) { rr(0, false, {0x81}, 4, dst); dword(imm); }
+    void cmp32(reg a, uint32_t imm) { rr(0, false, {0x81}, 7, a); dword(imm); }
+    void shr64(reg dst, uint8_t n) { rr(0, true, {0xc1}, 5, dst); byte(n); }
+    void shl32_cl(reg dst) { rr(0, false, {0xd3}, 4, dst); }
+    void shr32_cl(reg dst) { rr(0, false, {0xd3}, 5, dst); }
+    void sar32_cl(reg dst) { rr(0, false, {0xd3}, 7, dst); }
+    void idiv32(reg r) { rr(0, false, {0xf7}, 7, r); }
+    void cdq() { byte(0x99); }
+    void not32(reg dst) { rr(0, false, {0xf7}, 2, dst); }
+    void setcc(condition cc, reg dst) { rr(0, false, {0x0f, static_cast<uint8_t>(0x90 + cc)}, 0, dst); }
+    void movzx8(reg dst, reg src) { rr(0, false, {0x0f, 0xb6}, dst, src); }
+
+    void push(reg r) { rex(false, 0, r); byte(0x50 + (r & 7)); }
+    void pop(reg r) { rex(false, 0, r); byte(0x58 + (r & 7)); }
+    void ret() { byte(0xc3); }
+    void sub_rsp(uint8_t n) { rr(0, true, {0x83}, 5, rsp); byte(n); }
+    void add_rsp(uint8_t n) { rr(0, true, {0x83}, 0, rsp); byte(n); }
+    void call(reg r) { rr(0, false, {0xff}, 2, r); }
+
+    void jmp(label l) { byte(0xe9); ref(l); }
+    void jcc(condition cc, label l) { byte(0x0f); byte(0x80 + cc); ref(l); }
+
+    // jmp [labels_reg + index*8]
+    void jmp_table(reg index) {
+        static_assert(labels_reg == r13);
+        assert(index < r8);
+        byte(0x41);
+        byte(0xff);
+        byte(0x64);                 // mod=01 (disp8), reg=4 (jmp), rm=100 (SIB)
+        byte(0xc0 | index << 3 | 5);// scale=8, base=r13
+        byte(0);
+    }
+
+private:
+    static constexpr uint32_t unbound = UINT32_MAX;
+    struct fixup {
+        uint32_t pos;
+        label target;
+    };
+    std::vector<uint8_t> code_;
+    std::vector<uint32_t> labels_;
+    std::vector<fixup> fixups_;
+
+    uint32_t size() const { return static_cast<uint32_t>(code_.size()); }
+
+    uint8_t* grow(size_t n) {
+        code_.resize(code_.size() + n);
+        return &code_[code_.size() - n];
+    }
+
+    void byte(uint32_t b) { code_.push_back(static_cast<uint8_t>(b)); }
+    void dword(uint32_t d) { std::memcpy(grow(4), &d, 4); }
+
+    void ref(label l) {
+        fixups_.push_back(fixup{size(), l});
+        dword(0);
+    }
+
+    void rex(bool w, uint32_t r, uint32_t b) {
+        const uint8_t prefix = 0x40 | w << 3 | (r >> 3) << 2 | b >> 3;
+        // (Byte registers other than al-bl would also need one, but they are never used)
+        if (prefix != 0x40) {
+            byte(prefix);
+        }
+    }
+
+    void opcode(uint8_t prefix, bool w, std::initializer_list<uint8_t> op, uint32_t r, uint32_t b) {
+        if (prefix) {
+            byte(prefix);
+        }
+        rex(w, r, b);
+        for (const auto o: op) {
+            byte(o);
+        }
+    }
+
+    // Register (or opcode extension) 'r' and register 'm'
+    void rr(uint8_t prefix, bool w, std::initializer_list<uint8_t> op, uint32_t r, uint32_t m) {
+        opcode(prefix, w, op, r, m);
+        byte(0xc0 | (r & 7) << 3 | (m & 7));
+    }
+
+    // Register 'r' and frame register 'index'
+    void mem(uint8_t prefix, bool w, std::initializer_list<uint8_t> op, uint32_t r, uint32_t index) {
+        opcode(prefix, w, op, r, regs_reg);
+        byte(0x80 | (r & 7) << 3 | regs_reg);
+        dword(index * static_cast<uint32_t>(sizeof(value_representation)));
+    }
+};
+
+// Innermost loops get a second copy of their code, which keeps the frame registers that only hold numbers in the loop
+// in xmm registers (as well as in the frame, so the rest of the code and the interpreter can use the frame as usual).
+// The copy is entered from the loop head of the normal code once the registers it reads before writing them hold
+// numbers, and left for the normal code whenever an instruction's operands aren't handled or it jumps out of the loop.
+struct loop {
+    uint32_t start;                     // First instruction (the target of the backward jump)
+    uint32_t end;                       // Last instruction
+    std::vector<uint32_t> cached;       // Frame register kept in xmm register first_cache_xmm + i
+    uint32_t live_in = 0;               // Mask of the cached registers that must hold numbers when entering
+    std::vector<assembler::label> labels; // Labels of the instructions in the copy
+};
+
+constexpr uint32_t first_cache_xmm = xmm2;
+constexpr uint32_t max_cached = xmm14 - first_cache_xmm + 1;
+constexpr xmm scratch_xmm = xmm15;
+
+bool is_compare_jump(opcode op) {
+    return op == opcode::jump_if_lt || op == opcode::jump_if_le || op == opcode::jump_if_gt || op == opcode::jump_if_ge;
+}
+
+// Instructions followed by a data instruction
+bool has_data(opcode op) {
+    return is_compare_jump(op) || op == opcode::call || op == opcode::construct || op == opcode::for_in_next;
+}
+
+// Instructions that either store a number in register a or leave the loop
+bool produces_number(opcode op) {
+    switch (op) {
+    case opcode::load_number:
+    case opcode::add: case opcode::sub: case opcode::mul: case opcode::div: case opcode::mod:
+    case opcode::shl: case opcode::sar: case opcode::shr: case opcode::bit_and: case opcode::bit_xor: case opcode::bit_or:
+    case opcode::add_number: case opcode::sub_number: case opcode::mul_number: case opcode::bit_and_number:
+    case opcode::plus: case opcode::neg: case opcode::bit_not: case opcode::inc: case opcode::dec:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Calls 'f' for each register 'i' writes
+template<typename F>
+void for_each_write(const instruction& i, F f) {
+    switch (i.op) {
+    case opcode::nop: case opcode::data: case opcode::put_name: case opcode::put_slot: case opcode::put_member: case opcode::put_element:
+    case opcode::jump_if_lt: case opcode::jump_if_le: case opcode::jump_if_gt: case opcode::jump_if_ge:
+    case opcode::jump: case opcode::jump_if_true: case opcode::jump_if_false: case opcode::define_function:
+    case opcode::enter_with: case opcode::leave_with: case opcode::for_in_start: case opcode::invalid_reference:
+    case opcode::statement_executed: case opcode::return_:
+        break;
+    case opcode::get_name_this: case opcode::get_member_this: case opcode::get_element_this:
+        f(i.a);
+        f(i.a + 1);
+        break;
+    default:
+        f(i.a);
+    }
+}
+
+// Calls 'f' for each register the template for 'i' reads as a number
+template<typename F>
+void for_each_number_read(const instruction& i, F f) {
+    switch (i.op) {
+    case opcode::add: case opcode::sub: case opcode::mul: case opcode::div: case opcode::mod:
+    case opcode::shl: case opcode::sar: case opcode::shr: case opcode::bit_and: case opcode::bit_xor: case opcode::bit_or:
+    case opcode::lt: case opcode::le: case opcode::gt: case opcode::ge: case opcode::eq: case opcode::ne:
+        f(i.b);
+        f(i.c);
+        break;
+    case opcode::add_number: case opcode::sub_number: case opcode::mul_number: case opcode::bit_and_number:
+    case opcode::plus: case opcode::neg: case opcode::bit_not: case opcode::inc: case opcode::dec: case opcode::move:
+        f(i.b);
+        break;
+    case opcode::jump_if_lt: case opcode::jump_if_le: case opcode::jump_if_gt: case opcode::jump_if_ge:
+        f(i.a);
+        if (!(i.x & 2)) {
+            f(i.b);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+class compiler {
+public:
+    explicit compiler(const bytecode& bc, jit_code::step_function step) : bc_(bc), step_(step) {
+        for (uint32_t i = 0; i < bc_.code_size(); ++i) {
+            instruction_labels_.push_back(a_.new_label());
+        }
+        dispatch_ = a_.new_label();
+        epilogue_ = a_.new_label();
+    }
+
+    const assembler& compile() {
+        a_.push(rbx);
+        a_.push(context_reg);
+        a_.push(labels_reg);
+        a_.push(limit_reg);
+        a_.sub_rsp(8); // Keep the stack aligned for calls
+        a_.mov(limit_reg, uint64_t{value_representation::max_number_tag() + 1} << 49);
+        a_.mov(context_reg, rdi);
+        a_.mov(regs_reg, rsi);
+        a_.mov(labels_reg, rdx);
+
+        auto loops = find_loops();
+        for (auto& l: loops) {
+            for (uint32_t index = l.start; index <= l.end; ++index) {
+                l.labels.push_back(a_.new_label());
+            }
+        }
+        auto next_loop = loops.begin();
+        const instruction* const code = bc_.code();
+        for (uint32_t index = 0; index < bc_.code_size(); ++index) {
+            a_.bind(instruction_labels_[index]);
+            if (next_loop != loops.end() && next_loop->start == index) {
+                enter_loop(*next_loop++);
+            }
+            if (code[index].op != opcode::data) {
+                instruction_template(index, code[index]);
+            }
+        }
+
+        for (const auto& l: loops) {
+            loop_code(l);
+        }
+
+        // Operands the templates don't handle: let the interpreter run the instruction and continue where it says
+        for (const auto& s: slow_paths_) {
+            a_.bind(s.l);
+            step(s.index);
+            a_.jmp(dispatch_);
+        }
+
+        a_.bind(dispatch_);
+        a_.cmp32(rax, UINT32_MAX);
+        a_.jcc(cc_e, epilogue_);
+        a_.mov32(rax, rax);
+        a_.jmp_table(rax);
+
+        a_.bind(epilogue_);
+        a_.add_rsp(8);
+        a_.pop(limit_reg);
+        a_.pop(labels_reg);
+        a_.pop(context_reg);
+        a_.pop(rbx);
+        a_.ret();
+
+        a_.finish();
+        return a_;
+    }
+
+    uint32_t label_offset(uint32_t index) const { return a_.offset(instruction_labels_[index]); }
+
+private:
+    struct slow_path {
+        assembler::label l;
+        uint32_t index;
+    };
+
+    const bytecode& bc_;
+    jit_code::step_function step_;
+    assembler a_;
+    std::vector<assembler::label> instruction_labels_;
+    std::vector<slow_path> slow_paths_;
+    assembler::label dispatch_;
+    assembler::label epilogue_;
+    const loop* loop_ = nullptr; // While emitting the copy of a loop
+
+    // Returns the target of 'index' if it's a backward jump (otherwise UINT32_MAX)
+    uint32_t backward_target(uint32_t index) const {
+        const auto& i = bc_.code()[index];
+        uint32_t target = UINT32_MAX;
+        if (i.op == opcode::jump || i.op == opcode::jump_if_true || i.op == opcode::jump_if_false) {
+            target = i.bc();
+        } else if (is_compare_jump(i.op)) {
+            target = bc_.code()[index + 1].bc();
+        }
+        return target <= index ? target : UINT32_MAX;
+    }
+
+    // Successors of instruction 'index' (only the ones inside the loop are used)
+    template<typename F>
+    void for_each_successor(uint32_t index, F f) const {
+        const auto& i = bc_.code()[index];
+        switch (i.op) {
+        case opcode::jump:
+            f(i.bc());
+            break;
+        case opcode::jump_if_true: case opcode::jump_if_false:
+            f(i.bc());
+            f(index + 1);
+            break;
+        case opcode::jump_if_lt: case opcode::jump_if_le: case opcode::jump_if_gt: case opcode::jump_if_ge: case opcode::for_in_next:
+            f(bc_.code()[index + 1].bc());
+            f(index + 2);
+            break;
+        case opcode::return_: case opcode::invalid_reference:
+            break;
+        default:
+            f(index + (has_data(i.op) ? 2 : 1));
+        }
+    }
+
+    std::vector<loop> find_loops() const {
+        std::vector<loop> loops;
+        const instruction* const code = bc_.code();
+        uint32_t last_backward_jump = UINT32_MAX;
+        for (uint32_t index = 0; index < bc_.code_size(); ++index) {
+            const uint32_t target = backward_target(index);
+            if (target == UINT32_MAX) {
+                continue;
+            }
+            // Only innermost loops
+            const bool innermost = last_backward_jump == UINT32_MAX || last_backward_jump < target;
+            last_backward_jump = index;
+            if (!innermost) {
+                continue;
+            }
+            loop l;
+            l.start = target;
+            l.end = index + (has_data(code[index].op) ? 1 : 0);
+            if (l.end + 1 < bc_.code_size() && choose_cached(l)) {
+                loops.push_back(std::move(l));
+            }
+        }
+        return loops;
+    }
+
+    // Chooses the registers to keep in xmm registers in 'l', returns false if there are none
+    bool choose_cached(loop& l) const {
+        enum { unused, candidate, excluded };
+        const instruction* const code = bc_.code();
+        std::vector<uint8_t> state(bc_.register_count(), unused);
+        std::vector<uint32_t> uses(bc_.register_count());
+        for (uint32_t index = l.start; index <= l.end; ++index) {
+            const auto& i = code[index];
+            for_each_number_read(i, [&](uint32_t r) {
+                ++uses[r];
+                if (state[r] == unused) {
+                    state[r] = candidate;
+                }
+            });
+            for_each_write(i, [&](uint32_t r) {
+                ++uses[r];
+                if (!produces_number(i.op) && i.op != opcode::move) {
+                    state[r] = excluded;
+                } else if (state[r] == unused) {
+                    state[r] = candidate;
+                }
+            });
+        }
+        // Moves only produce numbers if their source does
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (uint32_t index = l.start; index <= l.end; ++index) {
+                const auto& i = code[index];
+                if (i.op == opcode::move && state[i.b] != candidate && state[i.a] == candidate) {
+                    state[i.a] = excluded;
+                    changed = true;
+                }
+            }
+        }
+        for (uint32_t r = 0; r < bc_.register_count(); ++r) {
+            if (state[r] == candidate) {
+                l.cached.push_back(r);
+            }
+        }
+        if (l.cached.empty()) {
+            return false;
+        }
+        std::stable_sort(l.cached.begin(), l.cached.end(), [&](uint32_t x, uint32_t y) { return uses[x] > uses[y]; });
+        if (l.cached.size() > max_cached) {
+            l.cached.resize(max_cached);
+        }
+
+        // Find the cached registers that might be read before they're written (they're only checked when entering)
+        auto mask = [&](uint32_t r) {
+            const auto it = std::find(l.cached.begin(), l.cached.end(), r);
+            return it == l.cached.end() ? 0 : 1U << (it - l.cached.begin());
+        };
+        std::vector<uint32_t> live(l.end - l.start + 1);
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (uint32_t index = l.end + 1; index-- > l.start;) {
+                const auto& i = code[index];
+                if (i.op == opcode::data) {
+                    continue;
+                }
+                uint32_t out = 0;
+                for_each_successor(index, [&](uint32_t s) {
+                    if (s >= l.start && s <= l.end) {
+                        out |= live[s - l.start];
+                    }
+                });
+                uint32_t in = out;
+                for_each_write(i, [&](uint32_t r) { in &= ~mask(r); });
+                for_each_number_read(i, [&](uint32_t r) { in |= mask(r); });
+                if (in != live[index - l.start]) {
+                    live[index - l.start] = in;
+                    changed = true;
+                }
+            }
+        }
+        l.live_in = live[0];
+        return true;
+    }
+
+    // Entry to the copy of 'l' from the loop head of the normal code
+    void enter_loop(const loop& l) {
+        const auto not_numbers = a_.new_label();
+        for (uint32_t n = 0; n < l.cached.size(); ++n) {
+            if (l.live_in & (1U << n)) {
+                a_.load(rax, l.cached[n]);
+                check_number(rax, not_numbers);
+            }
+        }
+        reload_cached(l);
+        a_.jmp(l.labels[0]);
+        a_.bind(not_numbers);
+    }
+
+    void loop_code(const loop& l) {
+        loop_ = &l;
+        const instruction* const code = bc_.code();
+        for (uint32_t index = l.start; index <= l.end; ++index) {
+            a_.bind(l.labels[index - l.start]);
+            if (code[index].op != opcode::data) {
+                instruction_template(index, code[index]);
+            }
+        }
+        a_.jmp(instruction_labels_[l.end + 1]);
+        loop_ = nullptr;
+    }
+
+    // The xmm register holding frame register 'index' (or no_xmm)
+    xmm cached(uint32_t index) const {
+        if (loop_) {
+            for (uint32_t n = 0; n < loop_->cached.size(); ++n) {
+                if (loop_->cached[n] == index) {
+                    return static_cast<xmm>(first_cache_xmm + n);
+                }
+            }
+        }
+        return no_xmm;
+    }
+
+    void reload_cached(const loop& l) {
+        for (uint32_t n = 0; n < l.cached.size(); ++n) {
+            a_.load(static_cast<xmm>(first_cache_xmm + n), l.cached[n]);
+        }
+    }
+
+    // Where to jump to reach instruction 'index'
+    assembler::label target(uint32_t index) const {
+        return loop_ && index >= loop_->start && index <= loop_->end ? loop_->labels[index - loop_->start] : instruction_labels_[index];
+    }
+
+    assembler::label slow(uint32_t index) {
+        const auto l = a_.new_label();
+        slow_paths_.push_back(slow_path{l, index});
+        return l;
+    }
+
+    // eax = step(context, index)
+    void step(uint32_t index) {
+        a_.mov(rdi, context_reg);
+        a_.mov(rsi, index);
+        a_.mov(rax, reinterpret_cast<uint64_t>(step_));
+        a_.call(rax);
+    }
+
+    // Let the interpreter run the instruction and continue with the next one unless it says otherwise
+    void step(uint32_t index, uint32_t next) {
+        step(index);
+        a_.cmp32(rax, next);
+        a_.jcc(cc_ne, dispatch_);
+        if (loop_) {
+            reload_cached(*loop_); // Not preserved by calls
+        }
+    }
+
+    // Jump to 'l' unless 'r' holds a number (clobbers rcx)
+    void check_number(reg r, assembler::label l) {
+        a_.mov(rcx, r);
+        a_.add64(rcx, rcx); // Ignore the sign
+        a_.cmp64(rcx, limit_reg);
+        a_.jcc(cc_ae, l);
+    }
+
+    // Returns the xmm register holding the number in frame register 'index' (loading it into 'x' unless it's cached,
+    // clobbers rax and rcx)
+    xmm number_operand(xmm x, uint32_t index, assembler::label l) {
+        if (const auto c = cached(index); c != no_xmm) {
+            return c;
+        }
+        a_.load(rax, index);
+        check_number(rax, l);
+        // Loading it again is faster than moving it from rax
+        a_.load(x, index);
+        return x;
+    }
+
+    // xmm0 = number in frame register 'index'
+    void load_number(uint32_t index, assembler::label l) {
+        if (const auto x = number_operand(xmm0, index, l); x != xmm0) {
+            a_.movapd(xmm0, x);
+        }
+    }
+
+    void load_constant(xmm x, double d) {
+        a_.mov(rax, bits(d));
+        a_.movq(x, rax);
+    }
+
+    // Frame register 'index' = xmm0 (with NaNs canonicalized like value_representation does)
+    void store_number(uint32_t index) {
+        const auto done = a_.new_label();
+        a_.ucomisd(xmm0, xmm0);
+        a_.jcc(cc_np, done);
+        load_constant(xmm0, NAN);
+        a_.bind(done);
+        store_canonical(index, xmm0);
+    }
+
+    // Frame register 'index' = x, which holds a number in its canonical representation
+    void store_canonical(uint32_t index, xmm x) {
+        a_.store(index, x);
+        if (const auto c = cached(index); c != no_xmm && c != x) {
+            a_.movapd(c, x);
+        }
+    }
+
+    // Frame register 'index' = the representation in rax
+    void store(uint32_t index) {
+        a_.store(index, rax);
+        if (const auto c = cached(index); c != no_xmm) {
+            a_.movq(c, rax);
+        }
+    }
+
+    // r = x if it holds an integer that fits in 32 bits
+    void to_exact_int32(reg r, xmm x, assembler::label l) {
+        a_.cvttsd2si32(r, x);
+        a_.cvtsi2sd32(scratch_xmm, r);
+        a_.ucomisd(scratch_xmm, x);
+        a_.jcc(cc_ne, l);
+        a_.jcc(cc_p, l);
+    }
+
+    // eax = ToInt32(xmm) if it can be done without calling out (clobbers rcx)
+    void convert_to_int32(xmm x, assembler::label l) {
+        a_.cvttsd2si(rax, x);
+        a_.mov(rcx, uint64_t{1} << 63); // The result for NaNs and numbers out of range
+        a_.cmp64(rax, rcx);
+        a_.jcc(cc_e, l);
+    }
+
+    void store_boolean(uint32_t index) {
+        a_.movzx8(rax, rax);
+        a_.mov(rcx, value_representation::boolean(false).raw());
+        a_.or64(rax, rcx);
+        store(index);
+    }
+
+    // Sets the flags for comparing the numbers in 'l' and 'r' using the condition for a (non-negated) comparison
+    // (NaNs compare unordered, which sets CF, ZF and PF, so the conditions are chosen to be false then)
+    condition compare(opcode op, xmm l, xmm r) {
+        switch (op) {
+        case opcode::lt: case opcode::jump_if_lt: a_.ucomisd(r, l); return cc_a;
+        case opcode::le: case opcode::jump_if_le: a_.ucomisd(r, l); return cc_ae;
+        case opcode::gt: case opcode::jump_if_gt: a_.ucomisd(l, r); return cc_a;
+        case opcode::ge: case opcode::jump_if_ge: a_.ucomisd(l, r); return cc_ae;
+        default:
+            assert(false);
+            return cc_e;
+        }
+    }
+
+    static condition negate(condition cc) {
+        return static_cast<condition>(cc ^ 1);
+    }
+
+    void instruction_template(uint32_t index, const instruction& i) {
+        switch (i.op) {
+        case opcode::nop:
+            break;
+        case opcode::load_undefined:
+            a_.mov(rax, value_representation::undefined().raw());
+            store(i.a);
+            break;
+        case opcode::load_null:
+            a_.mov(rax, value_representation{value::null}.raw());
+            store(i.a);
+            break;
+        case opcode::load_boolean:
+            a_.mov(rax, value_representation::boolean(i.x != 0).raw());
+            store(i.a);
+            break;
+        case opcode::load_number:
+            a_.mov(rax, bits(bc_.number(i.bc())));
+            store(i.a);
+            break;
+        case opcode::move:
+            if (const auto c = cached(i.b); c != no_xmm) {
+                store_canonical(i.a, c);
+            } else {
+                a_.load(rax, i.b);
+                store(i.a);
+            }
+            break;
+        case opcode::add: case opcode::sub: case opcode::mul: case opcode::div:
+        case opcode::add_number: case opcode::sub_number: case opcode::mul_number: {
+            const auto l = slow(index);
+            load_number(i.b, l);
+            xmm rhs = xmm1;
+            if (i.op == opcode::add_number || i.op == opcode::sub_number || i.op == opcode::mul_number) {
+                load_constant(xmm1, bc_.number(i.c));
+            } else {
+                rhs = number_operand(xmm1, i.c, l);
+            }
+            switch (i.op) {
+            case opcode::add: case opcode::add_number: a_.addsd(xmm0, rhs); break;
+            case opcode::sub: case opcode::sub_number: a_.subsd(xmm0, rhs); break;
+            case opcode::mul: case opcode::mul_number: a_.mulsd(xmm0, rhs); break;
+            default: a_.divsd(xmm0, rhs); break;
+            }
+            store_number(i.a);
+            break;
+        }
+        case opcode::mod: {
+            const auto l = slow(index);
+            if (const auto rhs = number_operand(xmm1, i.c, l); rhs != xmm1) {
+                a_.movapd(xmm1, rhs);
+            }
+            load_number(i.b, l);
+            // Use an integer division if both operands are positive integers (0 and -0 need fmod to get the sign right)
+            const auto use_fmod = a_.new_label(), done = a_.new_label();
+            to_exact_int32(rax, xmm0, use_fmod);
+            to_exact_int32(rcx, xmm1, use_fmod);
+            a_.cmp32(rax, 0);
+            a_.jcc(cc_le, use_fmod);
+            a_.cmp32(rcx, 0);
+            a_.jcc(cc_le, use_fmod);
+            a_.cdq();
+            a_.idiv32(rcx);
+            a_.cvtsi2sd32(xmm0, rdx);
+            store_canonical(i.a, xmm0);
+            a_.jmp(done);
+            // fmod doesn't touch the heap, so can be called directly
+            a_.bind(use_fmod);
+            a_.mov(rax, reinterpret_cast<uint64_t>(static_cast<double (*)(double, double)>(&std::fmod)));
+            a_.call(rax);
+            if (loop_) {
+                reload_cached(*loop_);
+            }
+            store_number(i.a);
+            a_.bind(done);
+            break;
+        }
+        case opcode::shl: case opcode::sar: case opcode::shr:
+        case opcode::bit_and: case opcode::bit_xor: case opcode::bit_or: {
+            const auto l = slow(index);
+            const auto rhs = number_operand(xmm1, i.c, l);
+            const auto lhs = number_operand(xmm0, i.b, l);
+            convert_to_int32(rhs, l);
+            a_.mov(rdx, rax);
+            convert_to_int32(lhs, l);
+            switch (i.op) {
+            case opcode::shl: a_.mov(rcx, rdx); a_.shl32_cl(rax); break;
+            case opcode::sar: a_.mov(rcx, rdx); a_.sar32_cl(rax); break;
+            case opcode::shr: a_.mov(rcx, rdx); a_.shr32_cl(rax); break;
+            case opcode::bit_and: a_.and32(rax, rdx); break;
+            case opcode::bit_xor: a_.xor32(rax, rdx); break;
+            default: a_.or32(rax, rdx); break;
+            }
+            if (i.op == opcode::shr) {
+                a_.mov32(rax, rax);
+                a_.cvtsi2sd64(xmm0, rax);
+            } else {
+                a_.cvtsi2sd32(xmm0, rax);
+            }
+            store_canonical(i.a, xmm0);
+            break;
+        }
+        case opcode::bit_and_number: {
+            const auto l = slow(index);
+            convert_to_int32(number_operand(xmm0, i.b, l), l);
+            a_.and32(rax, static_cast<uint32_t>(to_int32(bc_.number(i.c))));
+            a_.cvtsi2sd32(xmm0, rax);
+            store_canonical(i.a, xmm0);
+            break;
+        }
+        case opcode::lt: case opcode::le: case opcode::gt: case opcode::ge: case opcode::eq: case opcode::ne: {
+            const auto l = slow(index);
+            const auto lhs = number_operand(xmm0, i.b, l);
+            const auto rhs = number_operand(xmm1, i.c, l);
+            if (i.op == opcode::eq) {
+                a_.ucomisd(lhs, rhs);
+                a_.setcc(cc_e, rax);
+                a_.setcc(cc_np, rcx);
+                a_.and8(rax, rcx);
+            } else if (i.op == opcode::ne) {
+                a_.ucomisd(lhs, rhs);
+                a_.setcc(cc_ne, rax);
+                a_.setcc(cc_p, rcx);
+                a_.or8(rax, rcx);
+            } else {
+                a_.setcc(compare(i.op, lhs, rhs), rax);
+            }
+            store_boolean(i.a);
+            break;
+        }
+        case opcode::jump_if_lt: case opcode::jump_if_le: case opcode::jump_if_gt: case opcode::jump_if_ge: {
+            const auto l = slow(index);
+            const auto lhs = number_operand(xmm0, i.a, l);
+            xmm rhs = xmm1;
+            if (i.x & 2) {
+                load_constant(xmm1, bc_.number(i.b));
+            } else {
+                rhs = number_operand(xmm1, i.b, l);
+            }
+            const auto cc = compare(i.op, lhs, rhs);
+            a_.jcc(i.x & 1 ? cc : negate(cc), target(bc_.code()[index + 1].bc()));
+            break;
+        }
+        case opcode::plus: {
+            const auto l = slow(index);
+            if (const auto c = cached(i.b); c != no_xmm) {
+                store_canonical(i.a, c);
+            } else {
+                a_.load(rax, i.b);
+                check_number(rax, l);
+                store(i.a);
+            }
+            break;
+        }
+        case opcode::neg: {
+            const auto l = slow(index);
+            load_number(i.b, l);
+            a_.movq(rax, xmm0);
+            a_.mov(rcx, uint64_t{1} << 63);
+            a_.xor64(rax, rcx);
+            a_.movq(xmm0, rax);
+            store_number(i.a);
+            break;
+        }
+        case opcode::inc: case opcode::dec: {
+            const auto l = slow(index);
+            load_number(i.b, l);
+            load_constant(xmm1, 1);
+            if (i.op == opcode::inc) {
+                a_.addsd(xmm0, xmm1);
+            } else {
+                a_.subsd(xmm0, xmm1);
+            }
+            store_number(i.a);
+            break;
+        }
+        case opcode::bit_not: {
+            const auto l = slow(index);
+            convert_to_int32(number_operand(xmm0, i.b, l), l);
+            a_.not32(rax);
+            a_.cvtsi2sd32(xmm0, rax);
+            store_canonical(i.a, xmm0);
+            break;
+        }
+        case opcode::not_: {
+            const auto l = slow(index);
+            a_.load(rax, i.b);
+            a_.mov(rcx, ~uint64_t{1});
+            a_.and64(rcx, rax);
+            a_.mov(rdx, value_representation::boolean(false).raw());
+            a_.cmp64(rcx, rdx);
+            a_.jcc(cc_ne, l);
+            a_.mov(rcx, 1);
+            a_.xor64(rax, rcx);
+            store(i.a);
+            break;
+        }
+        case opcode::jump:
+            a_.jmp(target(i.bc()));
+            break;
+        case opcode::jump_if_true: case opcode::jump_if_false: {
+            const bool sense = i.op == opcode::jump_if_true;
+            a_.load(rax, i.a);
+            a_.mov(rcx, value_representation::boolean(sense).raw());
+            a_.cmp64(rax, rcx);
+            a_.jcc(cc_e, target(i.bc()));
+            a_.mov(rcx, value_representation::boolean(!sense).raw());
+            a_.cmp64(rax, rcx);
+            a_.jcc(cc_ne, slow(index));
+            break;
+        }
+        case opcode::return_:
+            a_.mov(rax, index);
+            a_.jmp(epilogue_);
+            break;
+        case opcode::call: case opcode::construct: case opcode::for_in_next:
+            step(index, index + 2);
+            break;
+        default:
+            step(index, index + 1);
+            break;
+        }
+    }
+};
+
+#endif
+
+} // unnamed namespace
+
+#ifdef MJS_JIT_X64
+
+jit_code::~jit_code() {
+    if (memory_) {
+        munmap(memory_, size_);
+    }
+}
+
+uint32_t jit_code::run(void* context, value_representation* regs) const {
+    return entry_(context, regs, labels_.get());
+}
+
+std::shared_ptr<const jit_code> jit_compile(const bytecode& bc, jit_code::step_function step) {
+    compiler c{bc, step};
+    const auto& code = c.compile().code();
+
+    std::shared_ptr<jit_code> res{new jit_code{}};
+    res->size_ = code.size();
+    void* const memory = mmap(nullptr, res->size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc{};
+    }
+    res->memory_ = memory;
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, res->size_, PROT_READ | PROT_EXEC) != 0) {
+        throw std::bad_alloc{};
+    }
+
+    const auto base = static_cast<const uint8_t*>(memory);
+    res->entry_ = reinterpret_cast<jit_code::entry_type>(const_cast<uint8_t*>(base));
+    res->labels_.reset(new const void*[bc.code_size()]);
+    for (uint32_t i = 0; i < bc.code_size(); ++i) {
+        res->labels_[i] = base + c.label_offset(i);
+    }
+    return res;
+}
+
+bool jit_supported() {
+    return true;
+}
+
+#else
+
+jit_code::~jit_code() = default;
+
+uint32_t jit_code::run(void*, value_representation*) const {
+    return UINT32_MAX;
+}
+
+std::shared_ptr<const jit_code> jit_compile(const bytecode&, jit_code::step_function) {
+    return nullptr;
+}
+
+bool jit_supported() {
+    return false;
+}
+
+#endif
+
+bool jit_enabled() {
+    return jit_enabled_;
+}
+
+bool enable_jit(bool enable) {
+    jit_enabled_ = enable && jit_supported();
+    return jit_enabled_;
+}
+
+} // namespace mjs
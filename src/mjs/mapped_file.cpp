@@ -0,0 +1,68 @@
+#include "mapped_file.h"
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace mjs {
+
+#ifndef _WIN32
+
+namespace {
+
+[[noreturn]] void throw_error(const char* what, const std::string& path) {
+    throw std::runtime_error(std::string{what} + " " + path + ": " + std::strerror(errno));
+}
+
+class file_descriptor {
+public:
+    explicit file_descriptor(int fd) : fd_(fd) {}
+    ~file_descriptor() { if (fd_ >= 0) close(fd_); }
+    file_descriptor(const file_descriptor&) = delete;
+    file_descriptor& operator=(const file_descriptor&) = delete;
+
+    int get() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+} // unnamed namespace
+
+mapped_file map_file(const std::string& path) {
+    const file_descriptor fd{open(path.c_str(), O_RDONLY)};
+    if (fd.get() < 0) {
+        throw_error("Could not open", path);
+    }
+    struct stat st;
+    if (fstat(fd.get(), &st) != 0) {
+        throw_error("Could not get size of", path);
+    }
+    const auto size = static_cast<uint64_t>(st.st_size);
+    if (!size) {
+        // Zero length mappings aren't allowed
+        return mapped_file{nullptr, 0};
+    }
+    void* const p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd.get(), 0);
+    if (p == MAP_FAILED) {
+        throw_error("Could not map", path);
+    }
+    // The mapping stays valid after the file is closed
+    return mapped_file{std::shared_ptr<std::byte>{static_cast<std::byte*>(p), [size](std::byte* data) { munmap(data, size); }}, size};
+}
+
+#else
+
+mapped_file map_file(const std::string& path) {
+    throw std::runtime_error("Mapping files (" + path + ") is not supported on this platform");
+}
+
+#endif
+
+} // namespace mjs
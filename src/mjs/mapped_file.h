@@ -0,0 +1,23 @@
+#ifndef MJS_MAPPED_FILE_H
+#define MJS_MAPPED_FILE_H
+
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+namespace mjs {
+
+struct mapped_file {
+    std::shared_ptr<std::byte> data; // nullptr for empty files
+    uint64_t size;
+};
+
+// Maps the file 'path' into memory. The pages are mapped copy-on-write, so they can be modified without changing
+// the file itself (or other mappings of it). The mapping is removed when the last reference to 'data' is released.
+// Throws std::runtime_error if the file can't be mapped.
+mapped_file map_file(const std::string& path);
+
+} // namespace mjs
+
+#endif
@@ -8,20 +8,119 @@ object::object(gc_heap& heap, const string& class_name, const object_ptr& protot
     : heap_(heap)
     , class_(class_name.unsafe_raw_get())
     , prototype_(prototype)
-    , properties_(gc_table::make(heap_, 32))
+    , shape_(prototype ? prototype->instance_root_shape() : gc_shape::make_root(heap_))
     , value_(value::undefined) {
 }
 
+object::object(gc_heap& heap, const string& class_name, const gc_heap_ptr<gc_shape>& root_shape)
+    : heap_(heap)
+    , class_(class_name.unsafe_raw_get())
+    , shape_(root_shape)
+    , value_(value::undefined) {
+    assert(root_shape->is_root());
+}
+
 
 void object::fixup() {
     class_.fixup(heap_);
     prototype_.fixup(heap_);
     construct_.fixup(heap_);
     call_.fixup(heap_);
+    shape_.fixup(heap_);
+    slots_.fixup(heap_);
     properties_.fixup(heap_);
+    instance_root_shape_.fixup(heap_);
     value_.fixup(heap_);
 }
 
+value object::property_value(const property_location& p) const {
+    assert(p);
+    if (shape_) {
+        return slots_.dereference(heap_)[p.index].get_value(heap_);
+    }
+    return properties_.dereference(heap_).at(p.index).value();
+}
+
+void object::property_value(const property_location& p, const value& val) {
+    assert(p);
+    if (shape_) {
+        slots_.dereference(heap_)[p.index] = value_representation{val};
+    } else {
+        properties_.dereference(heap_).at(p.index).value(val);
+    }
+}
+
+void object::add_property(const string& name, const value& val, property_attribute attr) {
+    if (shape_) {
+        auto shape = shape_.track(heap_);
+        if (shape->property_count() < max_shape_properties) {
+            if (!slots_) {
+                slots_ = slot_vector::make(heap_, 4);
+            } else if (auto& slots = slots_.dereference(heap_); slots.length() == slots.capacity()) {
+                slots_ = slots.copy_with_capacity(slots.capacity() * 2);
+            }
+            shape_ = gc_shape::add(shape, name, attr);
+            auto& slots = slots_.dereference(heap_);
+            slots.push_back(value_representation{val});
+            assert(slots.length() == shape_.dereference(heap_).property_count());
+            return;
+        }
+        convert_to_dictionary();
+    }
+
+    auto& props = properties_.dereference(heap_);
+    // Room to insert another element?
+    if (props.length() != props.capacity()) {
+        // Yes, insert into existing table
+        props.insert(name, val, attr);
+    } else {
+        // No, increase the capacity
+        properties_ = props.copy_with_increased_capacity();
+        // let props (old properties_) be collected
+        // MUST dereference again here
+        properties_.dereference(heap_).insert(name, val, attr);
+    }
+}
+
+void object::remove_property(const property_location& p) {
+    assert(p);
+    if (shape_) {
+        const auto& shape = shape_.dereference(heap_);
+        if (p.index == shape.slot()) {
+            // Removing the last property added, just go back to the previous shape
+            shape_ = shape.parent_ptr();
+            slots_.dereference(heap_).pop_back();
+            return;
+        }
+        // The properties are added to the table in slot order, so the index stays the same
+        convert_to_dictionary();
+    }
+    properties_.dereference(heap_).at(p.index).erase();
+}
+
+void object::convert_to_dictionary() {
+    assert(shape_ && !properties_);
+    const uint32_t count = shape_.dereference(heap_).property_count();
+    uint32_t capacity = 32;
+    while (capacity <= count) {
+        capacity *= 2;
+    }
+    auto props = gc_table::make(heap_, capacity);
+    for_each_own_property([&props](const string& key, const value& val, property_attribute attr) {
+        props->insert(key, val, attr);
+    });
+    properties_ = props;
+    shape_ = gc_heap_ptr_untracked<gc_shape>{};
+    slots_ = gc_heap_ptr_untracked<slot_vector>{};
+}
+
+gc_heap_ptr<gc_shape> object::instance_root_shape() {
+    if (!instance_root_shape_) {
+        instance_root_shape_ = gc_shape::make_root(heap_);
+    }
+    return instance_root_shape_.track(heap_);
+}
+
 std::vector<string> object::property_names() const {
     std::vector<string> names;
     add_property_names(names);
@@ -29,12 +128,14 @@ std::vector<string> object::property_names() const {
 }
 
 void object::add_property_names(std::vector<string>& names) const {
-    auto& props = properties_.dereference(heap_);
-    for (auto it = props.begin(); it != props.end(); ++it) {
-        if (!it.has_attribute(property_attribute::dont_enum)) {
-            names.push_back(it.key());
-        }
+    if (exotic_) {
+        exotic_property_names(names);
     }
+    for_each_own_property([&names](const string& key, const value&, property_attribute attr) {
+        if ((attr & property_attribute::dont_enum) != property_attribute::dont_enum) {
+            names.push_back(key);
+        }
+    });
     if (prototype_) {
         prototype_.dereference(heap()).add_property_names(names);
     }
@@ -52,14 +153,16 @@ void object::debug_print(std::wostream& os, int indent_incr, int max_nest, int i
         os << "\n";
     };
     os << "{\n";
-    auto& props = properties_.dereference(heap_);
-    for (auto it = props.begin(); it != props.end(); ++it) {
-        if (it.key()->view() == L"constructor") {
-            print_prop(it.key()->view(), it.value(), true);
-        } else {
-            print_prop(it.key()->view(), it.value(), false);
+    if (exotic_) {
+        std::vector<string> names;
+        exotic_property_names(names);
+        for (const auto& n: names) {
+            print_prop(n.view(), exotic_get(n.view()), false);
         }
     }
+    for_each_own_property([&print_prop](const string& key, const value& val, property_attribute) {
+        print_prop(key.view(), val, key.view() == L"constructor");
+    });
     print_prop("[[Class]]", class_name(), true);
     print_prop("[[Prototype]]", prototype_ ? value{prototype_.track(heap())} : value::null, true);
     auto val = internal_value();
@@ -3,7 +3,10 @@
 
 #include "value.h"
 #include "gc_table.h"
+#include "gc_shape.h"
+#include "gc_vector.h"
 #include "gc_function.h"
+#include "property_cache.h"
 
 namespace mjs {
 
@@ -22,6 +25,11 @@ public:
         return h.make<object>(h, class_name, prototype);
     }
 
+    // Objects without a prototype normally get a root shape of their own, this lets similar objects share one
+    static auto make_with_root_shape(gc_heap& h, const string& class_name, const gc_heap_ptr<gc_shape>& root_shape) {
+        return h.make<object>(h, class_name, root_shape);
+    }
+
     virtual ~object() {}
 
     // 8.6.2, Page 22: Internal Properties and Methods
@@ -49,64 +57,74 @@ public:
 
     // [[Get]] (PropertyName)
     value get(const std::wstring_view& name) const {
-        auto [it, pp] = deep_find(name);
-        return it != pp->end() ? it.value() : value::undefined;
+        auto [o, p] = deep_find(name);
+        return p ? o->property_value(p, name) : value::undefined;
+    }
+
+    value get(const string& name) const {
+        auto [o, p] = deep_find(name);
+        return p ? o->property_value(p, name.view()) : value::undefined;
     }
 
     // [[Put]] (PropertyName, Value)
     virtual void put(const string& name, const value& val, property_attribute attr = property_attribute::none) {
         // See if there is already a property with this name
-        auto& props = properties_.dereference(heap_);
-        if (auto [it, pp] = deep_find(name.view()); it != pp->end()) {
+        if (auto [o, p] = deep_find(name); p) {
             // CanPut?
-            if (it.has_attribute(property_attribute::read_only)) {
+            if (p.has_attribute(property_attribute::read_only)) {
                 return;
             }
             // Did the property come from this object's property list?
-            if (pp == &props) {
-                // Yes, update
-                it.value(val);
+            if (o == this) {
+                // Yes, update (exotic properties must be handled by the derived class)
+                assert(p.index != exotic_index);
+                property_value(p, val);
                 return;
             }
             // Handle as insertion
         }
-        // Room to insert another element?
-        if (props.length() != props.capacity()) {
-            // Yes, insert into existing table
-            props.insert(name, val, attr);
-        } else {
-            // No, increase the capacity
-            properties_ = props.copy_with_increased_capacity();
-            // let props (old properties_) be collected
-            // MUST dereference again here
-            properties_.dereference(heap_).insert(name, val, attr);
-        }
+        add_property(name, val, attr);
+    }
+
+    // [[Get]] and [[Put]] for the property named by the array index 'index'. Objects that store indexed properties
+    // specially (e.g. arrays) override these to avoid creating the property name.
+    virtual value get_index(uint32_t index) const {
+        return get(index_string(index));
+    }
+
+    virtual void put_index(uint32_t index, const value& val) {
+        put(string{heap_, index_string(index)}, val);
     }
 
     // [[CanPut]] (PropertyName)
     bool can_put(const std::wstring_view& name) const {
-        auto [it, pp] = deep_find(name);
-        return it != pp->end() ? !it.has_attribute(property_attribute::read_only) : true;
+        auto [o, p] = deep_find(name);
+        return p ? !p.has_attribute(property_attribute::read_only) : true;
     }
 
     // [[HasProperty]] (PropertyName)
     bool has_property(const std::wstring_view& name) const {
-        auto [it, pp] = deep_find(name);
-        return it != pp->end();
+        return static_cast<bool>(deep_find(name).second);
+    }
+
+    bool has_property(const string& name) const {
+        return static_cast<bool>(deep_find(name).second);
     }
 
     // [[Delete]] (PropertyName)
     bool delete_property(const std::wstring_view& name) {
-        auto& props = properties_.dereference(heap_);
-        auto it = props.find(name);
-        if (it == props.end()) {
+        const auto p = find_own_or_exotic(name);
+        if (!p) {
             return true;
-
         }
-        if (it.has_attribute(property_attribute::dont_delete)) {
+        if (p.has_attribute(property_attribute::dont_delete)) {
             return false;
         }
-        it.erase();
+        if (p.index == exotic_index) {
+            exotic_delete(name);
+        } else {
+            remove_property(p);
+        }
         return true;
     }
 
@@ -125,31 +143,241 @@ public:
 
     std::vector<string> property_names() const;
 
+    //
+    // Inline cache support (see property_cache.h)
+    //
+
+    // The following work like [[Get]]/[[HasProperty]], but try the results remembered in 'cache' first (and update it on misses)
+    template<unsigned Size>
+    value cached_get(const std::wstring_view& name, property_cache<Size>& cache) const {
+        const auto p = cached_find(name, cache);
+        return p ? p.holder->property_value(property_location{p.index, p.attributes}, name) : value::undefined;
+    }
+
+    template<unsigned Size>
+    bool cached_has_property(const std::wstring_view& name, property_cache<Size>& cache) const {
+        return static_cast<bool>(cached_find(name, cache));
+    }
+
+    // Updates the own property 'name' using 'cache'. Returns false if [[Put]] has to be used instead, which is the case
+    // when the property doesn't exist, is read only, comes from the prototype or this is an exotic object.
+    template<unsigned Size>
+    bool cached_put(const std::wstring_view& name, property_cache<Size>& cache, const value& val) {
+        if (exotic_) {
+            return false;
+        }
+        const auto p = cached_find(name, cache);
+        if (p.holder != this || p.has_attribute(property_attribute::read_only)) {
+            return false;
+        }
+        property_value(property_location{p.index, p.attributes}, val);
+        return true;
+    }
+
     virtual void debug_print(std::wostream& os, int indent_incr, int max_nest = INT_MAX, int indent = 0) const;
 
 protected:
     explicit object(gc_heap& heap, const string& class_name, const object_ptr& prototype);
+    explicit object(gc_heap& heap, const string& class_name, const gc_heap_ptr<gc_shape>& root_shape);
     object(object&& o) = default;
     void fixup();
 
+    // Exotic objects (e.g. arrays) keep some of their own properties outside the normal property storage. They must call
+    // set_exotic() on construction and override put() and the functions below, which are used to access those properties.
+    void set_exotic() { exotic_ = true; }
+
+    // Returns true (and sets 'attributes') if 'name' is an exotic own property
+    virtual bool exotic_find(const std::wstring_view& name, property_attribute& attributes) const {
+        (void)name; (void)attributes;
+        return false;
+    }
+    // Returns the value of the exotic own property 'name'
+    virtual value exotic_get(const std::wstring_view& name) const {
+        (void)name;
+        assert(!"Not implemented");
+        return value::undefined;
+    }
+    // Removes the exotic own property 'name'
+    virtual void exotic_delete(const std::wstring_view& name) {
+        (void)name;
+        assert(!"Not implemented");
+    }
+    // Adds the names of the enumerable exotic own properties
+    virtual void exotic_property_names(std::vector<string>& names) const {
+        (void)names;
+    }
+
+    // Calls f(key, value, attributes) for each (non-exotic) own property in the order they were added
+    template<typename F>
+    void for_each_own_property(F f) const;
+
 private:
+    using slot_vector = gc_vector<value_representation>;
+
+    // Objects with more properties than this (or that have had a property other than the last one deleted)
+    // are switched to "dictionary mode" where the properties are stored in a gc_table instead
+    static constexpr uint32_t max_shape_properties = 64;
+
     gc_heap& heap_;
     gc_heap_ptr_untracked<gc_string>    class_;
     gc_heap_ptr_untracked<object>       prototype_;
     gc_heap_ptr_untracked<gc_function>  construct_;
     gc_heap_ptr_untracked<gc_function>  call_;
-    gc_heap_ptr_untracked<gc_table>     properties_;
+    gc_heap_ptr_untracked<gc_shape>     shape_;               // nullptr in dictionary mode
+    gc_heap_ptr_untracked<slot_vector>  slots_;               // property values in the order given by shape_ (nullptr until needed)
+    gc_heap_ptr_untracked<gc_table>     properties_;          // only used in dictionary mode
+    gc_heap_ptr_untracked<gc_shape>     instance_root_shape_; // root shape of objects having this object as their prototype (created on demand)
     value_representation                value_;
+    bool                                exotic_ = false;
 
-    void add_property_names(std::vector<string>& names) const;
+    // An own property. 'index' is the slot (when using a shape) or the index of the property table entry (in dictionary mode).
+    struct property_location {
+        uint32_t           index = UINT32_MAX;
+        property_attribute attributes = property_attribute::none;
+
+        explicit operator bool() const { return index != UINT32_MAX; }
+        bool has_attribute(property_attribute a) const { return (attributes & a) == a; }
+    };
+
+    // property_location index of exotic properties
+    static constexpr uint32_t exotic_index = UINT32_MAX - 1;
+
+    static std::wstring_view key_view(const std::wstring_view& key) { return key; }
+    static std::wstring_view key_view(const string& key) { return key.view(); }
 
-    std::pair<gc_table::entry, gc_table*> deep_find(const std::wstring_view& key) const {
+    // 0 in dictionary mode
+    uint32_t shape_id() const {
+        return shape_ ? shape_.dereference(heap_).id() : 0;
+    }
+
+    template<typename Key>
+    property_location find_own(const Key& key) const {
+        if (shape_) {
+            if (const auto s = shape_.dereference(heap_).find(key)) {
+                return property_location{s->slot(), s->attributes()};
+            }
+            return property_location{};
+        }
         auto& props = properties_.dereference(heap_);
         auto it = props.find(key);
-        return it != props.end() || !prototype_ ? std::make_pair(it, &props) : prototype_.dereference(heap_).deep_find(key);
+        return it != props.end() ? property_location{it.index(), it.property_attributes()} : property_location{};
+    }
+
+    template<typename Key>
+    property_location find_own_or_exotic(const Key& key) const {
+        if (property_attribute attributes; exotic_ && exotic_find(key_view(key), attributes)) {
+            return property_location{exotic_index, attributes};
+        }
+        return find_own(key);
+    }
+
+    template<typename Key>
+    std::pair<const object*, property_location> deep_find(const Key& key) const {
+        for (const object* o = this;; o = &o->prototype_.dereference(heap_)) {
+            if (const auto p = o->find_own_or_exotic(key); p || !o->prototype_) {
+                return {o, p};
+            }
+        }
     }
+
+    // Finds 'name' like deep_find, but tries the results remembered in 'cache' first (and updates it on misses)
+    template<unsigned Size>
+    cached_property cached_find(const std::wstring_view& name, property_cache<Size>& cache) const;
+
+    value property_value(const property_location& p, const std::wstring_view& name) const {
+        return p.index == exotic_index ? exotic_get(name) : property_value(p);
+    }
+    value property_value(const property_location& p) const;
+    void property_value(const property_location& p, const value& val);
+    void add_property(const string& name, const value& val, property_attribute attr);
+    void remove_property(const property_location& p);
+    void convert_to_dictionary();
+    gc_heap_ptr<gc_shape> instance_root_shape();
+
+    void add_property_names(std::vector<string>& names) const;
 };
 
+template<typename F>
+void object::for_each_own_property(F f) const {
+    if (shape_) {
+        // The shape only links to its parent, so collect them first to visit the properties in order
+        std::vector<const gc_shape*> shapes;
+        for (const gc_shape* s = &shape_.dereference(heap_); !s->is_root(); s = &s->parent()) {
+            shapes.push_back(s);
+        }
+        if (shapes.empty()) {
+            return;
+        }
+        const auto& slots = slots_.dereference(heap_);
+        for (auto it = shapes.rbegin(); it != shapes.rend(); ++it) {
+            f((*it)->key(), slots[(*it)->slot()].get_value(heap_), (*it)->attributes());
+        }
+        return;
+    }
+    auto& props = properties_.dereference(heap_);
+    for (auto it = props.begin(); it != props.end(); ++it) {
+        f(it.key(), it.value(), it.property_attributes());
+    }
+}
+
+template<unsigned Size>
+cached_property object::cached_find(const std::wstring_view& name, property_cache<Size>& cache) const {
+    using kind = property_cache_entry::kind_type;
+    if (exotic_) {
+        const auto [o, p] = deep_find(name);
+        return p ? cached_property{o, p.index, p.attributes} : cached_property{};
+    }
+    const uint32_t id = shape_id();
+    // Objects with the same shape also have the same prototype
+    const object* proto = prototype_ ? &prototype_.dereference(heap_) : nullptr;
+    for (const auto& e: cache.entries_) {
+        switch (e.kind) {
+        case kind::unused:
+            break;
+        case kind::own:
+            if (e.shape_id == id) {
+                return cached_property{this, e.index, e.attributes};
+            }
+            break;
+        case kind::prototype:
+            if (e.shape_id == id && proto->shape_id() == e.prototype_shape_id) {
+                return cached_property{proto, e.index, e.attributes};
+            }
+            break;
+        case kind::absent:
+            if (e.shape_id == id && (!e.prototype_shape_id || proto->shape_id() == e.prototype_shape_id)) {
+                return cached_property{};
+            }
+            break;
+        case kind::dictionary:
+            if (!id && properties_.dereference(heap_).has_key_at(e.index, name)) {
+                return cached_property{this, e.index, e.attributes};
+            }
+            break;
+        }
+    }
+
+    // Miss, do a full lookup and remember the result if it can be revalidated cheaply
+    const auto [o, p] = deep_find(name);
+    property_cache_entry entry;
+    if (proto && proto->exotic_) {
+        // Don't cache
+    } else if (p) {
+        if (o == this) {
+            entry = property_cache_entry{id ? kind::own : kind::dictionary, p.attributes, id, 0, p.index};
+        } else if (o == proto && id && proto->shape_id()) {
+            entry = property_cache_entry{kind::prototype, p.attributes, id, proto->shape_id(), p.index};
+        }
+    } else if (id && (!proto || (proto->shape_id() && !proto->prototype_))) {
+        entry = property_cache_entry{kind::absent, property_attribute::none, id, proto ? proto->shape_id() : 0, 0};
+    }
+    if (entry.kind != kind::unused) {
+        cache.entries_[cache.next_] = entry;
+        cache.next_ = static_cast<uint8_t>((cache.next_ + 1) % Size);
+    }
+    return p ? cached_property{o, p.index, p.attributes} : cached_property{};
+}
+
 } // namespace mjs
 
 #endif
@@ -7,6 +7,7 @@
 #include <cassert>
 
 #include "lexer.h"
+#include "property_cache.h"
 
 namespace mjs {
 
@@ -136,8 +137,13 @@ public:
 
     const std::wstring& id() const { return id_; }
 
+    // Inline caches used by the interpreter, one per scope level searched (the last one is shared by any remaining levels)
+    static constexpr int scope_cache_levels = 4;
+    property_cache<1>& scope_cache(int level) const { return scope_cache_[level < scope_cache_levels ? level : scope_cache_levels - 1]; }
+
 private:
     std::wstring id_;
+    mutable property_cache<1> scope_cache_[scope_cache_levels];
 
     void print(std::wostream& os) const override {
         os << "identifier_expression{" << id_ << "}";
@@ -242,10 +248,15 @@ public:
     const expression& lhs() const { return *lhs_; }
     const expression& rhs() const { return *rhs_; }
 
+    // Inline cache used by the interpreter for member accesses with a fixed name (e.g. "o.name")
+    using member_cache_type = property_cache<4>;
+    member_cache_type& member_cache() const { return member_cache_; }
+
 private:
     token_type op_;
     expression_ptr lhs_;
     expression_ptr rhs_;
+    mutable member_cache_type member_cache_;
 
     void print(std::wostream& os) const override {
         os << "binary_expression{" << op_ << ", " << *lhs_ << ", " << *rhs_ << "}";
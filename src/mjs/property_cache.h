@@ -0,0 +1,55 @@
+#ifndef MJS_PROPERTY_CACHE_H
+#define MJS_PROPERTY_CACHE_H
+
+#include "property_attribute.h"
+#include <stdint.h>
+
+namespace mjs {
+
+class object;
+
+// Result of looking up a property using a property_cache (see object::find)
+struct cached_property {
+    const object*      holder = nullptr;   // The object (or prototype) having the property, nullptr if it doesn't exist
+    uint32_t           index = UINT32_MAX; // Slot or property table index in 'holder'
+    property_attribute attributes = property_attribute::none;
+
+    explicit operator bool() const { return holder != nullptr; }
+    bool has_attribute(property_attribute a) const { return (attributes & a) == a; }
+};
+
+// One remembered lookup result. Only contains shape ids and slots (no references to the GC heap), so caches
+// can be stored anywhere (e.g. in the AST) and stay valid when garbage is collected.
+struct property_cache_entry {
+    enum class kind_type : uint8_t {
+        unused,
+        own,            // Own property of objects with shape 'shape_id'
+        prototype,      // Own property of the prototype (having shape 'prototype_shape_id') of objects with shape 'shape_id'
+        absent,         // Not found, objects with shape 'shape_id' have no prototype or one with shape 'prototype_shape_id' without a prototype
+        dictionary,     // Own property found at 'index' of an object in dictionary mode (checked by comparing the key)
+    };
+
+    kind_type          kind = kind_type::unused;
+    property_attribute attributes = property_attribute::none;
+    uint32_t           shape_id = 0;
+    uint32_t           prototype_shape_id = 0;
+    uint32_t           index = 0;
+};
+
+// Inline cache for lookups of a property with a name that's fixed (e.g. an identifier in the source code).
+// Remembers the results for up to 'Size' different object shapes.
+template<unsigned Size>
+class property_cache {
+public:
+    static_assert(Size > 0 && Size < 256);
+    static constexpr unsigned size = Size;
+
+private:
+    friend object;
+    property_cache_entry entries_[Size];
+    uint8_t next_ = 0; // Entry to replace on the next miss
+};
+
+} // namespace mjs
+
+#endif
@@ -1,13 +1,40 @@
 #include "string.h"
 #include <ostream>
-#include <sstream>
+#include <charconv>
+#include <string>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 
 namespace mjs {
 
 static_assert(!gc_type_info_registration<gc_string>::needs_destroy);
-static_assert(!gc_type_info_registration<gc_string>::needs_fixup);
+static_assert(gc_type_info_registration<gc_string>::needs_fixup);
+
+gc_heap_ptr<gc_string> gc_string::make_slice(const gc_heap_ptr<gc_string>& parent, uint32_t offset, uint32_t length) {
+    assert(offset <= parent->length_ && length <= parent->length_ - offset);
+    auto& h = parent.heap();
+    slice_data sd{&h, parent, offset};
+    if (parent->sliced_) {
+        // Always refer to the string that actually holds the characters
+        sd.parent = parent->slice().parent;
+        sd.offset += parent->slice().offset;
+    }
+    return h.allocate_and_construct<gc_string>(sizeof(gc_string) + sizeof(slice_data), sd, length);
+}
+
+string string::substr(uint32_t pos, uint32_t len) const {
+    const auto& raw = unsafe_raw_get();
+    const auto l = static_cast<uint32_t>(raw->view().length());
+    pos = std::min(pos, l);
+    len = std::min(len, l - pos);
+    if (len == l) {
+        return *this;
+    } else if (len < gc_string::min_slice_length) {
+        return string{heap(), raw->view().substr(pos, len)};
+    }
+    return string{gc_string::make_slice(raw, pos, len)};
+}
 
 std::ostream& operator<<(std::ostream& os, const string& s) {
     auto v = s.view();
@@ -18,12 +45,215 @@ std::wostream& operator<<(std::wostream& os, const string& s) {
     return os << s.view();
 }
 
+static bool is_str_whitespace(wchar_t c) {
+    // StrWhiteSpaceChar (9.3.1)
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool is_decimal_digit(wchar_t c) {
+    return c >= '0' && c <= '9';
+}
+
+static int hex_digit_value(wchar_t c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+size_t parse_decimal_prefix(const std::wstring_view& s, double& result) {
+    const size_t n = s.length();
+    size_t i = 0;
+    bool negative = false;
+    if (i < n && (s[i] == '+' || s[i] == '-')) {
+        negative = s[i] == '-';
+        ++i;
+    }
+    if (s.compare(i, 8, L"Infinity") == 0) {
+        result = negative ? -INFINITY : INFINITY;
+        return i + 8;
+    }
+
+    // Validate the syntax (and find the magnitude of the number in case it's out of range)
+    const size_t start = i;
+    size_t leading_zeros = 0;
+    while (i < n && s[i] == '0') {
+        ++i, ++leading_zeros;
+    }
+    int magnitude = 0; // position of the first significant digit relative to the decimal point
+    while (i < n && is_decimal_digit(s[i])) {
+        ++i, ++magnitude;
+    }
+    size_t digits = leading_zeros + magnitude;
+    if (i < n && s[i] == '.') {
+        ++i;
+        const size_t frac_start = i;
+        if (!magnitude) {
+            while (i < n && s[i] == '0') {
+                ++i, --magnitude;
+            }
+        }
+        while (i < n && is_decimal_digit(s[i])) {
+            ++i;
+        }
+        digits += i - frac_start;
+    }
+    if (!digits) {
+        return 0;
+    }
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        size_t j = i + 1;
+        bool negative_exponent = false;
+        if (j < n && (s[j] == '+' || s[j] == '-')) {
+            negative_exponent = s[j] == '-';
+            ++j;
+        }
+        if (j < n && is_decimal_digit(s[j])) {
+            int exponent = 0;
+            for (; j < n && is_decimal_digit(s[j]); ++j) {
+                exponent = std::min(exponent * 10 + (s[j] - '0'), 100000);
+            }
+            magnitude += negative_exponent ? -exponent : exponent;
+            i = j;
+        }
+    }
+
+    // The syntax is a subset of what std::from_chars (which implements a fast and exact
+    // algorithm) accepts, so just convert it to a narrow string and let it do the work
+    constexpr size_t max_stack_length = 64;
+    char stack_buffer[max_stack_length];
+    std::string long_buffer;
+    char* buffer = stack_buffer;
+    const size_t length = i - start;
+    if (length > max_stack_length) {
+        long_buffer.resize(length);
+        buffer = long_buffer.data();
+    }
+    for (size_t k = 0; k < length; ++k) {
+        buffer[k] = static_cast<char>(s[start + k]);
+    }
+    double value;
+    const auto res = std::from_chars(buffer, buffer + length, value);
+    assert(res.ptr == buffer + length);
+    if (res.ec == std::errc::result_out_of_range) {
+        // Only digits can have been consumed if there was no significant digit
+        value = magnitude > 0 ? INFINITY : 0;
+    } else {
+        assert(res.ec == std::errc{});
+    }
+    result = negative ? -value : value;
+    return i;
+}
+
+double to_number(const std::wstring_view& str) {
+    // 9.3.1 ToNumber Applied to the String Type
+    size_t start = 0, end = str.length();
+    while (start < end && is_str_whitespace(str[start])) {
+        ++start;
+    }
+    while (end > start && is_str_whitespace(str[end - 1])) {
+        --end;
+    }
+    const auto s = str.substr(start, end - start);
+    if (s.empty()) {
+        return 0;
+    }
+    if (s.length() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        double value = 0;
+        for (size_t i = 2; i < s.length(); ++i) {
+            const int d = hex_digit_value(s[i]);
+            if (d < 0) {
+                return NAN;
+            }
+            value = value * 16 + d;
+        }
+        return value;
+    }
+    double value;
+    const auto used = parse_decimal_prefix(s, value);
+    return used && used == s.length() ? value : NAN;
+}
+
 double to_number(const string& s) {
-    // TODO: Implement real algorithm from 9.3.1 ToNumber Applied to the String Type
-    if (s.view().empty()) return 0;
-    std::wistringstream wis{std::wstring{s.view()}};
-    double d;
-    return (wis >> d) && !wis.rdbuf()->in_avail() ? d : NAN;
+    return to_number(s.view());
+}
+
+uint32_t string_to_index(const std::wstring_view& s) {
+    // Must be the canonical representation, i.e. no leading zeros (except for "0" itself)
+    if (s.empty() || s.length() > 10 || (s[0] == '0' && s.length() > 1)) {
+        return UINT32_MAX;
+    }
+    uint64_t index = 0;
+    for (const auto c: s) {
+        if (!is_decimal_digit(c)) {
+            return UINT32_MAX;
+        }
+        index = index * 10 + (c - '0');
+    }
+    return index < UINT32_MAX ? static_cast<uint32_t>(index) : UINT32_MAX;
+}
+
+std::wstring index_string(uint32_t index) {
+    wchar_t buffer[11], *p = &buffer[11];
+    *--p = '\0';
+    do {
+        *--p = '0' + index % 10;
+        index /= 10;
+    } while (index);
+    return std::wstring{p};
+}
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t load64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t string_hash(const std::wstring_view& s) {
+    // Word-at-a-time hash. The bulk of the string is processed 32 bytes at a time in four independent
+    // lanes (which lets the compiler keep them in vector registers), the rest 8 bytes at a time.
+    constexpr uint64_t prime1 = 0x9e3779b97f4a7c15ULL;
+    constexpr uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+    auto round = [](uint64_t acc, uint64_t v) {
+        return rotl64(acc ^ (v * prime2), 31) * prime1;
+    };
+
+    const auto* p = reinterpret_cast<const unsigned char*>(s.data());
+    size_t n = s.length() * sizeof(wchar_t);
+    uint64_t h = prime1 ^ n;
+    if (n >= 32) {
+        uint64_t lanes[4] = { prime1, prime2, h, ~h };
+        do {
+            for (int i = 0; i < 4; ++i) {
+                lanes[i] = round(lanes[i], load64(p + i * 8));
+            }
+            p += 32;
+            n -= 32;
+        } while (n >= 32);
+        h ^= rotl64(lanes[0], 1) + rotl64(lanes[1], 7) + rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+    }
+    for (; n >= 8; p += 8, n -= 8) {
+        h = round(h, load64(p));
+    }
+    if (n) {
+        uint64_t v = 0;
+        std::memcpy(&v, p, n);
+        h = round(h, v);
+    }
+
+    // Final avalanche (from MurmurHash3)
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    const auto res = static_cast<uint32_t>(h);
+    return res ? res : 1;
 }
 
 } // namespace mjs
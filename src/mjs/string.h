@@ -4,29 +4,85 @@
 #include <string>
 #include <string_view>
 #include "gc_heap.h"
+#include "string_kernels.h"
 
 namespace mjs {
 
-class gc_string {
+class gc_string_table;
+
+// Fast hash of the string contents (never returns 0)
+uint32_t string_hash(const std::wstring_view& s);
+
+// alignas needed so the slice_data of sliced strings is properly aligned
+class alignas(uint64_t) gc_string {
 public:
+    // Slices shorter than this are copied, sharing the parent's buffer isn't worth it for them
+    static constexpr uint32_t min_slice_length = 16;
+
     template<typename CharT>
     static gc_heap_ptr<gc_string> make(gc_heap& h, const std::basic_string_view<CharT>& s) {
         return h.allocate_and_construct<gc_string>(sizeof(gc_string) + s.length() * sizeof(wchar_t), s);
     }
 
+    // Create a string consisting of 'length' characters starting at 'offset' in 'parent' sharing the parent's character storage
+    static gc_heap_ptr<gc_string> make_slice(const gc_heap_ptr<gc_string>& parent, uint32_t offset, uint32_t length);
+
     std::wstring_view view() const {
-        return std::wstring_view(const_cast<gc_string&>(*this).data(), length_);
+        return std::wstring_view(sliced_ ? slice().chars() : const_cast<gc_string&>(*this).data(), length_);
+    }
+
+    // Interned strings are unique within their heap, so two of them are equal exactly when they're the same object
+    bool interned() const {
+        return interned_;
+    }
+
+    // Does the string share its characters with another string?
+    bool sliced() const {
+        return sliced_;
+    }
+
+    // Hash of the string contents (see string_hash()), computed on first use
+    uint32_t hash() const {
+        if (!hash_) {
+            hash_ = string_hash(view());
+        }
+        return hash_;
+    }
+
+    // Returns true if the hash has already been computed
+    bool has_hash() const {
+        return hash_ != 0;
     }
 
 private:
     friend gc_type_info_registration<gc_string>;
+    friend gc_string_table;
+
+    // Stored instead of the characters for sliced strings. The parent is never itself a slice.
+    struct slice_data {
+        gc_heap*                         heap;
+        gc_heap_ptr_untracked<gc_string> parent;
+        uint32_t                         offset;
+
+        wchar_t* chars() const {
+            return parent.dereference(*heap).data() + offset;
+        }
+    };
 
     uint32_t length_; // TODO: Get from allocation header
+    mutable uint32_t hash_ = 0; // 0 = not calculated yet
+    bool interned_ = false;
+    bool sliced_ = false;
 
     wchar_t* data() {
         return reinterpret_cast<wchar_t*>(reinterpret_cast<std::byte*>(this) + sizeof(*this));
     }
 
+    slice_data& slice() const {
+        assert(sliced_);
+        return *reinterpret_cast<slice_data*>(const_cast<std::byte*>(reinterpret_cast<const std::byte*>(this)) + sizeof(*this));
+    }
+
     explicit gc_string(const std::string_view& s) : length_(static_cast<uint32_t>(s.length())) {
         for (uint32_t i = 0; i < length_; ++i) {
             data()[i] = s[i];
@@ -37,8 +93,23 @@ private:
         std::memcpy(data(), s.data(), s.length() * sizeof(wchar_t));
     }
 
-    explicit gc_string(gc_string&& other) : length_(other.length_) {
-        std::memcpy(data(), other.data(), other.length_ * sizeof(wchar_t));
+    explicit gc_string(const slice_data& sd, uint32_t length) : length_(length), sliced_(true) {
+        new (&slice()) slice_data(sd);
+    }
+
+    explicit gc_string(gc_string&& other) : length_(other.length_), hash_(other.hash_), interned_(other.interned_), sliced_(other.sliced_) {
+        if (sliced_) {
+            new (&slice()) slice_data(other.slice());
+        } else {
+            std::memcpy(data(), other.data(), other.length_ * sizeof(wchar_t));
+        }
+    }
+
+    void fixup() {
+        if (sliced_) {
+            auto& sd = slice();
+            sd.parent.fixup(*sd.heap);
+        }
     }
 };
 
@@ -51,18 +122,55 @@ public:
     using gc_heap_ptr<gc_string>::heap;
 
     std::wstring_view view() const { return get()->view(); }
+    uint32_t hash() const { return get()->hash(); }
+
+    // Returns the substring starting at 'pos' of at most 'len' characters, sharing storage with this string when it's large enough
+    string substr(uint32_t pos, uint32_t len = UINT32_MAX) const;
+
     const gc_heap_ptr<gc_string>& unsafe_raw_get() const { return *this; }
 };
 std::ostream& operator<<(std::ostream& os, const string& s);
 std::wostream& operator<<(std::wostream& os, const string& s);
-inline bool operator==(const string& l, const string& r) { return l.view() == r.view(); }
+inline bool operator==(const string& l, const string& r) {
+    const auto& lr = *l.unsafe_raw_get();
+    const auto& rr = *r.unsafe_raw_get();
+    if (&lr == &rr) {
+        return true;
+    }
+    if (lr.interned() && rr.interned() && &l.heap() == &r.heap()) {
+        return false;
+    }
+    if (lr.has_hash() && rr.has_hash() && lr.hash() != rr.hash()) {
+        return false;
+    }
+    return string_equal(lr.view(), rr.view());
+}
 inline string operator+(const string& l, const string& r) {
     // TODO: Optimize this
     return string{l.heap(), std::wstring{l.view()} + std::wstring{r.view()}};
 }
 
+// Parses the longest prefix of 's' that is a StrDecimalLiteral (see 9.3.1) storing the value in 'result', returns the length of the prefix (0 if there is none)
+size_t parse_decimal_prefix(const std::wstring_view& s, double& result);
+
+double to_number(const std::wstring_view& s);
 double to_number(const string& s);
 
+// Returns the array index 's' represents (in canonical form) or UINT32_MAX if it isn't one
+uint32_t string_to_index(const std::wstring_view& s);
+
+// Returns the canonical string representation of the array index 'index' (the inverse of string_to_index)
+std::wstring index_string(uint32_t index);
+
 } // namespace mjs
 
+namespace std {
+template<>
+struct hash<mjs::string> {
+    size_t operator()(const mjs::string& s) const {
+        return s.hash();
+    }
+};
+} // namespace std
+
 #endif
@@ -0,0 +1,211 @@
+#include "string_kernels_impl.h"
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MJS_STRING_KERNELS_X86
+#include <emmintrin.h>
+#endif
+
+namespace mjs {
+
+namespace {
+
+size_t scalar_find_char(const wchar_t* s, size_t n, wchar_t c) {
+    return std::wstring_view(s, n).find(c);
+}
+
+size_t scalar_rfind_char(const wchar_t* s, size_t n, wchar_t c) {
+    return std::wstring_view(s, n).rfind(c);
+}
+
+size_t scalar_find(const wchar_t* s, size_t n, const wchar_t* needle, size_t m) {
+    return std::wstring_view(s, n).find(std::wstring_view(needle, m));
+}
+
+size_t scalar_mismatch(const wchar_t* l, const wchar_t* r, size_t n) {
+    return static_cast<size_t>(std::mismatch(l, l + n, r).first - l);
+}
+
+constexpr string_kernel_table scalar_table{&scalar_find_char, &scalar_rfind_char, &scalar_find, &scalar_mismatch};
+
+#ifdef MJS_STRING_KERNELS_X86
+// SSE2 is always available on x86-64
+struct sse2_vec {
+    using reg = __m128i;
+    static constexpr size_t width = sizeof(reg) / sizeof(wchar_t);
+
+    static reg load(const wchar_t* p) {
+        return _mm_loadu_si128(reinterpret_cast<const reg*>(p));
+    }
+
+    static reg broadcast(wchar_t c) {
+        if constexpr (sizeof(wchar_t) == 2) {
+            return _mm_set1_epi16(static_cast<short>(c));
+        } else {
+            return _mm_set1_epi32(static_cast<int>(c));
+        }
+    }
+
+    static reg eq(reg a, reg b) {
+        if constexpr (sizeof(wchar_t) == 2) {
+            return _mm_cmpeq_epi16(a, b);
+        } else {
+            return _mm_cmpeq_epi32(a, b);
+        }
+    }
+
+    static uint32_t mask(reg r) {
+        return static_cast<uint32_t>(_mm_movemask_epi8(r));
+    }
+
+    static uint32_t eq_mask(reg a, reg b) {
+        return mask(eq(a, b));
+    }
+
+    static reg and_(reg a, reg b) {
+        return _mm_and_si128(a, b);
+    }
+
+    static reg or_(reg a, reg b) {
+        return _mm_or_si128(a, b);
+    }
+
+    static bool any(reg r) {
+        return mask(r) != 0;
+    }
+
+    static bool all(reg r) {
+        return mask(r) == 0xFFFF;
+    }
+};
+
+constexpr string_kernel_table sse2_table = make_vec_kernel_table<sse2_vec>();
+
+bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    constexpr int osxsave_bit = 1 << 27, avx_bit = 1 << 28;
+    if ((info[2] & (osxsave_bit | avx_bit)) != (osxsave_bit | avx_bit) || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+struct kernel_selection {
+    string_kernel_isa isa;
+    const string_kernel_table* table;
+};
+
+kernel_selection best_kernels(string_kernel_isa max_isa) {
+#ifdef MJS_STRING_KERNELS_X86
+    if (max_isa >= string_kernel_isa::avx2 && avx2_string_kernels() && cpu_has_avx2()) {
+        return {string_kernel_isa::avx2, avx2_string_kernels()};
+    }
+    if (max_isa >= string_kernel_isa::sse2) {
+        return {string_kernel_isa::sse2, &sse2_table};
+    }
+#else
+    (void)max_isa;
+#endif
+    return {string_kernel_isa::scalar, &scalar_table};
+}
+
+kernel_selection& active_kernels() {
+    static kernel_selection k = best_kernels(string_kernel_isa::avx2);
+    return k;
+}
+
+inline const string_kernel_table& kernels() {
+    return *active_kernels().table;
+}
+
+} // unnamed namespace
+
+string_kernel_isa current_string_kernels() {
+    return active_kernels().isa;
+}
+
+string_kernel_isa select_string_kernels(string_kernel_isa max_isa) {
+    return (active_kernels() = best_kernels(max_isa)).isa;
+}
+
+size_t string_find(const std::wstring_view& s, wchar_t c, size_t pos) {
+    if (pos >= s.size()) {
+        return std::wstring_view::npos;
+    }
+    const auto res = kernels().find_char(s.data() + pos, s.size() - pos, c);
+    return res == std::wstring_view::npos ? res : res + pos;
+}
+
+size_t string_rfind(const std::wstring_view& s, wchar_t c, size_t pos) {
+    if (s.empty()) {
+        return std::wstring_view::npos;
+    }
+    return kernels().rfind_char(s.data(), std::min(pos, s.size() - 1) + 1, c);
+}
+
+size_t string_find(const std::wstring_view& s, const std::wstring_view& needle, size_t pos) {
+    const auto n = s.size(), m = needle.size();
+    if (pos > n || m > n - pos) {
+        return std::wstring_view::npos;
+    } else if (m == 0) {
+        return pos;
+    } else if (m == 1) {
+        return string_find(s, needle[0], pos);
+    }
+    const auto res = kernels().find(s.data() + pos, n - pos, needle.data(), m);
+    return res == std::wstring_view::npos ? res : res + pos;
+}
+
+size_t string_rfind(const std::wstring_view& s, const std::wstring_view& needle, size_t pos) {
+    const auto n = s.size(), m = needle.size();
+    if (m > n) {
+        return std::wstring_view::npos;
+    }
+    size_t last = std::min(pos, n - m); // last possible starting position
+    if (m == 0) {
+        return last;
+    }
+    const auto& k = kernels();
+    const auto tail_bytes = (m - 1) * sizeof(wchar_t);
+    for (;;) {
+        const auto cand = k.rfind_char(s.data(), last + 1, needle[0]);
+        if (cand == std::wstring_view::npos) {
+            return cand;
+        }
+        if (std::memcmp(s.data() + cand + 1, needle.data() + 1, tail_bytes) == 0) {
+            return cand;
+        }
+        if (!cand) {
+            return std::wstring_view::npos;
+        }
+        last = cand - 1;
+    }
+}
+
+bool string_equal(const std::wstring_view& l, const std::wstring_view& r) {
+    return l.size() == r.size() && kernels().mismatch(l.data(), r.data(), l.size()) == l.size();
+}
+
+int string_compare(const std::wstring_view& l, const std::wstring_view& r) {
+    const auto common = std::min(l.size(), r.size());
+    const auto i = kernels().mismatch(l.data(), r.data(), common);
+    if (i != common) {
+        using unit = std::conditional_t<sizeof(wchar_t) == 2, uint16_t, uint32_t>;
+        return static_cast<unit>(l[i]) < static_cast<unit>(r[i]) ? -1 : 1;
+    }
+    return l.size() < r.size() ? -1 : l.size() > r.size() ? 1 : 0;
+}
+
+} // namespace mjs
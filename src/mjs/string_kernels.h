@@ -0,0 +1,38 @@
+#ifndef MJS_STRING_KERNELS_H
+#define MJS_STRING_KERNELS_H
+
+#include <string_view>
+#include <stddef.h>
+
+namespace mjs {
+
+// Vectorized (where supported) string searching and comparison. The functions behave
+// like the corresponding std::wstring_view members and return std::wstring_view::npos
+// when nothing is found.
+
+size_t string_find(const std::wstring_view& s, wchar_t c, size_t pos = 0);
+size_t string_rfind(const std::wstring_view& s, wchar_t c, size_t pos = std::wstring_view::npos);
+size_t string_find(const std::wstring_view& s, const std::wstring_view& needle, size_t pos = 0);
+size_t string_rfind(const std::wstring_view& s, const std::wstring_view& needle, size_t pos = std::wstring_view::npos);
+
+bool string_equal(const std::wstring_view& l, const std::wstring_view& r);
+
+// Returns a negative number, zero or a positive number if 'l' is less than, equal to or greater than 'r'
+// (code units are compared as unsigned numbers)
+int string_compare(const std::wstring_view& l, const std::wstring_view& r);
+
+enum class string_kernel_isa {
+    scalar,
+    sse2,
+    avx2,
+};
+
+// Returns the instruction set currently used by the string kernels
+string_kernel_isa current_string_kernels();
+
+// Use the best implementation supported by the processor not exceeding 'max_isa' (mostly useful for testing/benchmarking)
+string_kernel_isa select_string_kernels(string_kernel_isa max_isa);
+
+} // namespace mjs
+
+#endif
@@ -0,0 +1,79 @@
+// Compiled with AVX2 code generation enabled (see src/CMakeLists.txt), only called when the processor supports it
+#include "string_kernels_impl.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace mjs {
+
+#ifdef __AVX2__
+
+namespace {
+
+struct avx2_vec {
+    using reg = __m256i;
+    static constexpr size_t width = sizeof(reg) / sizeof(wchar_t);
+
+    static reg load(const wchar_t* p) {
+        return _mm256_loadu_si256(reinterpret_cast<const reg*>(p));
+    }
+
+    static reg broadcast(wchar_t c) {
+        if constexpr (sizeof(wchar_t) == 2) {
+            return _mm256_set1_epi16(static_cast<short>(c));
+        } else {
+            return _mm256_set1_epi32(static_cast<int>(c));
+        }
+    }
+
+    static reg eq(reg a, reg b) {
+        if constexpr (sizeof(wchar_t) == 2) {
+            return _mm256_cmpeq_epi16(a, b);
+        } else {
+            return _mm256_cmpeq_epi32(a, b);
+        }
+    }
+
+    static uint32_t mask(reg r) {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(r));
+    }
+
+    static uint32_t eq_mask(reg a, reg b) {
+        return mask(eq(a, b));
+    }
+
+    static reg and_(reg a, reg b) {
+        return _mm256_and_si256(a, b);
+    }
+
+    static reg or_(reg a, reg b) {
+        return _mm256_or_si256(a, b);
+    }
+
+    static bool any(reg r) {
+        return mask(r) != 0;
+    }
+
+    static bool all(reg r) {
+        return mask(r) == 0xFFFFFFFF;
+    }
+};
+
+constexpr string_kernel_table avx2_table = make_vec_kernel_table<avx2_vec>();
+
+} // unnamed namespace
+
+const string_kernel_table* avx2_string_kernels() {
+    return &avx2_table;
+}
+
+#else
+
+const string_kernel_table* avx2_string_kernels() {
+    return nullptr;
+}
+
+#endif
+
+} // namespace mjs
@@ -0,0 +1,184 @@
+#ifndef MJS_STRING_KERNELS_IMPL_H
+#define MJS_STRING_KERNELS_IMPL_H
+
+// Internal header shared by the string kernel implementations. Everything is in an anonymous
+// namespace since the translation units are compiled with different instruction sets enabled.
+
+#include "string_kernels.h"
+#include <cstring>
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace mjs {
+
+struct string_kernel_table {
+    size_t (*find_char)(const wchar_t* s, size_t n, wchar_t c);
+    size_t (*rfind_char)(const wchar_t* s, size_t n, wchar_t c);
+    // Only called with 2 <= m <= n
+    size_t (*find)(const wchar_t* s, size_t n, const wchar_t* needle, size_t m);
+    // Returns the index of the first differing character (or 'n' if all are the same)
+    size_t (*mismatch)(const wchar_t* l, const wchar_t* r, size_t n);
+};
+
+// nullptr if not compiled with AVX2 support
+const string_kernel_table* avx2_string_kernels();
+
+namespace {
+
+constexpr size_t kernel_npos = std::wstring_view::npos;
+
+inline unsigned lowest_bit(uint32_t m) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, m);
+    return index;
+#else
+    return __builtin_ctz(m);
+#endif
+}
+
+inline unsigned highest_bit(uint32_t m) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, m);
+    return index;
+#else
+    return 31 - __builtin_clz(m);
+#endif
+}
+
+// The vector kernels are written in terms of a "vector traits" type providing:
+//   reg                        - the register type
+//   width                      - number of wchar_t's in a register
+//   load(p)                    - unaligned load of 'width' characters
+//   broadcast(c)               - register with all lanes set to 'c'
+//   eq(a, b)                   - register with all bits set in lanes where 'a' and 'b' are equal
+//   mask(r)                    - byte mask (one bit per byte, lowest lane in the lowest bits) of 'r'
+//   eq_mask(a, b)              - mask(eq(a, b))
+//   and_(a, b)/or_(a, b)       - bitwise and/or
+//   any(r)/all(r)              - returns true if any/all bits of 'r' are set
+// Since wchar_t is wider than a byte, each matching lane sets sizeof(wchar_t) bits in the masks.
+
+// Keep only one bit per lane
+constexpr uint32_t lane_bits = sizeof(wchar_t) == 2 ? 0x55555555 : 0x11111111;
+
+template<typename V>
+size_t vec_find_char(const wchar_t* s, size_t n, wchar_t c) {
+    const auto vc = V::broadcast(c);
+    size_t i = 0;
+    // Check 4 registers at a time and only find the exact position when there's a match
+    for (; i + 4 * V::width <= n; i += 4 * V::width) {
+        const auto e0 = V::eq(V::load(s + i), vc);
+        const auto e1 = V::eq(V::load(s + i + V::width), vc);
+        const auto e2 = V::eq(V::load(s + i + 2 * V::width), vc);
+        const auto e3 = V::eq(V::load(s + i + 3 * V::width), vc);
+        if (V::any(V::or_(V::or_(e0, e1), V::or_(e2, e3)))) {
+            break;
+        }
+    }
+    for (; i + V::width <= n; i += V::width) {
+        if (const uint32_t m = V::eq_mask(V::load(s + i), vc)) {
+            return i + lowest_bit(m) / sizeof(wchar_t);
+        }
+    }
+    for (; i < n; ++i) {
+        if (s[i] == c) {
+            return i;
+        }
+    }
+    return kernel_npos;
+}
+
+template<typename V>
+size_t vec_rfind_char(const wchar_t* s, size_t n, wchar_t c) {
+    const auto vc = V::broadcast(c);
+    size_t i = n;
+    for (; i >= 4 * V::width; ) {
+        const auto e0 = V::eq(V::load(s + i - V::width), vc);
+        const auto e1 = V::eq(V::load(s + i - 2 * V::width), vc);
+        const auto e2 = V::eq(V::load(s + i - 3 * V::width), vc);
+        const auto e3 = V::eq(V::load(s + i - 4 * V::width), vc);
+        if (V::any(V::or_(V::or_(e0, e1), V::or_(e2, e3)))) {
+            break;
+        }
+        i -= 4 * V::width;
+    }
+    for (; i >= V::width; ) {
+        i -= V::width;
+        if (const uint32_t m = V::eq_mask(V::load(s + i), vc)) {
+            return i + highest_bit(m) / sizeof(wchar_t);
+        }
+    }
+    while (i--) {
+        if (s[i] == c) {
+            return i;
+        }
+    }
+    return kernel_npos;
+}
+
+template<typename V>
+size_t vec_mismatch(const wchar_t* l, const wchar_t* r, size_t n) {
+    constexpr uint32_t all = static_cast<uint32_t>((uint64_t(1) << (V::width * sizeof(wchar_t))) - 1);
+    size_t i = 0;
+    for (; i + 4 * V::width <= n; i += 4 * V::width) {
+        const auto e0 = V::eq(V::load(l + i), V::load(r + i));
+        const auto e1 = V::eq(V::load(l + i + V::width), V::load(r + i + V::width));
+        const auto e2 = V::eq(V::load(l + i + 2 * V::width), V::load(r + i + 2 * V::width));
+        const auto e3 = V::eq(V::load(l + i + 3 * V::width), V::load(r + i + 3 * V::width));
+        if (!V::all(V::and_(V::and_(e0, e1), V::and_(e2, e3)))) {
+            break;
+        }
+    }
+    for (; i + V::width <= n; i += V::width) {
+        if (const uint32_t m = ~V::eq_mask(V::load(l + i), V::load(r + i)) & all) {
+            return i + lowest_bit(m) / sizeof(wchar_t);
+        }
+    }
+    for (; i < n; ++i) {
+        if (l[i] != r[i]) {
+            return i;
+        }
+    }
+    return n;
+}
+
+// Compares the first and last character of the needle at 'width' positions at once and only
+// checks the remaining characters of the candidates found this way.
+template<typename V>
+size_t vec_find(const wchar_t* s, size_t n, const wchar_t* needle, size_t m) {
+    const auto first = V::broadcast(needle[0]);
+    const auto last = V::broadcast(needle[m - 1]);
+    const auto middle_bytes = (m - 2) * sizeof(wchar_t);
+    size_t i = 0;
+    for (; i + m - 1 + V::width <= n; i += V::width) {
+        uint32_t mask = V::eq_mask(V::load(s + i), first) & V::eq_mask(V::load(s + i + m - 1), last) & lane_bits;
+        while (mask) {
+            const size_t pos = i + lowest_bit(mask) / sizeof(wchar_t);
+            if (std::memcmp(s + pos + 1, needle + 1, middle_bytes) == 0) {
+                return pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    for (; i + m <= n; ++i) {
+        if (s[i] == needle[0] && std::memcmp(s + i + 1, needle + 1, (m - 1) * sizeof(wchar_t)) == 0) {
+            return i;
+        }
+    }
+    return kernel_npos;
+}
+
+template<typename V>
+constexpr string_kernel_table make_vec_kernel_table() {
+    return string_kernel_table{&vec_find_char<V>, &vec_rfind_char<V>, &vec_find<V>, &vec_mismatch<V>};
+}
+
+} // unnamed namespace
+
+} // namespace mjs
+
+#endif
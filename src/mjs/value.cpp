@@ -5,6 +5,9 @@
 #include <sstream>
 #include <cmath>
 #include <cstring>
+#include <cwchar>
+#include <charconv>
+#include <iterator>
 
 namespace mjs {
 
@@ -32,12 +35,20 @@ const char* string_value(value_type t) {
 // reference
 //
 
+string reference::property_name() const {
+    return has_index() ? string{base_.heap(), index_string(index_)} : property_name_;
+}
+
 value reference::get_value() const {
-    return base_->get(property_name_.view());
+    return has_index() ? base_->get_index(index_) : base_->get(property_name_);
 }
 
 void reference::put_value(const value& val) const {
-    base_->put(property_name_, val);
+    if (has_index()) {
+        base_->put_index(index_, val);
+    } else {
+        base_->put(property_name_, val);
+    }
 }
 
 //
@@ -107,7 +118,7 @@ bool operator==(const value& l, const value& r) {
         const double lv = l.number_value(), rv = r.number_value();
         return lv == rv || (std::isnan(lv) && std::isnan(rv));
     }
-    case value_type::string:    return l.string_value().view() == r.string_value().view();
+    case value_type::string:    return l.string_value() == r.string_value();
     case value_type::object:    return l.object_value().get() == r.object_value().get();
     case value_type::reference: break;
     }
@@ -233,40 +244,118 @@ uint16_t to_uint16(const value& v) {
     return to_uint16(to_number(v));
 }
 
-std::wstring do_format_double(double m, int k) {
-    assert(k >= 1);             // k is the number of decimal digits in the representation
-    int n;                      // n is the position of the decimal point in s
-    int sign;                   // sign is set if the value is negative (never true since to_string handles that)
-#ifdef _MSC_VER
-    char s[_CVTBUFSIZE + 1];    // s is the decimal representation of the number
-    _ecvt_s(s, m, k, &n, &sign);
-#else
-    const char* s = ecvt(m, k, &n, &sign);
-#endif
-    assert(sign == 0);
+// Writes the digits of 'n' backwards from 'end', returns the position of the first digit
+template<typename CharT>
+CharT* format_integer(CharT* end, uint64_t n) {
+    do {
+        *--end = static_cast<CharT>('0' + n % 10);
+        n /= 10;
+    } while (n);
+    return end;
+}
+
+int format_number(wchar_t* buffer, double m) {
+    wchar_t* p = buffer;
+
+    // Handle special cases
+    if (std::isnan(m)) {
+        std::wmemcpy(p, L"NaN", 3);
+        return 3;
+    }
+    if (m == 0) {
+        *p = L'0';
+        return 1;
+    }
+    if (m < 0) {
+        *p++ = L'-';
+        m = -m;
+    }
+    if (std::isinf(m)) {
+        std::wmemcpy(p, L"Infinity", 8);
+        return static_cast<int>(p - buffer) + 8;
+    }
+
+    assert(std::isfinite(m) && m > 0);
+
+    // 9.8.1 ToString Applied to the Number Type
+
+    // Fast path for integers that are exactly representable (this includes all array indices)
+    if (m < 9007199254740992.0 && m == std::floor(m)) {
+        wchar_t digits[20];
+        const auto first = format_integer(std::end(digits), static_cast<uint64_t>(m));
+        const auto len = std::end(digits) - first;
+        std::wmemcpy(p, first, len);
+        return static_cast<int>(p - buffer + len);
+    }
+
+    // std::to_chars produces the shortest representation that round trips. In scientific
+    // notation ("d[.ddd]e[+-]xx") the k digits of s and n are easily extracted.
+    char sci[number_buffer_size];
+    const auto res = std::to_chars(std::begin(sci), std::end(sci), m, std::chars_format::scientific);
+    assert(res.ec == std::errc{});
+    char s[17];                 // s holds the digits of the decimal representation
+    int k = 0;                  // k is the number of decimal digits in the representation
+    const char* c = sci;
+    for (; *c != 'e'; ++c) {
+        if (*c != '.') {
+            assert(k < 17);
+            s[k++] = *c;
+        }
+    }
+    const bool negative_exponent = *++c == '-';
+    int exponent = 0;
+    for (++c; c != res.ptr; ++c) {
+        exponent = exponent * 10 + (*c - '0');
+    }
+    const int n = (negative_exponent ? -exponent : exponent) + 1; // n is the position of the decimal point in s
+
+    auto put_digits = [&p](const char* first, const char* last) {
+        for (; first != last; ++first) {
+            *p++ = static_cast<wchar_t>(*first);
+        }
+    };
+    auto put_zeros = [&p](int count) {
+        for (; count > 0; --count) {
+            *p++ = L'0';
+        }
+    };
+    auto put_exponent = [&p](int e) {
+        *p++ = L'e';
+        *p++ = e >= 0 ? L'+' : L'-';
+        wchar_t digits[4];
+        for (auto d = format_integer(std::end(digits), static_cast<uint64_t>(std::abs(e))); d != std::end(digits); ++d) {
+            *p++ = *d;
+        }
+    };
 
-    std::wostringstream woss;
     if (k <= n && n <= 21) {
         // 6. If k <= n <= 21, return the string consisting of the k digits of the decimal
         // representation of s (in order, with no leading zeroes), followed by n - k
         // occurences of the character 0
-        woss << s << std::wstring(n-k, '0');
+        put_digits(s, s + k);
+        put_zeros(n - k);
     } else if (0 < n && n <= 21) {
         // 7. If 0 < n <= 21, return the string consisting of the most significant n digits
         // of the decimal representation of s, followed by a decimal point ., followed
         // by the remaining k - n digits of the decimal representation of s.
-        woss << std::wstring(s, s + n) << '.' << std::wstring(s + n, s + std::strlen(s));
+        put_digits(s, s + n);
+        *p++ = L'.';
+        put_digits(s + n, s + k);
     } else if (-6 < n && n <= 0) {
         // 8. If -6 < n <= 0, return the string consisting of the character 0, followed
         // by a decimal point ., followed by -n occurences of the character 0, followed
         // by the k digits of the decimal representation of s.
-        woss << "0." << std::wstring(-n, '0') << s;
+        *p++ = L'0';
+        *p++ = L'.';
+        put_zeros(-n);
+        put_digits(s, s + k);
     } else if (k == 1) {
         // 9.  Otherwise, if k = 1, return the string consisting of the single digit of s,
         // followed by lowercase character e, followed by a plus sign + or minus sign
         // - according to whether n - 1 is positive or negative, followed by the decimal
         // representation of the integer abs(n - 1) (with no leading zeros).
-        woss << s << 'e' << (n-1>=0?'+':'-') << std::abs(n-1);
+        put_digits(s, s + 1);
+        put_exponent(n - 1);
     } else {
         // 10. Return the string consisting of the most significant digit of the decimal
         // representation of s, followed by a decimal point ., followed by the remaining
@@ -274,46 +363,23 @@ std::wstring do_format_double(double m, int k) {
         // e, followed by a plus sign + or minus sign - according to whether n - 1 is positive
         // or negative, followed by the decimal representation of the integer abs(n - 1)
         // (with no leading zeros)
-        woss << s[0] << '.' << s+1 << 'e' << (n-1>=0?'+':'-') << std::abs(n-1);
+        put_digits(s, s + 1);
+        *p++ = L'.';
+        put_digits(s + 1, s + k);
+        put_exponent(n - 1);
     }
-    return woss.str();
+    assert(p - buffer <= number_buffer_size);
+    return static_cast<int>(p - buffer);
 }
 
 std::wstring to_string(double m) {
-    // Handle special cases
-    if (std::isnan(m)) {
-        return L"NaN";
-    }
-    if (m == 0) {
-        return L"0";
-    }
-    if (m < 0) {
-        return L"-" + to_string(-m);
-    }
-    if (std::isinf(m)) {
-        return L"Infinity";
-    }
-
-    assert(std::isfinite(m) && m > 0);
-
-    // 9.8.1 ToString Applied to the Number Type    
-
-    // Use really slow method to determine shortest representation of m
-    for (int k = 1; k <= 17; ++k) {
-        std::ostringstream woss;
-        woss.precision(k);
-        woss << std::defaultfloat << m;
-        if (double t; std::istringstream{woss.str()} >> t && t == m) {
-            return do_format_double(m, k);
-        }
-    }
-    // More than 17 digits should never happen
-    assert(false);
-    NOT_IMPLEMENTED(m);
+    wchar_t buffer[number_buffer_size];
+    return std::wstring(buffer, format_number(buffer, m));
 }
 
 string to_string(gc_heap& h, double m) {
-    return string{h, to_string(m)};
+    wchar_t buffer[number_buffer_size];
+    return string{h, std::wstring_view(buffer, format_number(buffer, m))};
 }
 
 string to_string(gc_heap& h, const value& v) {
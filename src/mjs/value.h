@@ -36,19 +36,28 @@ using object_ptr = gc_heap_ptr<object>;
 // 8.7
 class reference {
 public:
-    explicit reference(const object_ptr& base, const string& property_name) : base_(base), property_name_(property_name) {
+    explicit reference(const object_ptr& base, const string& property_name) : base_(base), property_name_(property_name), index_(UINT32_MAX) {
         assert(base);
     }
 
+    // Reference to the property named by the array index 'index', the name is only created if it's actually needed
+    explicit reference(const object_ptr& base, uint32_t index) : base_(base), property_name_(nullptr), index_(index) {
+        assert(base && index != UINT32_MAX);
+    }
+
     const object_ptr& base() const { return base_; }
-    const string& property_name() const { return property_name_; }
+    string property_name() const;
+
+    bool has_index() const { return index_ != UINT32_MAX; }
+    uint32_t index() const { assert(has_index()); return index_; }
 
     value get_value() const;
     void put_value(const value& val) const;
 
 private:
     object_ptr base_;
-    string property_name_;
+    string property_name_; // Only valid if !has_index()
+    uint32_t index_;
 };
 
 class value {
@@ -120,6 +129,12 @@ uint16_t to_uint16(const value& v);
 string to_string(gc_heap& h, double n);
 string to_string(gc_heap& h, const value& v);
 
+// Large enough for any number formatted by format_number
+constexpr int number_buffer_size = 32;
+
+// Formats 'm' as described in 9.8.1 into 'buffer' (which must hold at least number_buffer_size characters) and returns the length
+int format_number(wchar_t* buffer, double m);
+
 void debug_print(std::wostream& os, const value& v, int indent_incr, int max_nest = INT_MAX, int indent = 0);
 std::wstring debug_string(const value& v);
 
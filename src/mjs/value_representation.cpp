@@ -8,35 +8,6 @@ namespace mjs {
 
 static_assert(sizeof(value_representation) == gc_heap::slot_size);
 
-// sign bit, exponent (11-bits), fraction (52-bits)
-// NaNs have exponent 0x7ff and fraction != 0
-static constexpr int type_shift         = 52-4;
-static constexpr uint64_t nan_bits      = 0x7ffULL << 52;
-static constexpr uint64_t type_bits     = 0xfULL << type_shift;
-
-constexpr bool is_special(uint64_t repr) {
-    return (repr & nan_bits) == nan_bits && (repr & type_bits) != 0;
-}
-
-constexpr value_type type_from_repr(uint64_t repr) {
-    return static_cast<value_type>(((repr&type_bits)>>type_shift)-1);
-}
-
-constexpr uint64_t make_repr(value_type type, uint32_t payload) {
-    return nan_bits | (static_cast<uint64_t>(type)+1)<<type_shift | payload;
-}
-
-static uint64_t number_repr(double d) {
-    if (std::isnan(d)) {
-        // Make sure all NaNs are handled uniformly - In particular don't allow arbitrary NaNs to be turned into the raw representation
-        return nan_bits | 1;
-    }
-    uint64_t repr;
-    static_assert(sizeof(d) == sizeof(repr));
-    std::memcpy(&repr, &d, sizeof(repr));
-    return repr;
-}
-
 value_representation::value_representation(const value& v) {
     switch (v.type()) {
     case value_type::undefined: [[fallthrough]];
@@ -54,6 +25,10 @@ value_representation::value_representation(const value& v) {
 }
 
 value value_representation::get_value(gc_heap& heap) const {
+    static_assert(hole_repr == make_repr(value_type::undefined, 1));
+    static_assert(undefined_repr == make_repr(value_type::undefined, 0));
+    static_assert(false_repr == make_repr(value_type::boolean, 0));
+    assert(!is_hole());
     if (!is_special(repr_)) {
         double d;
         static_assert(sizeof(d) == sizeof(repr_));
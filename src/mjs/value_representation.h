@@ -2,19 +2,103 @@
 #define MJS_VALUE_REPRESENTATION_H
 
 #include <stdint.h>
+#include <cstring>
+#include <cassert>
+#include <cmath>
 
 namespace mjs {
 
 class value;
 class gc_heap;
+enum class value_type;
 
 class value_representation {
 public:
     value_representation() = default;
     explicit value_representation(const value& v);
+    explicit value_representation(double d) : repr_(number_repr(d)) {}
     value get_value(gc_heap& heap) const;
     void fixup(gc_heap& old_heap);
+
+    // Marker for missing values (e.g. holes in arrays), get_value() must not be called for it
+    static value_representation hole() {
+        value_representation r;
+        r.repr_ = hole_repr;
+        return r;
+    }
+    bool is_hole() const { return repr_ == hole_repr; }
+
+    // The following allow handling the most common cases without converting to/from value
+
+    static value_representation undefined() {
+        value_representation r;
+        r.repr_ = undefined_repr;
+        return r;
+    }
+
+    static value_representation boolean(bool b) {
+        value_representation r;
+        r.repr_ = false_repr | b;
+        return r;
+    }
+
+    bool is_number() const { return !is_special(repr_); }
+    bool is_boolean() const { return (repr_ & ~uint64_t{1}) == false_repr; }
+
+    double number_value() const {
+        assert(is_number());
+        double d;
+        static_assert(sizeof(d) == sizeof(repr_));
+        std::memcpy(&d, &repr_, sizeof(d));
+        return d;
+    }
+
+    bool boolean_value() const {
+        assert(is_boolean());
+        return repr_ & 1;
+    }
+
+    // For code generators (see jit_x64.cpp): The raw bits of the representation, numbers are stored as is and a
+    // representation is a number if bits 48-62 (the exponent and top of the fraction) are at most max_number_tag().
+    uint64_t raw() const { return repr_; }
+    static constexpr uint32_t max_number_tag() { return static_cast<uint32_t>(nan_bits >> type_shift); }
+
 private:
+    // sign bit, exponent (11-bits), fraction (52-bits)
+    // NaNs have exponent 0x7ff and fraction != 0, special values are NaNs with the value type (plus one) stored in
+    // the 4 most significant bits of the fraction and the payload in the lower 32-bits.
+    static constexpr int      type_shift = 52-4;
+    static constexpr uint64_t nan_bits   = 0x7ffULL << 52;
+    static constexpr uint64_t type_bits  = 0xfULL << type_shift;
+
+    // Undefined with a non-zero payload
+    static constexpr uint64_t hole_repr      = 0x7ff1000000000001ULL;
+    static constexpr uint64_t undefined_repr = 0x7ff1000000000000ULL;
+    static constexpr uint64_t false_repr     = 0x7ff3000000000000ULL;
+
+    static constexpr bool is_special(uint64_t repr) {
+        return (repr & nan_bits) == nan_bits && (repr & type_bits) != 0;
+    }
+
+    static constexpr value_type type_from_repr(uint64_t repr) {
+        return static_cast<value_type>(((repr&type_bits)>>type_shift)-1);
+    }
+
+    static constexpr uint64_t make_repr(value_type type, uint32_t payload) {
+        return nan_bits | (static_cast<uint64_t>(type)+1)<<type_shift | payload;
+    }
+
+    static uint64_t number_repr(double d) {
+        if (std::isnan(d)) {
+            // Make sure all NaNs are handled uniformly - In particular don't allow arbitrary NaNs to be turned into the raw representation
+            return nan_bits | 1;
+        }
+        uint64_t repr;
+        static_assert(sizeof(d) == sizeof(repr));
+        std::memcpy(&repr, &d, sizeof(repr));
+        return repr;
+    }
+
     uint64_t repr_;
 };
 
@@ -2,11 +2,15 @@
 #include <cmath>
 #include <cstring>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
 
 #include <mjs/interpreter.h>
 #include <mjs/parser.h>
 #include <mjs/printer.h>
 #include <mjs/object.h>
+#include <mjs/jit.h>
 
 #include "test_spec.h"
 
@@ -123,6 +127,35 @@ void eval_tests() {
     test(L"var x = 0; for(var i = 10, dec = 1; i; i = i - dec) x = x + i; x", value{55.0});
     test(L"var x=0; for (i=2; i; i=i-1) x=x+i; x+i", value{3.0});
     test(L"for (var i=0;!i;) { i=1 }", value{1.});
+    test(L"function f() { var x=0; for(;;) break; x=1; return x+10; } f()", value{11.0});
+    test(L"function f() { for(var i=0;i<3;++i) { with (new Object()) { if (i) continue; } } return i; } f()", value{3.0});
+    test(L"function f() { 42; } f()", value::undefined);
+    test(L"function f(a,b) { var c = a; function g(d) { function h() { return c + d; } return h(); } return g(b); } f(1,2)", value{3.0});
+    test(L"function counter() { var n = 0; function next() { return ++n; } return next; } c = counter(); c(); c(); c()", value{3.0});
+    test(L"function f(a) { var a; return a; } f(42)", value{42.0});
+    test(L"function f(a, a) { return a; } f(1, 2)", value{2.0});
+    test(L"function f(arguments) { return arguments; } f(42)", value{42.0});
+    test(L"function f(x) { delete x; return x; } f(42)", value{42.0});
+    test(L"function f() { var x = 1; function g() { return eval('x'); } return g(); } f()", value{1.0});
+    test(L"function f() { var x = 1; o = new Object(); o.x = 2; with (o) { function g() { return x; } } return o.g(); } f()", value{2.0});
+    test(L"x = 1; function f() { var y = x; function g() { return x + y; } return g(); } f()", value{2.0});
+    test(L"function f(a, a) { return a; } f(1)", value::undefined);
+    test(L"function f(a) { function g() { a = a + 1; } g(); g(); return a; } f(1)", value{3.0});
+    test(L"function f(a, b) { function g() { return b; } var c = a * 2; return c + g(); } f(2, 3)", value{7.0});
+    test(L"function f(x) { function g() { function h() { return x; } return h; } return g()(); } f(5)", value{5.0});
+    test(L"function fact(n) { var r = 1; if (n > 1) r = n * fact(n - 1); return r; } fact(5)", value{120.0});
+    test(L"function f() { function g(x) { return x; } return g; } a = f(); b = f(); a != b && a.toString() == b.toString() && a.length == 1", value{true});
+    test(L"for (i = 0; i < 100; ++i) { g = Function('x', 'return x + ' + i); } g(1)", value{100.0});
+    // Local variables updated in place and operators combined with constants or jumps
+    test(L"function f() { var x = 1; x = x + 1; x += x; x++; ++x; x -= 0.5; return x; } f()", value{5.5});
+    test(L"function f() { var x = 5; x += (x = 1); return x; } f()", value{6.0});
+    test(L"y = 10; function f() { var x = 2, z = 3; x = z - x; z = y - z; x = y - x; return x * z; } f()", value{63.0});
+    test(L"function f() { var x = 1; x = x ? 5 : x; x = x.toString() + x; return x; } f()", value{string{h, "55"}});
+    test(L"function f(a) { var x = 2; x = a(x, x); x = new Number(x); return x + 1; } f(Math.pow)", value{5.0});
+    test(L"function f(b) { var n = 0; for (var i = '0'; i < b; i += 1) ++n; return n; } f(3)", value{2.0});
+    test(L"function f(x) { if (x < 1) return 1; if (x >= 1) return 2; return 3; } '' + f(NaN) + f(0) + f(5) + f('2') + f(undefined)", value{string{h, "31223"}});
+    test(L"function f(s) { return s + 1 + (s < 10) + (s & 3); } f('9')", value{string{h, "91true1"}});
+    test(L"function f(n) { var i = 0, j = 0; while (i < n) { i++; j--; } do_ = 0; for (; j <= -2; j += 2) ++do_; return i * 10 + do_; } f(4)", value{42.0});
     
     // for in statement
     // FIXME: The order of the objects are unspecified in earlier revisions of ECMAScript..
@@ -196,6 +229,14 @@ with(42) {
 
 
     test(L"function sum() {  var s = 0; for (var i = 0; i < arguments.length; ++i) s += arguments[i]; return s; } sum(1,2,3)", value{6.0});
+    test(L"function f(a) { arguments[0] = 2; return a + arguments[0]; } f(1)", value{3.0});
+    test(L"function f() { return eval('arguments.length'); } f(1,2)", value{2.0});
+    test(L"function f() { function g() { return arguments.length; } return g(1,2,3); } f()", value{3.0});
+    test(L"function f() { with (new Object()) { return arguments[1]; } } f(1,2)", value{2.0});
+    test(L"function f() { var s=''; for (var k in arguments) s+=k; return s; } f(1,2)", value{string{h, ""}});
+    test(L"function f(a,b) { delete arguments[0]; arguments[1]=5; return typeof arguments[0] + arguments[1] + arguments.length; } f(1,2)", value{string{h, "undefined52"}});
+    test(L"function f(a) { delete arguments[0]; arguments[0]=7; var s=''; for (var k in arguments) s+=k; return s+arguments[0]; } f(1)", value{string{h, "07"}});
+    test(L"function f() { arguments[3]=4; return arguments.length + arguments[3]; } f(1)", value{5.0});
     // Object
     test(L"''+Object(null)", value{string{h, "[object Object]"}});
     test(L"o=Object(null); o.x=42; o.y=60; o.x+o['y']", value{102.0});
@@ -315,6 +356,35 @@ function f(x) {
     test(L"+new Array(1,2)", value{NAN});
     // Make sure we handle "large" arrays
     test(L"a=new Array(500);for (var i=0; i<a.length; ++i) a[i] = i; sum=0; for (var i=0; i<a.length; ++i) sum += a[i]; sum", value{499*500/2.});
+    // Holes and sparse elements
+    test(L"a=new Array(); a[3]=1; a[1]=2; var s=''; for (var k in a) s+=k+','; s", value{string{h, "1,3,"}});
+    test(L"a=new Array(1,2,3); delete a[1]; ''+a", value{string{h, "1,,3"}});
+    test(L"a=new Array(1,2,3); delete a[1]; ''+a.length+a[1]", value{string{h, "3undefined"}});
+    test(L"a=new Array(); a[1000000]=1; a[2]=3; a.length+','+a[1000000]+','+a[2]+','+a[1]", value{string{h, "1000001,1,3,undefined"}});
+    test(L"a=new Array(); a[100]=1; for (var i=0; i<100; ++i) a[i]=i; var s=0; for (var i=0; i<a.length; ++i) s+=a[i]; s", value{4951.0});
+    test(L"a=new Array(); a[100]=1; a[1]=2; a.length=50; a.length+','+a[100]+','+a[1]", value{string{h, "50,undefined,2"}});
+    test(L"a=new Array(); a[100]=1; a[1]=2; a.length=0; a[100]=3; a.length+','+a[1]", value{string{h, "101,undefined"}});
+    test(L"a=new Array(4000000000); a.length+','+a[3999999999]", value{string{h, "4000000000,undefined"}});
+    test(L"a=new Array(1,2); a.x=3; a['1']=4; ''+a+a.x", value{string{h, "1,43"}});
+    test(L"function F(){} F.prototype=new Array(5,6); var o=new F(); o[0]+o[1]+o.length", value{13.0});
+    // Element kind transitions
+    test(L"a=new Array(); a[0]=1; a[1]=2.5; a[2]=-0; a[3]=0/0; ''+a+','+(1/a[2])", value{string{h, "1,2.5,0,NaN,-Infinity"}});
+    test(L"a=new Array(); a[0]=2147483647; a[0]+=1; a[1]=-2147483648; a[1]-=1; a[0]+','+a[1]", value{string{h, "2147483648,-2147483649"}});
+    test(L"a=new Array(1,2); a[1]='x'; a[2]=3; ''+a", value{string{h, "1,x,3"}});
+    test(L"a=new Array(1,2); a[5]=1; ''+a", value{string{h, "1,2,,,,1"}});
+    test(L"a=new Array(1,2); a.length=4; ''+a+a.length", value{string{h, "1,2,,4"}});
+    test(L"a=new Array(1,2,3); a.length=1; a[1]=5; ''+a+a.length", value{string{h, "1,52"}});
+    test(L"a=new Array(1.5,2,3); delete a[0]; a[0]=1; ''+a", value{string{h, "1,2,3"}});
+    test(L"''+new Array(10,9,1,100,-5).sort()", value{string{h, "-5,1,10,100,9"}});
+    test(L"''+new Array(0.5,10,2.25,1e21).sort()", value{string{h, "0.5,10,1e+21,2.25"}});
+    test(L"''+new Array(1.5,2,3).reverse()+';'+new Array(1,2,3,4).reverse().join('-')", value{string{h, "3,2,1.5;4-3-2-1"}});
+    test(L"a=new Array(); for (var i=0; i<100; ++i) a[i]=i*0.5; s=0; for (var i=0; i<a.length; ++i) s+=a[i]; s", value{2475.0});
+    // Numeric subscripts (only array indices use the index path)
+    test(L"a=new Array(); a[1.5]=1; a[-1]=2; a[4294967295]=3; a[-0]=4; ''+a.length+a['1.5']+a['-1']+a['4294967295']+a['0']", value{string{h, "11234"}});
+    test(L"o=new Object(); o[1]=2; o[4294967294]=3; o['1']+o['4294967294']", value{5.0});
+    test(L"Array.prototype[1]='p'; a=new Array(1,2,3); delete a[1]; a[1]+a[5]", value{string{h, "pundefined"}});
+    test(L"s=new String('ab'); s[0]='x'; s[0]+s[1]", value{string{h, "xundefined"}});
+    test(L"a=new Array(3,1,2); a.sort(); a.reverse(); a[0]*100+a[1]*10+a[2]", value{321.0});
 
     // String
     test(L"String()", value{string{h, ""}});
@@ -356,6 +426,8 @@ function f(x) {
     test(L"'foo bar'.substring(1, 0)", value{string{h, "f"}});
     test(L"'foo bar'.substring(1000, -1)", value{string{h, "foo bar"}});
     test(L"'foo bar'.substring(1, 4)", value{string{h, "oo "}});
+    test(L"var s='a string long enough to be sliced'.substring(2); s+'|'+s.substring(7,18)+'|'+s.length", value{string{h, "string long enough to be sliced|long enough|31"}});
+    test(L"'first part of the text|second part of the text'.split('|')+''", value{string{h, "first part of the text,second part of the text"}});
     test(L"'ABc'.toLowerCase()", value{string{h, "abc"}});
     test(L"'ABc'.toUpperCase()", value{string{h, "ABC"}});
     // Boolean
@@ -377,6 +449,9 @@ function f(x) {
     test(L"Number.MIN_VALUE", value{5e-324});
     test(L"Number('1.2')", value{1.2});
     test(L"Number('1,2')", value{NAN});
+    test(L"Number(' 0x10 ')", value{16.0});
+    test(L"'1.5'==1.5", value{true});
+    test(L"var a=new Array(); a['01']=1; a['1']=2; a.length", value{2.0});
     test(L"new Number(42.42).toString()", value{string{h, "42.42"}});
     test(L"''+new Number(60)", value{string{h, "60"}});
     test(L"new Number(123).valueOf()", value{123.0});
@@ -421,6 +496,7 @@ eval(true) //$ boolean true
 eval(new String('123')).length //$ number 3
 eval('1+2*3') //$ number 7
 x42=50; eval('x'+42+'=13'); x42 //$ number 13
+function f() { eval('var y = 2'); return y; }; f() //$ number 2
 )");
 
     // parseInt
@@ -445,6 +521,9 @@ parseFloat('0'); //$ number 0
 parseFloat(42); //$ number 42
 parseFloat(' 42.25x'); //$ number 42.25
 parseFloat('h'); //$ number NaN
+parseFloat('-.5e1'); //$ number -5
+parseFloat('Infinityx'); //$ number Infinity
+parseFloat('1e1000'); //$ number Infinity
 )");
 
     // escape / unescape
@@ -620,6 +699,64 @@ x++; x //$ number 2
 )");
 }
 
+void test_inline_caches() {
+    gc_heap h{1<<10};
+    // Member accesses seeing many different shapes
+    test(L"function get(o) { return o.x; } var s = 0; for (var i = 0; i < 6; ++i) { var o = new Object(); if (i & 1) o.y = 1; if (i & 2) o.z = 1; if (i & 4) o.w = 1; o.x = i; s += get(o); } s", value{15.0});
+    // Changing, shadowing and deleting properties after they've been cached
+    test(L"function F(){} F.prototype.v=1; var o=new F(); var s=0; for (var i=0;i<4;++i) { s=s*10+o.v; if (i==0) F.prototype.v=2; if (i==1) o.v=3; if (i==2) delete o.v; } s", value{1232.0});
+    test(L"var o = new Object(); o.a = 1; o.b = 2; var s = ''; for (var i = 0; i < 3; ++i) { s += o.b; if (i == 0) delete o.a; if (i == 1) o.b = 3; } s", value{string{h, "223"}});
+    test(L"var o = new Object(); for (var i = 0; i < 70; ++i) o['p'+i] = i; var s = 0; for (var i = 0; i < 2; ++i) { s += o.p1; o.p1 = 10; } s", value{11.0});
+    // Identifiers resolved in different scopes
+    test(L"var x=1; var o=new Object(); var s=''; for (var i=0;i<2;++i) { with(o) { s+=x; } o.x=2; } s", value{string{h, "12"}});
+    test(L"zz=1; var t=0; for (var i=0;i<3;++i) { t = t*10 + zz; delete zz; zz=i+2; } t", value{123.0});
+    test(L"function outer(a) { function inner(b) { return a+b; } return inner(1); } outer(1)+outer(2)", value{5.0});
+    test(L"function f(a, b) { return a+b; } function g(b, a) { return a*b; } f(1,2)+g(3,4)+f(5,6)", value{26.0});
+    // Assignments that can't be done through the cache
+    test(L"var a=new Array(1,2,3); var s=''; for (var i=0;i<2;++i) { a.length = 2-i; s+=a.length; } s+a[1]", value{string{h, "21undefined"}});
+    test(L"function f(a, b) {} var s = ''; for (var i = 0; i < 2; ++i) { f.length = 3; s += f.length; } s", value{string{h, "22"}});
+}
+
+void test_typed_arrays() {
+    gc_heap h{1<<10};
+    test(L"b=new ArrayBuffer(8); ''+b.byteLength+','+new ArrayBuffer(0).byteLength+','+b.slice(2,-1).byteLength+','+b.slice(-3).byteLength", value{string{h, "8,0,5,3"}});
+    test(L"a=new Uint8Array(3); a[0]=256; a[1]=-1; a[2]=3.7; a[3]=1; a['1']+=2; ''+a+','+a.length+','+a[3]+','+Uint8Array.BYTES_PER_ELEMENT", value{string{h, "0,1,3,3,undefined,1"}});
+    test(L"a=new Int8Array(new Array(127,128,-129)); ''+a", value{string{h, "127,-128,127"}});
+    test(L"a=new Int16Array(2); a[0]=40000; a[1]=-32769; ''+a+','+new Uint16Array(a)", value{string{h, "-25536,32767,40000,32767"}});
+    test(L"''+new Int32Array(new Array(4294967295, 2147483648))+','+new Uint32Array(new Array(-1, 1))", value{string{h, "-1,-2147483648,4294967295,1"}});
+    test(L"''+new Float32Array(new Array(0.5, 0.1, 'x'))[2]+','+(new Float32Array(new Array(0.1, 0))[0] == 0.1)+','+new Float64Array(new Array(0.1, 0))[0]", value{string{h, "NaN,false,0.1"}});
+    // Views sharing a buffer
+    test(L"b=new ArrayBuffer(8); u=new Uint8Array(b); i=new Int32Array(b, 4, 1); i[0]=-2; s=i.subarray(0); s[0]=1; ''+u+','+i.byteOffset+','+i.byteLength+','+(s.buffer==b)", value{string{h, "0,0,0,0,1,0,0,0,4,4,true"}});
+    test(L"a=new Uint8Array(4); a.set(new Array(1,2), 1); a.subarray(1,3).set(a.subarray(2)); a.join('-')", value{string{h, "0-2-0-0"}});
+    test(L"a=new Uint16Array(2); a.length=5; delete a[0]; a.x=1; var s=''; for (var k in a) s+=k+','; s+a.length", value{string{h, "0,1,x,2"}});
+    // DataView
+    test(L"d=new DataView(new ArrayBuffer(8), 1); d.setInt16(0, -2); d.setUint32(2, 0x01020304, true); ''+d.byteLength+','+d.getUint16(0)+','+d.getUint8(1)+','+d.getUint32(2)+','+d.getInt32(2,true)", value{string{h, "7,65534,254,67305985,16909060"}});
+    test(L"d=new DataView(new ArrayBuffer(12)); d.setFloat64(0, -1.5); d.setFloat32(8, 0.5, true); ''+d.getFloat64(0)+','+d.getUint8(0)+','+d.getFloat32(8, true)+','+d.getInt8(0)", value{string{h, "-1.5,191,0.5,-65"}});
+}
+
+void test_map_file() {
+    gc_heap h{1<<10};
+    const char* const filename = "mjs_map_file_test.bin";
+    {
+        std::ofstream out{filename, std::ios::binary};
+        const char data[] = {1, 2, 3, 4, 5, '\xff'};
+        out.write(data, sizeof(data));
+    }
+    test(L"b=mjs.mapFile('mjs_map_file_test.bin'); u=new Uint8Array(b); s=0; for (var i=0; i<u.length; ++i) s+=u[i]; u[0]=9; ''+b.byteLength+','+s+','+u[0]+','+new DataView(b).getUint16(0)", value{string{h, "6,270,9,2306"}});
+    {
+        // Writes through the mapping don't change the file
+        std::ifstream in{filename, std::ios::binary};
+        if (in.get() != 1) {
+            THROW_RUNTIME_ERROR("File changed by writing to mapping");
+        }
+    }
+    {
+        std::ofstream out{filename, std::ios::binary};
+    }
+    test(L"mjs.mapFile('mjs_map_file_test.bin').byteLength", value{0.0});
+    std::remove(filename);
+}
+
 void test_long_object_chain() {
     test(LR"(
 var l = null;
@@ -632,14 +769,128 @@ null
 )", value::null);
 }
 
+void test_runtime_errors() {
+    auto test_eval_fails = [](const wchar_t* text, const char* expected_msg, int expected_trace_length) {
+        gc_heap h{1<<20};
+        auto bs = parse(std::make_shared<source_file>(L"test", text));
+        try {
+            interpreter i{h, *bs};
+            for (const auto& s: bs->l()) {
+                i.eval(*s);
+            }
+        } catch (const std::exception& e) {
+            // The message is followed by one line per position in the stack trace
+            const std::string msg = e.what();
+            if (msg.find(expected_msg) == std::string::npos || std::count(msg.begin(), msg.end(), '\n') != expected_trace_length) {
+                std::wcout << "Test failed: " << text << " unexpected error: " << msg.c_str() << "\n";
+                THROW_RUNTIME_ERROR("Wrong error");
+            }
+            return;
+        }
+        std::wcout << "Test failed: " << text << " no error thrown\n";
+        THROW_RUNTIME_ERROR("No error");
+    };
+
+    test_eval_fails(L"x = 1; x()", "is not a function", 1);
+    test_eval_fails(L"function g(o) { return o.f(); }\nfunction f() { return g(new Object()); }\nf()", "is not a function", 3);
+    test_eval_fails(L"function f(x) { return new x(); }\nf(42)", "is not an object", 2);
+    // Errors propagating out of native functions calling back into code
+    test_eval_fails(L"function cmp(x, y) { return x(); }\na = new Array(1, 2); a.sort(cmp)", "is not a function", 2);
+}
+
+void test_constant_folding() {
+    gc_heap h{1<<10};
+    // Operators applied to literals are evaluated when compiling
+    test(LR"("a" + "b" + 1 + 2 + (1 + 2) + null + undefined + true + 1e21 + 0.1 + -0)", value{string{h, "ab123nullundefinedtrue1e+210.10"}});
+    test(LR"('' + (1 << 10) + ',' + (1 << 33) + ',' + (-1 >>> 0) + ',' + (-8 >> 1) + ',' + ~'7' + ',' + (5 & 3 | 8 ^ 2) + ',' + 7 % -3 + ',' + -7 % 3 + ',' + 1 / -0 + ',' + (0 / 0) + ',' + -'' + ',' + +'0x10' + ',' + 'x' * 2)", value{string{h, "1024,2,4294967295,-4,-8,11,1,-1,-Infinity,NaN,0,16,NaN"}});
+    test(LR"('' + (typeof 1) + (typeof 'x') + (typeof null) + (typeof undefined) + (typeof true) + (typeof !1) + (typeof void 0))", value{string{h, "numberstringobjectundefinedbooleanbooleanundefined"}});
+    test(LR"('' + (1 == '1') + (null == undefined) + (null == 0) + ('' == 0) + (true == 1) + (0/0 == 0/0) + (0 == -0) + ('a' != 'b') + (undefined == false) + (1 < 2) + (2 <= 1) + (0/0 >= 0) + ('10' > 9))", value{string{h, "truetruefalsetruetruefalsetruetruefalsetruefalsefalsetrue"}});
+    test(LR"('' + (0 && x) + (1 || x) + ('' || 'y') + (null && 1) + (1 ? 2 : x) + (0 ? x : 3) + (1, 2))", value{string{h, "01ynull232"}});
+    // Division by powers of two is done as multiplication
+    test(LR"(function f(x) { return x / 4 + ',' + x / -2 + ',' + x / 0.5 + ',' + x / 3 + ',' + 1 / (x / 8) + ',' + x / 1; }
+f(-0) + ';' + f(5) + ';' + f('6') + ';' + f(0/0) + ';' + f(1e-300 / 1e10) + ';' + f(1.7976931348623157e308))", value{string{h, "0,0,0,0,-Infinity,0;1.25,-2.5,10,1.6666666666666667,1.6,5;1.5,-3,12,2,1.3333333333333333,6;NaN,NaN,NaN,NaN,NaN,NaN;2.5e-311,-5e-311,2e-310,3.333333333333e-311,Infinity,1e-310;4.4942328371557893e+307,-8.988465674311579e+307,Infinity,5.992310449541053e+307,4.450147717014404e-308,1.7976931348623157e+308"}});
+    // Branches that can't be taken are left out
+    test(LR"(function g(n) { var s = 0; if (false) { s = 'dead'; } else s += 1; if (1) s += 2; else s = 'dead'; while (false) s = 'dead'; for (var i = 0; false; ++i) s = 'dead'; for (;1;) { if (++n > 3) break; s += n; } while ('x') { s += 10; break; } return s + ',' + i + ',' + n; } g(0))", value{string{h, "19,0,4"}});
+    test(L"if (0) 1; else 2", value{2.0});
+    test(L"if (0) 1", value::undefined);
+    test(L"var x = 1; while (false) x = 2; x", value{1.0});
+}
+
+void test_string_constants() {
+    // Loading string constants and typeof don't allocate (once the code has run)
+    gc_heap h{1<<20};
+    auto bs = parse(std::make_shared<source_file>(L"test", LR"(
+function f(n) {
+    var s, t, u, v;
+    for (var i = 0; i < n; ++i) {
+        s = 'abc'; t = typeof s; u = typeof i; v = typeof f;
+    }
+    return t + u + v;
+}
+f(1);
+f(10);
+f(1000);
+)"));
+    {
+        interpreter i{h, *bs};
+        std::vector<uint32_t> used;
+        for (const auto& s: bs->l()) {
+            const auto before = h.calc_used();
+            (void)i.eval(*s);
+            used.push_back(h.calc_used() - before);
+        }
+        if (used[2] != used[3]) {
+            std::wcout << "Test failed: " << used[2] << " slots used for 10 iterations, " << used[3] << " for 1000\n";
+            THROW_RUNTIME_ERROR("Allocations in loop");
+        }
+    }
+    h.garbage_collect();
+    if (h.calc_used()) {
+        THROW_RUNTIME_ERROR("Leaks");
+    }
+}
+
+void test_jit() {
+    gc_heap h{1<<10};
+    // Operands the machine code handles and those it leaves to the interpreter
+    test(L"function f(n) { var s = 0; for (var i = 0; i < n; ++i) { s += i * 0.5 - 1; } return s; } f(10)", value{12.5});
+    test(L"function f(a, b) { return a + b; } '' + f(1, 2) + f('1', 2) + f(1, true) + f(null, 1)", value{string{h, "31221"}});
+    test(L"function f(a, b) { return '' + (a < b) + (a <= b) + (a > b) + (a >= b) + (a == b) + (a != b); } f(0/0, 1) + f(1, 1) + f('2', 10)", value{string{h, "falsefalsefalsefalsefalsetruefalsetruefalsetruetruefalsetruetruefalsefalsefalsetrue"}});
+    test(L"function f(x) { var n = 0; while (x > 0) { x -= 1; ++n; } return n; } '' + f(3) + f('3') + f(0/0)", value{string{h, "330"}});
+    test(L"function f(a, b) { return '' + (a & b) + ',' + (a | b) + ',' + (a ^ b) + ',' + (a << b) + ',' + (a >> b) + ',' + (a >>> b) + ',' + ~a; } f(-5, 33) + ';' + f(4294967301, '1') + ';' + f(1e20, 1)", value{string{h, "33,-5,-38,-10,-3,2147483645,4;1,5,4,10,2,2,-6;0,1661992961,1661992961,-970981376,830996480,830996480,-1661992961"}});
+    test(L"function f(x) { var y = x & 255; return -x + ',' + +x + ',' + y + ',' + !x + ',' + (x / 0) + ',' + (0 * x / 0); } f(-1000) + ';' + f(true)", value{string{h, "1000,-1000,24,false,-Infinity,NaN;-1,1,1,false,Infinity,NaN"}});
+    test(L"function f(b) { var n = 0; if (b) n = 1; if (!b) n += 2; return n; } '' + f(true) + f(false) + f(1) + f('') + f(new Object())", value{string{h, "12121"}});
+    test(L"function f() { var s = ''; for (var p in Math) s += p; return s == ''; } f()", value{true});
+    test(L"function m(a, b) { return a % b; } '' + 1/m(-3, 3) + ',' + 1/m(0, 5) + ',' + m(7, -3) + ',' + m(-7, 3) + ',' + m(5.5, 2) + ',' + m(4, 0) + ',' + m(2147483648, 10) + ',' + m('8', 5)", value{string{h, "-Infinity,Infinity,1,-1,1.5,NaN,8,3"}});
+    // Loops keeping registers in machine registers
+    test(L"function f(n) { var s = 0; for (var i = 0; i < n; ++i) { if (i == 5) s = 'x'; s += i; } return s; } f(8)", value{string{h, "x567"}});
+    test(L"function g(x) { return x * 2; } function h(n) { var s = 0, t = 1; for (var i = 0; i < n; i++) { s = s + g(i); t = t * 3 % 7; } return s + ',' + t; } h(10)", value{string{h, "90,4"}});
+    test(L"function k(n) { var a = 0, b = 1, c; for (var i = 0; i < n; ++i) { c = a + b; a = b; b = c; if (c > 50) break; } return a + ',' + b + ',' + i; } k(100)", value{string{h, "34,55,8"}});
+    test(L"function w(n) { var s = 0; var o = new Object(); o.v = 2; while (n-- > 0) { s += o.v; if (n == 3) o.v = 'y'; } return s; } w(6)", value{string{h, "6yyy"}});
+    test(L"function u(n) { var x = 1e300, i = 0; for (; i < n; ++i) { x = x * x - x; } return x + ',' + (x - x) + ',' + (1 / -x); } u(1) + ';' + u(2)", value{string{h, "Infinity,NaN,0;NaN,NaN,NaN"}});
+}
+
 int main() {
     try {
-        eval_tests();
-        test_global_functions();
-        test_math_functions();
-        test_date_functions();
-        test_semicolon_insertion();
-        test_long_object_chain();
+        for (const bool jit: {false, true}) {
+            if (jit && !enable_jit(true)) {
+                break;
+            }
+            eval_tests();
+            test_global_functions();
+            test_math_functions();
+            test_date_functions();
+            test_semicolon_insertion();
+            test_inline_caches();
+            test_typed_arrays();
+            test_map_file();
+            test_long_object_chain();
+            test_runtime_errors();
+            test_constant_folding();
+            test_string_constants();
+            test_jit();
+        }
+        enable_jit(false);
     } catch (const std::exception& e) {
         std::cerr << e.what() << '\n';
         return 1;
@@ -4,6 +4,9 @@
 #include <mjs/value.h>
 #include <mjs/object.h>
 #include <mjs/gc_heap.h>
+#include <mjs/gc_table.h>
+#include <mjs/gc_string_table.h>
+#include <mjs/string_kernels.h>
 
 #define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
@@ -54,11 +57,162 @@ TEST_CASE("value - string") {
     REQUIRE(value{string{h,"Hello"}}.type() == value_type::string);
     REQUIRE(value{string{h,std::wstring_view{L"test"}}}.type() == value_type::string);
     REQUIRE(string{h,"test "} + string{h,"42"} == string{h,"test 42"});
+    REQUIRE(string{h,"test"}.hash() == string_hash(L"test"));
+    REQUIRE(string{h,"test"}.hash() != string{h,"tesT"}.hash());
+    REQUIRE(string{h,"a somewhat longer string that is hashed in blocks"}.hash() == string_hash(L"a somewhat longer string that is hashed in blocks"));
+    REQUIRE(std::hash<string>{}(string{h,""}) == string_hash(L""));
+    REQUIRE(!(string{h,"x"} == string{h,"y"}));
 
     h.garbage_collect();
     assert(h.calc_used() == 0);
 }
 
+TEST_CASE("string - substr") {
+    gc_heap h{256};
+    {
+        const std::wstring_view text = L"The quick brown fox jumps over the lazy dog";
+        const auto s = string{h, text};
+        REQUIRE(s.substr(0).unsafe_raw_get() == s.unsafe_raw_get());
+        REQUIRE(s.substr(4, 5).view() == L"quick");
+        REQUIRE(!s.substr(4, 5).unsafe_raw_get()->sliced());
+        REQUIRE(s.substr(100).view() == L"");
+        auto sl = s.substr(4);
+        REQUIRE(sl.unsafe_raw_get()->sliced());
+        REQUIRE(sl.view() == text.substr(4));
+        REQUIRE(sl == string{h, text.substr(4)});
+        REQUIRE(sl.hash() == string_hash(text.substr(4)));
+        auto sl2 = sl.substr(6, 20);
+        REQUIRE(sl2.unsafe_raw_get()->sliced());
+        REQUIRE(sl2.view() == text.substr(10, 20));
+        h.garbage_collect();
+        // Slices keep the parent alive and survive it being moved
+        REQUIRE(s.view() == text);
+        REQUIRE(sl.view() == text.substr(4));
+        REQUIRE(sl2.view() == text.substr(10, 20));
+    }
+    h.garbage_collect();
+    REQUIRE(h.calc_used() == 0);
+    {
+        auto sl = string{h, L"Only the slice of this string is kept alive"}.substr(5);
+        h.garbage_collect();
+        REQUIRE(sl.view() == L"the slice of this string is kept alive");
+    }
+    h.garbage_collect();
+    REQUIRE(h.calc_used() == 0);
+}
+
+TEST_CASE("string kernels") {
+    const auto best = current_string_kernels();
+    for (const auto isa: {string_kernel_isa::scalar, string_kernel_isa::sse2, string_kernel_isa::avx2}) {
+        if (select_string_kernels(isa) != isa) {
+            continue;
+        }
+        INFO("isa " << static_cast<int>(isa));
+        // Use a small alphabet to get plenty of (partial) matches at all offsets
+        std::wstring text;
+        for (int i = 0; i < 200; ++i) {
+            text.push_back(L"abc"[(i * 7 + i / 5) % 3]);
+        }
+        text.push_back(0x10000);
+        const std::wstring_view s{text};
+        for (size_t len = 0; len < 80; ++len) {
+            for (size_t start = 0; start < 8; ++start) {
+                const auto h = s.substr(start, len);
+                for (const wchar_t c: {L'a', L'b', L'c', L'x'}) {
+                    REQUIRE(string_find(h, c) == h.find(c));
+                    REQUIRE(string_rfind(h, c) == h.rfind(c));
+                    REQUIRE(string_find(h, c, 3) == h.find(c, 3));
+                    REQUIRE(string_rfind(h, c, 5) == h.rfind(c, 5));
+                }
+                for (const wchar_t* needle: {L"", L"a", L"ab", L"cab", L"abca", L"bcabca", L"abcabcabcabcabcabc", L"x"}) {
+                    REQUIRE(string_find(h, needle) == h.find(needle));
+                    REQUIRE(string_rfind(h, needle) == h.rfind(needle));
+                    REQUIRE(string_find(h, needle, 2) == h.find(needle, 2));
+                    REQUIRE(string_rfind(h, needle, 10) == h.rfind(needle, 10));
+                }
+                const std::wstring copy{h};
+                REQUIRE(string_equal(h, copy));
+                REQUIRE(string_compare(h, copy) == 0);
+                for (size_t i = 0; i < len; ++i) {
+                    auto modified = copy;
+                    modified[i] = L'b';
+                    REQUIRE(string_equal(h, modified) == (h == modified));
+                    REQUIRE((string_compare(h, modified) < 0) == (h < modified));
+                    REQUIRE((string_compare(modified, h) < 0) == (modified < h));
+                }
+                REQUIRE(string_compare(h, s.substr(start, len + 1)) < (len + start < s.length() ? 0 : 1));
+            }
+        }
+        REQUIRE(string_compare(L"a", std::wstring(1, 0x10000)) < 0);
+    }
+    select_string_kernels(best);
+}
+
+TEST_CASE("gc_table") {
+    gc_heap h{8192};
+    {
+        auto key = [&](int i) { return string{h, "key" + std::to_string(i)}; };
+        auto t = gc_table::make(h, 8);
+        REQUIRE(!t->has_hash_index());
+        constexpr int n = 200;
+        for (int i = 0; i < n; ++i) {
+            if (t->length() == t->capacity()) {
+                t = t->copy_with_increased_capacity();
+            }
+            t->insert(key(i), value{static_cast<double>(i)}, property_attribute::none);
+        }
+        REQUIRE(t->has_hash_index());
+        REQUIRE(t->live_length() == n);
+
+        // Erase every other key
+        for (int i = 0; i < n; i += 2) {
+            auto it = t->find(key(i));
+            REQUIRE(it != t->end());
+            it.erase();
+        }
+        REQUIRE(t->length() == n);
+        REQUIRE(t->live_length() == n / 2);
+
+        auto check = [&]() {
+            for (int i = 0; i < n; ++i) {
+                const auto k = key(i);
+                auto it = t->find(k);
+                auto it2 = t->find(k.view());
+                REQUIRE(it == it2);
+                if (i % 2) {
+                    REQUIRE(it != t->end());
+                    REQUIRE(it.value() == value{static_cast<double>(i)});
+                } else {
+                    REQUIRE(it == t->end());
+                }
+            }
+            // Iteration skips the erased entries and keeps the insertion order
+            int expected = 1;
+            for (auto it = t->begin(); it != t->end(); ++it, expected += 2) {
+                REQUIRE(it.key_view() == key(expected).view());
+            }
+            REQUIRE(expected == n + 1);
+        };
+        check();
+        h.garbage_collect();
+        check();
+
+        // Erased keys can be inserted again
+        t->insert(key(0), value{true}, property_attribute::none);
+        REQUIRE(t->find(key(0)).value() == value{true});
+        t->find(key(0)).erase();
+
+        // Copying drops erased entries without growing when there's enough room
+        const auto old_capacity = t->capacity();
+        t = t->copy_with_increased_capacity();
+        REQUIRE(t->capacity() == old_capacity);
+        REQUIRE(t->length() == n / 2);
+        check();
+    }
+    h.garbage_collect();
+    REQUIRE(h.calc_used() == 0);
+}
+
 TEST_CASE("object") {
     gc_heap h{128};
     {
@@ -95,6 +249,110 @@ TEST_CASE("object") {
     assert(h.calc_used() == 0);
 }
 
+TEST_CASE("object shapes") {
+    gc_heap h{1<<16};
+    {
+        const string x{h, "x"}, y{h, "y"}, z{h, "z"}, class_name{h, "Object"};
+        auto proto = object::make(h, class_name, nullptr);
+        auto make_point = [&](double i) {
+            auto o = object::make(h, class_name, proto);
+            o->put(x, value{i});
+            o->put(y, value{i * 2});
+            o->put(z, value{i * 3}, property_attribute::dont_enum);
+            return o;
+        };
+
+        // Objects with the same layout share their shapes, so only the objects and their values need space
+        auto first = make_point(0);
+        h.garbage_collect();
+        const auto used_before = h.calc_used();
+        std::vector<object_ptr> points;
+        constexpr int num_points = 100;
+        for (int i = 0; i < num_points; ++i) {
+            points.push_back(make_point(i));
+        }
+        h.garbage_collect();
+        const auto used_per_point = (h.calc_used() - used_before) * gc_heap::slot_size / num_points;
+        REQUIRE(used_per_point <= 128);
+
+        for (int i = 0; i < num_points; ++i) {
+            const auto& p = points[i];
+            REQUIRE(p->get(x.view()) == value{i * 1.0});
+            REQUIRE(p->get(y) == value{i * 2.0});
+            REQUIRE(p->get(z) == value{i * 3.0});
+            REQUIRE(p->property_names() == (std::vector<string>{x, y}));
+        }
+
+        // Deleting the last property goes back to the previous shape
+        auto& p0 = points[0];
+        REQUIRE(p0->delete_property(z.view()));
+        REQUIRE(!p0->has_property(z));
+        p0->put(z, value{42.0});
+        REQUIRE(p0->get(z) == value{42.0});
+        REQUIRE(p0->property_names() == (std::vector<string>{x, y, z}));
+
+        // Deleting other properties switches to a property table
+        auto& p1 = points[1];
+        REQUIRE(p1->delete_property(x.view()));
+        REQUIRE(!p1->has_property(x));
+        REQUIRE(p1->get(y) == value{2.0});
+        p1->put(x, value{true});
+        REQUIRE(p1->property_names() == (std::vector<string>{y, x}));
+        REQUIRE(points[2]->property_names() == (std::vector<string>{x, y}));
+
+        // As do objects with many properties
+        auto& p2 = points[2];
+        for (int i = 0; i < 100; ++i) {
+            p2->put(string{h, std::to_wstring(i)}, value{static_cast<double>(i)});
+        }
+        h.garbage_collect();
+        for (int i = 0; i < 100; ++i) {
+            REQUIRE(p2->get(std::to_wstring(i)) == value{static_cast<double>(i)});
+        }
+        REQUIRE(p2->get(x) == value{2.0});
+        REQUIRE(p2->property_names().size() == 102);
+
+        // Properties are still found through the prototype
+        proto->put(string{h, "w"}, value{1.0});
+        REQUIRE(points[3]->get(L"w") == value{1.0});
+        REQUIRE(points[3]->can_put(L"w"));
+    }
+    h.garbage_collect();
+    REQUIRE(h.calc_used() == 0);
+}
+
+TEST_CASE("gc_string_table") {
+    gc_heap h{1<<12};
+    {
+        auto table = gc_string_table::make(h, 8);
+        auto a = gc_string_table::intern(table, L"a");
+        REQUIRE(a.view() == L"a");
+        REQUIRE(a.unsafe_raw_get()->interned());
+        REQUIRE(gc_string_table::intern(table, L"a").unsafe_raw_get().get() == a.unsafe_raw_get().get());
+        REQUIRE(a == gc_string_table::intern(table, L"a"));
+        REQUIRE(!(a == gc_string_table::intern(table, L"b")));
+        REQUIRE(a == string{h, "a"});
+
+        // Force the table to grow
+        for (int i = 0; i < 100; ++i) {
+            gc_string_table::intern(table, std::to_wstring(i));
+        }
+        REQUIRE(table->capacity() > 8);
+        REQUIRE(gc_string_table::intern(table, L"a").unsafe_raw_get().get() == a.unsafe_raw_get().get());
+
+        // Only strings that are still referenced survive garbage collection
+        const auto used_before = h.calc_used();
+        h.garbage_collect();
+        REQUIRE(h.calc_used() < used_before);
+        REQUIRE(a.view() == L"a");
+        REQUIRE(gc_string_table::intern(table, L"a").unsafe_raw_get().get() == a.unsafe_raw_get().get());
+        REQUIRE(gc_string_table::intern(table, L"42").view() == L"42");
+    }
+
+    h.garbage_collect();
+    assert(h.calc_used() == 0);
+}
+
 TEST_CASE("Type Conversions") {
     gc_heap h{1<<8};
     // TODO: to_primitive hint
@@ -152,7 +410,7 @@ TEST_CASE("Type Conversions") {
 }
 
 TEST_CASE("NumberToString") {
-    gc_heap h{128};
+    gc_heap h{1024};
     REQUIRE(to_string(h, 0.005                    ) == string{h, "0.005"});
     REQUIRE(to_string(h, 0.000005                 ) == string{h, "0.000005"});
     REQUIRE(to_string(h, (0.000005+1e-10)         ) == string{h, "0.000005000100000000001"});
@@ -160,10 +418,72 @@ TEST_CASE("NumberToString") {
     REQUIRE(to_string(h, 1234.0                   ) == string{h, "1234"});
     REQUIRE(to_string(h, 1e20                     ) == string{h, "100000000000000000000"});
     REQUIRE(to_string(h, 1e21                     ) == string{h, "1e+21"});
-// FIXME: Why doesn't this work on w/ g++ 8.2.0 on Linux?
-//    REQUIRE(to_string(h, 1.7976931348623157e+308  ) == string{h, "1.7976931348623157e+308"});
+    REQUIRE(to_string(h, 1.7976931348623157e+308  ) == string{h, "1.7976931348623157e+308"});
+    REQUIRE(to_string(h, 4294967295.0             ) == string{h, "4294967295"});
+    REQUIRE(to_string(h, -4294967296.0            ) == string{h, "-4294967296"});
+    REQUIRE(to_string(h, 9007199254740991.0       ) == string{h, "9007199254740991"});
+    REQUIRE(to_string(h, 9007199254740992.0       ) == string{h, "9007199254740992"});
+    REQUIRE(to_string(h, 123456789012345680000.0  ) == string{h, "123456789012345680000"});
+    REQUIRE(to_string(h, 0.1                      ) == string{h, "0.1"});
+    REQUIRE(to_string(h, -1.5                     ) == string{h, "-1.5"});
+    REQUIRE(to_string(h, 1/3.                     ) == string{h, "0.3333333333333333"});
+    REQUIRE(to_string(h, 1.5e300                  ) == string{h, "1.5e+300"});
+    REQUIRE(to_string(h, -2.2250738585072014e-308 ) == string{h, "-2.2250738585072014e-308"});
     REQUIRE(to_string(h, 5e-324                   ) == string{h, "5e-324"});
 
     h.garbage_collect();
     assert(h.calc_used() == 0);
 }
+
+TEST_CASE("StringToNumber") {
+    auto same = [](double a, double b) { return std::isnan(a) ? std::isnan(b) : a == b && std::signbit(a) == std::signbit(b); };
+    REQUIRE(same(to_number(L""), 0));
+    REQUIRE(same(to_number(L" \t\r\n"), 0));
+    REQUIRE(same(to_number(L"  42  "), 42));
+    REQUIRE(same(to_number(L"-0"), -0.0));
+    REQUIRE(same(to_number(L"+1.5"), 1.5));
+    REQUIRE(same(to_number(L".5"), 0.5));
+    REQUIRE(same(to_number(L"5."), 5));
+    REQUIRE(same(to_number(L"1e3"), 1000));
+    REQUIRE(same(to_number(L"1E-3"), 0.001));
+    REQUIRE(same(to_number(L"0.1"), 0.1));
+    REQUIRE(same(to_number(L"0.30000000000000004"), 0.1+0.2));
+    REQUIRE(same(to_number(L"1.7976931348623157e308"), 1.7976931348623157e308));
+    REQUIRE(same(to_number(L"1e400"), INFINITY));
+    REQUIRE(same(to_number(L"-1e400"), -INFINITY));
+    REQUIRE(same(to_number(L"1e-400"), 0));
+    REQUIRE(same(to_number(L"0.0000e500"), 0));
+    REQUIRE(same(to_number(L"Infinity"), INFINITY));
+    REQUIRE(same(to_number(L"-Infinity"), -INFINITY));
+    REQUIRE(same(to_number(L"0x1F"), 31));
+    REQUIRE(same(to_number(L"0XaB"), 171));
+    REQUIRE(same(to_number(L"000123"), 123));
+    REQUIRE(same(to_number(L"12345678901234567890123456789012345678901234567890123456789012345678901234567890"), 1.2345678901234568e79));
+    REQUIRE(same(to_number(L"0x"), NAN));
+    REQUIRE(same(to_number(L"-0x10"), NAN));
+    REQUIRE(same(to_number(L"."), NAN));
+    REQUIRE(same(to_number(L"e5"), NAN));
+    REQUIRE(same(to_number(L"1e"), NAN));
+    REQUIRE(same(to_number(L"1,2"), NAN));
+    REQUIRE(same(to_number(L"inf"), NAN));
+    REQUIRE(same(to_number(L"1 2"), NAN));
+
+    double d = 0;
+    REQUIRE(parse_decimal_prefix(L"42.25x", d) == 5);
+    REQUIRE(d == 42.25);
+    REQUIRE(parse_decimal_prefix(L"1e+x", d) == 1);
+    REQUIRE(d == 1);
+    REQUIRE(parse_decimal_prefix(L"-Infinityx", d) == 9);
+    REQUIRE(d == -INFINITY);
+    REQUIRE(parse_decimal_prefix(L"x1", d) == 0);
+
+    REQUIRE(string_to_index(L"0") == 0);
+    REQUIRE(string_to_index(L"42") == 42);
+    REQUIRE(string_to_index(L"4294967294") == 4294967294);
+    REQUIRE(string_to_index(L"4294967295") == UINT32_MAX);
+    REQUIRE(string_to_index(L"99999999999") == UINT32_MAX);
+    REQUIRE(string_to_index(L"") == UINT32_MAX);
+    REQUIRE(string_to_index(L"01") == UINT32_MAX);
+    REQUIRE(string_to_index(L"1.0") == UINT32_MAX);
+    REQUIRE(string_to_index(L"-1") == UINT32_MAX);
+}